@@ -0,0 +1,99 @@
+#version 150
+
+//Vertex of the shared patch grid, integer coordinates 0..GridSize
+in vec2 vGrid;
+
+//Two texels per instance: (face, x, y, size) and (morph_start, morph_end),
+//see GlobePatch in Globe.h
+uniform samplerBuffer Patches;
+uniform float GridSize;
+
+//Camera position in object space, for the morph distance
+uniform vec3 CameraPosition;
+
+//Equirectangular heights in [0,1], scaled to the displacement above the
+//unit sphere
+uniform sampler2D textureElevation;
+uniform float ElevationScale;
+
+uniform mat4 ModelViewEarth;
+uniform mat4 Projection;
+uniform mat4 NormalMatrix;
+
+out vec4 pos;
+out vec4 N;
+out vec2 texCoord;
+
+const float PI = 3.14159265358979;
+
+//globeCubeToSphere() in Globe.cpp
+vec3 cubeToSphere(int face, vec2 uv)
+{
+  vec3 p;
+  if (face == 0)      p = vec3( 1.0,  uv.y, -uv.x);
+  else if (face == 1) p = vec3(-1.0,  uv.y,  uv.x);
+  else if (face == 2) p = vec3( uv.x,  1.0, -uv.y);
+  else if (face == 3) p = vec3( uv.x, -1.0,  uv.y);
+  else if (face == 4) p = vec3( uv.x,  uv.y,  1.0);
+  else                p = vec3(-uv.x,  uv.y, -1.0);
+  vec3 p2 = p*p;
+  return p*sqrt(1.0 - 0.5*p2.yzx - 0.5*p2.zxy + p2.yzx*p2.zxy/3.0);
+}
+
+//Longitude as in makeSphere(), in (-0.5, 0.5], and latitude from the north pole
+float longitude(vec3 dir)
+{
+  return atan(dir.z, -dir.x) / (2.0*PI);
+}
+
+float latitude(vec3 dir)
+{
+  return acos(clamp(dir.y, -1.0, 1.0)) / PI;
+}
+
+//Displaced surface point at face coordinates uv
+vec3 surface(int face, vec2 uv)
+{
+  vec3 dir = cubeToSphere(face, uv);
+  float height = textureLod(textureElevation, vec2(longitude(dir), latitude(dir)), 0.0).r;
+  return dir*(1.0 + ElevationScale*height);
+}
+
+void main()
+{
+  vec4 tile = texelFetch(Patches, 2*gl_InstanceID);
+  vec4 morph = texelFetch(Patches, 2*gl_InstanceID + 1);
+  int face = int(tile.x);
+  float cell = tile.w / GridSize;
+
+  //Fold the odd vertices by their distance onto the parent's triangles:
+  //toward the middle of the parent edge they lie on, or of the quad
+  //diagonal for odd/odd.  The target does not depend on which side of the
+  //edge, or which cube face, the patch is on, so neighbours agree exactly
+  vec3 position = surface(face, tile.yz + vGrid*cell);
+  vec2 odd = fract(vGrid*0.5)*2.0;
+  float d = distance(CameraPosition, cubeToSphere(face, tile.yz + vGrid*cell));
+  float m = clamp((d - morph.x) / max(morph.y - morph.x, 1e-6), 0.0, 1.0);
+  if (odd.x + odd.y > 0.0 && m > 0.0) {
+    vec2 a = vGrid + vec2(odd.x, -odd.y);
+    vec2 b = vGrid + vec2(-odd.x, odd.y);
+    vec3 parent = 0.5*(surface(face, tile.yz + a*cell) + surface(face, tile.yz + b*cell));
+    position = mix(position, parent, m);
+  }
+  vec3 dir = normalize(position);
+  float u = longitude(dir);
+  float v = latitude(dir);
+
+  //Keep u within half a turn of the tile center, so no triangle
+  //interpolates across the seam
+  vec3 center = cubeToSphere(face, tile.yz + 0.5*tile.w);
+  texCoord = vec2(u + round(longitude(center) - u), v);
+
+  pos = ModelViewEarth * vec4(position, 1.0);
+
+  N = NormalMatrix*vec4(dir, 0.0);
+  N.w = 0.0;
+  N = normalize(N);
+
+  gl_Position = Projection * pos;
+}
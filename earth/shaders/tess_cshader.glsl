@@ -0,0 +1,61 @@
+#version 400
+
+//Quad patch, corners counter clockwise from (u,v) = (0,0)
+layout(vertices = 4) out;
+
+in vec3 cCorner[];
+out vec3 eCorner[];
+
+uniform mat4 ModelViewEarth;
+uniform mat4 Projection;
+uniform float ViewportHeight;
+
+//Wanted length of a tessellated edge on screen, in pixels
+uniform float EdgePixels;
+
+//globeCubeToSphere() in Globe.cpp
+vec3 cubeToSphere(int face, vec2 uv)
+{
+  vec3 p;
+  if (face == 0)      p = vec3( 1.0,  uv.y, -uv.x);
+  else if (face == 1) p = vec3(-1.0,  uv.y,  uv.x);
+  else if (face == 2) p = vec3( uv.x,  1.0, -uv.y);
+  else if (face == 3) p = vec3( uv.x, -1.0,  uv.y);
+  else if (face == 4) p = vec3( uv.x,  uv.y,  1.0);
+  else                p = vec3(-uv.x,  uv.y, -1.0);
+  vec3 p2 = p*p;
+  return p*sqrt(1.0 - 0.5*p2.yzx - 0.5*p2.zxy + p2.yzx*p2.zxy/3.0);
+}
+
+//Pixels covered by the sphere around the edge a-b, at its distance from
+//the eye.  Depends only on the two end points, so the patches on either
+//side of an edge, on either cube face, agree on its level.  At most 16,
+//finer detail comes from more coarse patches
+float edgeLevel(vec3 a, vec3 b)
+{
+  vec4 middle = ModelViewEarth * vec4(0.5*(a + b), 1.0);
+  float depth = max(-middle.z, 0.01);
+  float pixels = distance(a, b) * Projection[1][1] * 0.5*ViewportHeight / depth;
+  return clamp(pixels / EdgePixels, 1.0, 16.0);
+}
+
+void main()
+{
+  eCorner[gl_InvocationID] = cCorner[gl_InvocationID];
+
+  if (gl_InvocationID == 0) {
+    int face = int(cCorner[0].x);
+    vec3 p0 = cubeToSphere(face, cCorner[0].yz);
+    vec3 p1 = cubeToSphere(face, cCorner[1].yz);
+    vec3 p2 = cubeToSphere(face, cCorner[2].yz);
+    vec3 p3 = cubeToSphere(face, cCorner[3].yz);
+
+    //Outer edges u=0, v=0, u=1, v=1
+    gl_TessLevelOuter[0] = edgeLevel(p3, p0);
+    gl_TessLevelOuter[1] = edgeLevel(p0, p1);
+    gl_TessLevelOuter[2] = edgeLevel(p1, p2);
+    gl_TessLevelOuter[3] = edgeLevel(p2, p3);
+    gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+    gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+  }
+}
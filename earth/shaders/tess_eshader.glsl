@@ -0,0 +1,64 @@
+#version 400
+
+//Integer levels, so neighbours with the same edge level share its points
+layout(quads, equal_spacing, ccw) in;
+
+in vec3 eCorner[];
+
+uniform mat4 ModelViewEarth;
+uniform mat4 Projection;
+uniform mat4 NormalMatrix;
+
+out vec4 pos;
+out vec4 N;
+out vec2 texCoord;
+
+const float PI = 3.14159265358979;
+
+//globeCubeToSphere() in Globe.cpp
+vec3 cubeToSphere(int face, vec2 uv)
+{
+  vec3 p;
+  if (face == 0)      p = vec3( 1.0,  uv.y, -uv.x);
+  else if (face == 1) p = vec3(-1.0,  uv.y,  uv.x);
+  else if (face == 2) p = vec3( uv.x,  1.0, -uv.y);
+  else if (face == 3) p = vec3( uv.x, -1.0,  uv.y);
+  else if (face == 4) p = vec3( uv.x,  uv.y,  1.0);
+  else                p = vec3(-uv.x,  uv.y, -1.0);
+  vec3 p2 = p*p;
+  return p*sqrt(1.0 - 0.5*p2.yzx - 0.5*p2.zxy + p2.yzx*p2.zxy/3.0);
+}
+
+//Longitude as in makeSphere(), in (-0.5, 0.5], and latitude from the north pole
+float longitude(vec3 dir)
+{
+  return atan(dir.z, -dir.x) / (2.0*PI);
+}
+
+float latitude(vec3 dir)
+{
+  return acos(clamp(dir.y, -1.0, 1.0)) / PI;
+}
+
+void main()
+{
+  //Face coordinates are affine over the patch
+  int face = int(eCorner[0].x);
+  vec2 low = eCorner[0].yz;
+  vec2 high = eCorner[2].yz;
+  vec3 dir = cubeToSphere(face, mix(low, high, gl_TessCoord.xy));
+
+  //Keep u within half a turn of the patch center, so no triangle
+  //interpolates across the seam
+  float u = longitude(dir);
+  float center = longitude(cubeToSphere(face, 0.5*(low + high)));
+  texCoord = vec2(u + round(center - u), latitude(dir));
+
+  pos = ModelViewEarth * vec4(dir, 1.0);
+
+  N = NormalMatrix*vec4(dir, 0.0);
+  N.w = 0.0;
+  N = normalize(N);
+
+  gl_Position = Projection * pos;
+}
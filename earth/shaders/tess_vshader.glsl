@@ -0,0 +1,12 @@
+#version 400
+
+//Corner of a coarse cube-sphere patch: (face, u, v) in face coordinates,
+//see globeCubeToSphere() in Globe.cpp
+in vec3 vCorner;
+
+out vec3 cCorner;
+
+void main()
+{
+  cCorner = vCorner;
+}
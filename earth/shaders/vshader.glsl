@@ -9,21 +9,79 @@ uniform mat4 ModelViewEarth;
 uniform mat4 Projection;
 uniform mat4 NormalMatrix;
 
+//Decode of compact vertices (see VertexPack.h): positions are unorm16
+//against the bounding box, normals are octahedral snorm16x2 in vNormal.xy
+uniform vec3 PositionScale;
+uniform vec3 PositionBias;
+uniform bool OctNormals;
+
+//Procedural globe: with GlobeSteps > 0 the vertex attributes are unused and
+//triangle gl_VertexID/3 of a GlobeSteps x GlobeSteps (latitude, longitude)
+//grid is rebuilt here in makeSphere()'s order: six vertices per grid quad,
+//three on the two pole rows, whose other triangle would be degenerate
+uniform int GlobeSteps;
+
 out vec4 pos;
 out vec4 N;
 out vec2 texCoord;
 
 
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
+const float PI = 3.14159265358979;
+
+//Row and column offsets of the six corners of a grid quad
+const ivec2 quadCorners[6] = ivec2[6](ivec2(0,0), ivec2(1,0), ivec2(0,1),
+                                      ivec2(0,1), ivec2(1,0), ivec2(1,1));
 
 void main()
 {
+  vec4 position;
+  vec3 normal;
   
-  texCoord    = vTexCoord;
+  if (GlobeSteps > 0) {
+    int quads = GlobeSteps - 1;
+    int id = gl_VertexID;
+    ivec2 quad;
+    int corner;
+    if (id < 3*quads) {
+      quad = ivec2(0, id / 3);                        //north pole row, second triangles
+      corner = 3 + id % 3;
+    } else if (id < 3*quads + 6*quads*(quads-2)) {
+      id -= 3*quads;
+      quad = ivec2(1 + id / (6*quads), (id / 6) % quads);
+      corner = id % 6;
+    } else {
+      id -= 3*quads + 6*quads*(quads-2);
+      quad = ivec2(quads - 1, id / 3);                //south pole row, first triangles
+      corner = id % 3;
+    }
+    ivec2 grid = quad + quadCorners[corner];
+    vec2 uv = vec2(grid.y, grid.x) / float(quads);
+    float phi = uv.y * PI;
+    float theta = uv.x * 2.0 * PI;
+    
+    //On the unit sphere the position is its own normal
+    normal = vec3(-cos(theta) * sin(phi), cos(phi), sin(theta) * sin(phi));
+    position = vec4(normal, 1.0);
+    texCoord = uv;
+  } else {
+    position = vec4(vPosition.xyz*PositionScale + PositionBias, 1.0);
+    normal = OctNormals ? octDecode(vNormal.xy) : vNormal;
+    texCoord = vTexCoord;
+  }
   
-  pos = ModelViewEarth * vPosition;
+  pos = ModelViewEarth * position;
 
   // Transform vertex normal into eye coordinates
-  N = NormalMatrix*vec4(vNormal, 0.0);
+  N = NormalMatrix*vec4(normal, 0.0);
   N.w = 0.0;
   N = normalize(N);
 
@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- AssetBundle.h ---
+//
+//  Read side of the baked asset bundles written by assetc.  A bundle holds
+//  every asset of a program under the name it is otherwise loaded by
+//  relative to source_path ("/models/bunny.obj", "/skybox/2",
+//  "/images/perlin_noise.png"), already in the form the program uploads:
+//
+//    ASSET_MESH     a .meshbin (see MeshCache.h), optimized with LODs,
+//                   meshlets and tangents, offsets relative to the asset
+//    ASSET_TEXTURE  RGBA8 pixels, levels mip levels from the full size down
+//    ASSET_CUBEMAP  six RGBA8 faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order,
+//                   each followed by its mip levels
+//
+//  Layout: the header below, the asset payloads at 16 byte aligned
+//  offsets, then num_assets AssetRecords sorted by name at assets_offset.
+//  Native (little endian) byte order.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ASSET_BUNDLE_H__
+#define __ASSET_BUNDLE_H__
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <string>
+
+#define ASSET_BUNDLE_MAGIC   "ASSETBN"
+#define ASSET_BUNDLE_VERSION 1
+
+enum AssetType{ ASSET_MESH = 1, ASSET_TEXTURE = 2, ASSET_CUBEMAP = 3 };
+
+struct AssetBundleHeader{
+  char     magic[8];          //ASSET_BUNDLE_MAGIC, null padded
+  uint32_t version;           //ASSET_BUNDLE_VERSION
+  uint32_t num_assets;
+  uint64_t assets_offset;     //byte offset of the AssetRecord table
+};
+
+struct AssetRecord{
+  char     name[96];          //null padded, compared with strncmp
+  uint32_t type;              //AssetType
+  uint32_t width;             //level 0 of textures and cubemap faces, 0 for meshes
+  uint32_t height;
+  uint32_t levels;            //mip levels per face
+  uint64_t offset;            //payload, from the start of the bundle
+  uint64_t size;
+};
+
+//A piece of the mapped bundle; valid while the AssetBundle stays open
+struct AssetSpan{
+  const unsigned char *data;
+  size_t size;
+
+  AssetSpan() : data(NULL), size(0) {}
+  AssetSpan(const unsigned char *data, size_t size) : data(data), size(size) {}
+};
+
+/**
+  A bundle mapped into memory.  Lookups and spans touch only the pages
+    they need and never copy, so textures can be handed to glTexImage2D
+    straight out of the mapping.
+**/
+class AssetBundle{
+public:
+  AssetBundle() : header(NULL), records(NULL) {}
+
+  //Map path and check its header and table, false if it is not a bundle
+  bool open(const char * path);
+  void close();
+  bool isOpen() const { return records != NULL; }
+
+  size_t size() const { return header ? header->num_assets : 0; }
+  const AssetRecord &record(size_t i) const { return records[i]; }
+
+  //Binary search of the table, NULL if name is missing or of another type
+  const AssetRecord *find(const char * name, AssetType type) const;
+
+  //The whole payload of an asset
+  AssetSpan span(const AssetRecord &asset) const;
+
+  /**
+    One mip level of a texture or cubemap face.
+    @param face 0 for textures, 0 to 5 for cubemaps
+    @param width, height receive the level's size
+  **/
+  AssetSpan level(const AssetRecord &asset, unsigned int face, unsigned int level,
+                  unsigned int &width, unsigned int &height) const;
+
+private:
+  MappedFile file;
+  const AssetBundleHeader *header;
+  const AssetRecord *records;
+
+  AssetBundle(const AssetBundle&);
+  AssetBundle& operator=(const AssetBundle&);
+};
+
+//Bytes of levels RGBA8 mip levels starting at width x height
+uint64_t assetMipChainBytes(unsigned int width, unsigned int height, unsigned int levels);
+
+//Levels down to 1x1 for a width x height image
+unsigned int assetMipLevels(unsigned int width, unsigned int height);
+
+//"assets.bundle#/models/bunny.obj" <-> ("assets.bundle", "/models/bunny.obj")
+bool splitAssetPath(const std::string &path, std::string &file, std::string &name);
+std::string assetPath(const std::string &file, const std::string &name);
+
+#endif //__ASSET_BUNDLE_H__
@@ -0,0 +1,182 @@
+#include "Globe.h"
+
+vec3 globeCubeToSphere(int face, float u, float v){
+  //Point of the face with right x up = outward normal, so counter clockwise
+  //grid triangles face outward
+  vec3 p;
+  switch( face ){
+    case 0:  p = vec3( 1.0f,     v,    -u); break;
+    case 1:  p = vec3(-1.0f,     v,     u); break;
+    case 2:  p = vec3(    u,  1.0f,    -v); break;
+    case 3:  p = vec3(    u, -1.0f,     v); break;
+    case 4:  p = vec3(    u,     v,  1.0f); break;
+    default: p = vec3(   -u,     v, -1.0f); break;
+  }
+  vec3 p2(p.x*p.x, p.y*p.y, p.z*p.z);
+  return vec3(p.x*sqrtf(1.0f - 0.5f*p2.y - 0.5f*p2.z + p2.y*p2.z/3.0f),
+              p.y*sqrtf(1.0f - 0.5f*p2.z - 0.5f*p2.x + p2.z*p2.x/3.0f),
+              p.z*sqrtf(1.0f - 0.5f*p2.x - 0.5f*p2.y + p2.x*p2.y/3.0f));
+}
+
+GlobeQuadtree::GlobeQuadtree(unsigned int max_depth, float lod_range, float max_elevation)
+  : culling(true), max_depth(max_depth), max_elevation(max_elevation){
+  //Ranges halve with the patch diameter, from the root bound
+  float root_radius = node(0, -1.0f, -1.0f, 0).radius;
+  ranges.resize(max_depth+1);
+  for(unsigned int d=0; d <= max_depth; d++){
+    ranges[d] = lod_range*2.0f*root_radius/float(1u << d);
+  }
+  
+  //Flat grid triangles dip below the unit sphere, at most to the cosine of
+  //the widest cell diagonal, which is on the root patches
+  occluder_radius = 1.0f;
+  float cell = 2.0f/GLOBE_GRID;
+  for(int j=0; j < GLOBE_GRID; j++){
+    for(int i=0; i < GLOBE_GRID; i++){
+      float u = -1.0f + cell*i, v = -1.0f + cell*j;
+      occluder_radius = (std::min)(occluder_radius, dot(globeCubeToSphere(0, u, v),
+                                                        globeCubeToSphere(0, u + cell, v + cell)));
+      occluder_radius = (std::min)(occluder_radius, dot(globeCubeToSphere(0, u + cell, v),
+                                                        globeCubeToSphere(0, u, v + cell)));
+    }
+  }
+}
+
+//Sphere around a 3x3 sample of the patch, at zero and full elevation; the
+//margin covers the bulge between samples
+GlobePatch GlobeQuadtree::node(int face, float x, float y, unsigned int depth) const{
+  GlobePatch patch;
+  patch.face = (float) face;
+  patch.x = x;
+  patch.y = y;
+  patch.size = 2.0f/float(1u << depth);   //power of two sizes keep shared corners bit exact
+  patch.depth = depth;
+  patch.center = globeCubeToSphere(face, x + 0.5f*patch.size, y + 0.5f*patch.size);
+  patch.radius = 0;
+  for(int j=0; j <= 2; j++){
+    for(int i=0; i <= 2; i++){
+      vec3 p = globeCubeToSphere(face, x + 0.5f*patch.size*i, y + 0.5f*patch.size*j);
+      patch.radius = (std::max)(patch.radius, length(p - patch.center));
+      patch.radius = (std::max)(patch.radius, length(p*(1.0f + max_elevation) - patch.center));
+    }
+  }
+  patch.radius *= 1.05f;
+  
+  //Undisplaced normals are the sphere points; the corners are the furthest
+  //from the center
+  patch.cone_axis = normalize(patch.center);
+  float cone_cos = 1.0f;
+  for(int j=0; j <= 1; j++){
+    for(int i=0; i <= 1; i++){
+      cone_cos = (std::min)(cone_cos, dot(patch.cone_axis, globeCubeToSphere(face, x + patch.size*i, y + patch.size*j)));
+    }
+  }
+  patch.cone_cutoff = (cone_cos > 0.0f) ? sqrtf(1.0f - cone_cos*cone_cos) : 2.0f;  //a half space or more never faces away
+
+  if( depth == 0 ){
+    patch.morph_start = patch.morph_end = 1e30f;     //nothing to fold onto
+  }else{
+    patch.morph_end = ranges[depth-1];
+    patch.morph_start = 0.8f*ranges[depth-1];
+  }
+  return patch;
+}
+
+bool GlobeQuadtree::behindHorizon(const GlobePatch &patch, const vec3 &camera) const{
+  //In units of the occluder radius
+  vec3 eye = camera/occluder_radius;
+  vec3 center = patch.center/occluder_radius;
+  float radius = patch.radius/occluder_radius;
+  float distance = length(eye);
+  if( distance <= 1.0f ){ return false; }
+  
+  //Past the plane of the horizon circle and inside the cone tangent to the
+  //occluder, every point is behind it
+  if( dot(center, eye)/distance + radius >= 1.0f/distance ){ return false; }
+  vec3 to_center = center - eye;
+  float to_center_length = length(to_center);
+  if( to_center_length <= radius ){ return false; }
+  float off_axis = acosf((std::max)(-1.0f, (std::min)(1.0f, -dot(to_center, eye)/(to_center_length*distance))));
+  return off_axis + asinf(radius/to_center_length) < asinf(1.0f/distance);
+}
+
+bool GlobeQuadtree::backFacing(const GlobePatch &patch, const vec3 &camera) const{
+  vec3 to_center = patch.center - camera;
+  return dot(to_center, patch.cone_axis) >= patch.cone_cutoff*length(to_center) + patch.radius;
+}
+
+bool GlobeQuadtree::outsideFrustum(const GlobePatch &patch, const vec4 planes[6]) const{
+  for(int i=0; i < 6; i++){
+    vec3 normal(planes[i].x, planes[i].y, planes[i].z);
+    if( dot(normal, patch.center) + planes[i].w < -patch.radius*length(normal) ){ return true; }
+  }
+  return false;
+}
+
+void GlobeQuadtree::select(const vec3 &camera, const mat4 &object_to_clip, std::vector< GlobePatch > &patches,
+                           unsigned int max_patches, GlobeStats &stats) const{
+  //Clip planes in object space, from the rows of object_to_clip
+  vec4 planes[6];
+  for(int i=0; i < 3; i++){
+    planes[2*i]   = object_to_clip[3] + object_to_clip[i];
+    planes[2*i+1] = object_to_clip[3] - object_to_clip[i];
+  }
+
+  //One level at a time: the patches of a level either split into the next
+  //one or are drawn.  A level that would go over max_patches is not split
+  //at all, which is the same tree a smaller max_depth gives, so the
+  //neighbour guarantees hold
+  std::vector< GlobePatch > level, next;
+  for(int face=0; face < 6; face++){ level.push_back(node(face, -1.0f, -1.0f, 0)); }
+  patches.clear();
+  stats = GlobeStats();
+  std::vector< char > split;
+  while( !level.empty() ){
+    //Hidden patches are neither drawn nor split.  Displaced normals are not
+    //in the cone, so only the horizon applies to a globe with elevation
+    if( culling ){
+      size_t kept = 0;
+      for(size_t i=0; i < level.size(); i++){
+        if( outsideFrustum(level[i], planes) ){
+          stats.culled_frustum++;
+        }else if( behindHorizon(level[i], camera) ){
+          stats.culled_horizon++;
+        }else if( max_elevation == 0.0f && backFacing(level[i], camera) ){
+          stats.culled_backface++;
+        }else{
+          level[kept++] = level[i];
+        }
+      }
+      level.resize(kept);
+    }
+    
+    size_t splits = 0;
+    split.assign(level.size(), 0);
+    for(size_t i=0; i < level.size(); i++){
+      const GlobePatch &p = level[i];
+      float distance = (std::max)(0.0f, length(camera - p.center) - p.radius);
+      split[i] = p.depth < max_depth && distance < ranges[p.depth];
+      splits += split[i];
+    }
+    if( patches.size() + level.size() + 3*splits > max_patches ){ splits = 0; }
+
+    next.clear();
+    for(size_t i=0; i < level.size(); i++){
+      const GlobePatch &p = level[i];
+      if( splits == 0 || !split[i] ){
+        patches.push_back(p);
+        continue;
+      }
+      float half = 0.5f*p.size;
+      next.push_back(node((int) p.face, p.x,        p.y,        p.depth+1));
+      next.push_back(node((int) p.face, p.x + half, p.y,        p.depth+1));
+      next.push_back(node((int) p.face, p.x,        p.y + half, p.depth+1));
+      next.push_back(node((int) p.face, p.x + half, p.y + half, p.depth+1));
+    }
+    level.swap(next);
+  }
+
+  stats.patches = (unsigned int) patches.size();
+  stats.triangles = stats.patches*2*GLOBE_GRID*GLOBE_GRID;
+  for(size_t i=0; i < patches.size(); i++){ stats.depth = (std::max)(stats.depth, patches[i].depth); }
+}
@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Globe.h ---
+//
+//  Chunked LOD globe (CDLOD): the unit sphere as the six faces of a cube,
+//  each the root of a quadtree of square patches.  Every frame select()
+//  walks the trees from the camera and returns the patches to draw.  All
+//  of them share one GLOBE_GRID x GLOBE_GRID grid, drawn instanced;
+//  globe_vshader.glsl places it on the patch, projects it to the sphere
+//  and displaces it by the elevation raster.
+//
+//  A patch splits while the camera is closer than lod_range times its
+//  diameter, so patches keep about the same size on screen.  As the camera
+//  nears the distance at which a patch's parent stops splitting, the
+//  patch's odd grid vertices fold onto the parent's triangles.  Neighbours
+//  one level apart then meet without cracks, and levels change without
+//  popping.
+//
+//  Patches that cannot be seen are neither drawn nor split: those outside
+//  the view frustum, those whose bounding sphere is hidden behind the
+//  horizon of the unit sphere, and on a flat globe those whose normal
+//  cone faces away from the camera.  Every level adds a ring of patches
+//  around the camera, but the frustum keeps only the part of the ring in
+//  view, so the triangle count stays within about 2.5x over the zoom range
+//  (25k to 62k triangles at lod_range 4 and a 45 degree view).  select()
+//  also stops splitting, coarsest levels first, at max_patches.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __GLOBE_H__
+#define __GLOBE_H__
+
+#include "common.h"
+
+using namespace Angel;
+
+#define GLOBE_GRID 16           //quads along the edge of every patch
+
+//One quadtree node to draw
+struct GlobePatch{
+  float face;                   //cube face, see globeCubeToSphere()
+  float x, y;                   //lower corner in face coordinates, [-1,1]
+  float size;                   //edge length in face coordinates
+  float morph_start;            //camera distances over which the odd vertices
+  float morph_end;              //fold onto the parent grid
+  unsigned int depth;           //0 for a whole cube face
+  vec3 center;                  //bounding sphere in object space, elevation included
+  float radius;
+  vec3 cone_axis;               //normal cone of the undisplaced patch
+  float cone_cutoff;            //sine of its half angle
+};
+
+//Counts of the last select(); only the quadtree globe is culled
+struct GlobeStats{
+  unsigned int patches;
+  unsigned int triangles;
+  unsigned int depth;           //deepest patch
+  unsigned int culled_frustum;  //patches dropped outside the view
+  unsigned int culled_horizon;  //patches dropped behind the horizon
+  unsigned int culled_backface; //patches dropped facing away
+
+  GlobeStats() : patches(0), triangles(0), depth(0), culled_frustum(0), culled_horizon(0), culled_backface(0) {}
+
+  //Share of the patches reached that were culled
+  float cullRatio() const{
+    unsigned int culled = culled_frustum + culled_horizon + culled_backface;
+    return culled ? float(culled)/float(culled + patches) : 0.0f;
+  }
+};
+
+class GlobeQuadtree{
+public:
+  bool culling;                 //frustum, horizon and back face culling in select()
+  
+  /**
+    @param max_depth deepest level below the cube faces
+    @param lod_range split distance in patch diameters; from 2 up
+      neighbours differ by one level at most, and the finer one is fully
+      folded where they meet
+    @param max_elevation largest displacement above the unit sphere
+  **/
+  GlobeQuadtree(unsigned int max_depth=14, float lod_range=2.0f, float max_elevation=0.0f);
+
+  /**
+    Patches covering the visible sphere for a camera at camera, with
+      object_to_clip the projection times the model view.  Levels are
+      refined breadth first, so when max_patches is reached the
+      finest levels are the ones left out.
+  **/
+  void select(const vec3 &camera, const mat4 &object_to_clip, std::vector< GlobePatch > &patches,
+              unsigned int max_patches, GlobeStats &stats) const;
+
+private:
+  unsigned int max_depth;
+  float max_elevation;
+  std::vector< float > ranges;  //split distance by depth
+  float occluder_radius;        //sphere inside every drawn patch grid
+
+  //Patch of the given depth and corner, with its bound and morph range
+  GlobePatch node(int face, float x, float y, unsigned int depth) const;
+  
+  //Bounding sphere entirely outside one of the clip planes
+  bool outsideFrustum(const GlobePatch &patch, const vec4 planes[6]) const;
+  
+  //Bounding sphere entirely behind the occluder as seen from camera
+  bool behindHorizon(const GlobePatch &patch, const vec3 &camera) const;
+  
+  //Every normal of the cone faces away from camera, anywhere in the bound
+  bool backFacing(const GlobePatch &patch, const vec3 &camera) const;
+};
+
+/**
+  Face coordinates (u,v) in [-1,1] of cube face 0..5 (+x, -x, +y, -y, +z,
+    -z) on the unit sphere, spread more evenly than by normalizing the cube
+    point.  Must match cubeToSphere() in globe_vshader.glsl.
+**/
+vec3 globeCubeToSphere(int face, float u, float v);
+
+#endif //__GLOBE_H__
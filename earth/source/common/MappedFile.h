@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MappedFile.h ---
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+
+/**
+  Memory mapping of a whole file, read-only unless made with create().
+    The contents are NOT null terminated; always bound reads with data+size.
+**/
+class MappedFile{
+public:
+  const char *data;
+  size_t size;
+
+  MappedFile();
+  ~MappedFile(){ close(); }
+
+  /**
+    Map a file into memory.
+    @param path UTF-8 file name (converted with u8names on Windows)
+    @return false if the file can not be opened or mapped
+  **/
+  bool open(const char * path);
+
+  /**
+    Create (or truncate) a zero filled file of size bytes and map it
+      read-write; changes go to the file.
+    @param path UTF-8 file name (converted with u8names on Windows)
+  **/
+  bool create(const char * path, size_t size);
+  void close();
+
+  bool isOpen() const { return opened; }
+
+  //Mapping of a file made with create(), NULL for read-only files
+  char *writable() const { return writable_map ? (char *) data : NULL; }
+
+  /**
+    Drop the pages of [offset, offset+bytes) from the process's resident
+      set.  The contents stay in the file (and the OS cache) and are read
+      back on the next access, so out-of-core passes can walk files larger
+      than memory with a bounded footprint.
+  **/
+  void release(size_t offset, size_t bytes);
+  void release(){ release(0, size); }
+
+private:
+  bool opened;
+  bool writable_map;
+#ifdef _WIN32
+  void *file;     //HANDLE from CreateFileW
+  void *mapping;  //HANDLE from CreateFileMapping
+#else
+  int fd;
+#endif //_WIN32
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+#endif //__MAPPED_FILE_H__
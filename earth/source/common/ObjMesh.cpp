@@ -8,6 +8,7 @@ bool Mesh::loadOBJ(const char * path){
   std::vector< vec3 > temp_normals;
   
   hasUV = true;
+  indices.clear();
   
 #ifdef _WIN32
   std::wstring wcfn;
@@ -141,64 +142,59 @@ bool Mesh::makeSphere(int steps) {
   vertices.clear();
   normals.clear();
   uvs.clear();
+  indices.clear();
+  if (steps < 2) { return false; }
+
+  //steps x steps grid of (latitude, longitude) vertices, each emitted once.
+  //Longitude 0 and 2*pi are separate columns so the seam gets both u = 0
+  //and u = 1; the pole rows keep a vertex per column for the same reason
+  unsigned int n = (unsigned int) steps;
+  vertices.reserve(n * n);
+  normals.reserve(n * n);
+  uvs.reserve(n * n);
 
   double step_theta = (2 * M_PI) / (double)(steps - 1);
   double step_phi   = (M_PI) / (double)(steps - 1);
 
-  std::vector<vec3> pstrip0;
-  std::vector<vec3> pstrip1;
-  std::vector<vec2> uvstrip0;
-  std::vector<vec2> uvstrip1;
-
   // latitude
-  for (unsigned int i = 0; i < (unsigned)steps; i++) {
+  for (unsigned int i = 0; i < n; i++) {
     double phi = i * step_phi;
     double vc  = (double)i / (steps - 1);
+    double sin_phi = sin(phi), cos_phi = cos(phi);
 
     // longitude
-    for (unsigned int j = 0; j < (unsigned)steps; j++) {
+    for (unsigned int j = 0; j < n; j++) {
       double theta = j * step_theta;
       double uc    = (double)j / (steps - 1);
 
+      //On the unit sphere the position is its own normal
       vec3 p = vec3(
-        -cos(theta) * sin(phi),
-        cos(phi),
-        sin(theta) * sin(phi)
+        -cos(theta) * sin_phi,
+        cos_phi,
+        sin(theta) * sin_phi
       );
-      pstrip1.push_back(p);
-      uvstrip1.push_back(vec2(uc, vc));
+      vertices.push_back(p);
+      normals.push_back(p);
+      uvs.push_back(vec2(uc, vc));
     }
+  }
 
-    for (unsigned int k = 0; (k + 1) < pstrip0.size(); k++) {
-      // positions
-      vertices.push_back(pstrip0[k]);
-      vertices.push_back(pstrip1[k]);
-      vertices.push_back(pstrip0[k + 1]);
-      vertices.push_back(pstrip0[k + 1]);
-      vertices.push_back(pstrip1[k]);
-      vertices.push_back(pstrip1[k + 1]);
-
-      // normals (normalized position on unit sphere)
-      normals.push_back(normalize(pstrip0[k]));
-      normals.push_back(normalize(pstrip1[k]));
-      normals.push_back(normalize(pstrip0[k + 1]));
-      normals.push_back(normalize(pstrip0[k + 1]));
-      normals.push_back(normalize(pstrip1[k]));
-      normals.push_back(normalize(pstrip1[k + 1]));
-
-      // texture coordinates
-      uvs.push_back(uvstrip0[k]);
-      uvs.push_back(uvstrip1[k]);
-      uvs.push_back(uvstrip0[k + 1]);
-      uvs.push_back(uvstrip0[k + 1]);
-      uvs.push_back(uvstrip1[k]);
-      uvs.push_back(uvstrip1[k + 1]);
+  //Two triangles per grid quad, one where the quad touches a pole
+  indices.reserve(6 * (n - 1) * (n - 2));
+  for (unsigned int i = 1; i < n; i++) {
+    unsigned int row0 = (i - 1) * n, row1 = i * n;
+    for (unsigned int k = 0; k + 1 < n; k++) {
+      if (i > 1) {
+        indices.push_back(row0 + k);
+        indices.push_back(row1 + k);
+        indices.push_back(row0 + k + 1);
+      }
+      if (i + 1 < n) {
+        indices.push_back(row0 + k + 1);
+        indices.push_back(row1 + k);
+        indices.push_back(row1 + k + 1);
+      }
     }
-
-    pstrip1.swap(pstrip0);
-    uvstrip1.swap(uvstrip0);
-    pstrip1.clear();
-    uvstrip1.clear();
   }
 
   return true;
@@ -15,6 +15,10 @@ public:
   std::vector < vec2 > uvs;
   std::vector < vec3 > normals;
   
+  //Triangle list into the arrays above; empty when they are unindexed
+  //triangles (loadOBJ())
+  std::vector < unsigned int > indices;
+  
   vec3 box_min;
   vec3 box_max;
   vec3 center;
@@ -31,10 +35,11 @@ public:
       scale(1.0),
       model_view(){ if(path){ loadOBJ(path); } }
   
-  unsigned int getNumTri(){ return vertices.size()/3; }
+  unsigned int getNumTri(){ return (indices.empty() ? vertices.size() : indices.size())/3; }
 
   bool loadOBJ(const char * path);
   
+  //Indexed unit sphere of steps x steps (latitude, longitude) vertices
   bool makeSphere(int steps=64);
   
   friend std::ostream& operator << ( std::ostream& os, const Mesh& v ) {
@@ -126,6 +126,7 @@ static void check_program_link(GLuint program){
 
 #include "Trackball.h"
 #include "ObjMesh.h"
+#include "VertexPack.h"
 
 
 
@@ -1,6 +1,8 @@
 #include "common.h"
 #include "SourcePath.h"
 #include "common/lodepng.h"
+#include "AssetBundle.h"
+#include "Globe.h"
 
 
 using namespace Angel;
@@ -12,11 +14,63 @@ vec4 light_position( 0.0, 0.0, 10.0, 1.0 );
 vec4 ambient(  0.0, 0.0, 0.0, 1.0 );
 
 Mesh *mesh;
+int sphere_steps = 128;   //latitude and longitude vertices of the globe, -/= halve and double
+
+//How the globe is drawn, 'g' cycles.  Only the quadtree globe culls, so
+//it is the one earth starts with
+enum GlobeMode{
+  GLOBE_MESH,             //makeSphere() grid in vertex and index buffers
+  GLOBE_PROCEDURAL,       //the same grid from gl_VertexID alone, no vertex buffers
+  GLOBE_QUADTREE,         //CDLOD patches refined by distance, see Globe.h
+  GLOBE_TESSELLATED,      //coarse cube-sphere refined by the GL 4 tessellator, when available
+  GLOBE_MODES
+};
+GlobeMode globe_mode;
+
+//Quadtree globe
+GlobeQuadtree *quadtree;
+std::vector< GlobePatch > globe_patches;
+GlobeStats globe_stats;
+const unsigned int max_globe_patches = 2048;
+float elevation_scale;    //displacement of the highest point, 0 without an elevation raster
+GLuint globe_program;
+GLint  GlobeModelViewEarth, GlobeModelViewLight, GlobeProjection, GlobeNormalMatrix;
+GLint  GlobeCameraPosition, GlobeElevationScale, GlobeLightPosition, GlobeAnimateTime;
+GLuint grid_vao, grid_buffer, grid_index_buffer;
+GLuint patch_buffer, patch_texture;
+
+//Tessellated globe: GL 4.0 entry points and enums beyond the 3.2 loader,
+//found at run time by initTessellation()
+#ifndef GL_PATCHES
+#define GL_PATCHES                  0x000E
+#define GL_PATCH_VERTICES           0x8E72
+#define GL_TESS_EVALUATION_SHADER   0x8E87
+#define GL_TESS_CONTROL_SHADER      0x8E88
+#endif
+typedef void (APIENTRYP PatchParameteriProc)(GLenum pname, GLint value);
+PatchParameteriProc patchParameteri;
+const int tess_patches = 8;     //coarse patches along a cube face edge
+float tess_edge_pixels = 16.0f; //target triangle edge on screen, -/= halve and double
+GLuint tess_program;            //0 on GL 3.x, GLOBE_TESSELLATED is skipped
+GLuint tess_vao, tess_buffer;
+GLint  TessModelViewEarth, TessModelViewLight, TessProjection, TessNormalMatrix;
+GLint  TessViewportHeight, TessEdgePixels, TessLightPosition, TessAnimateTime;
+
+//'i' measures the next frame: primitives generated and time to glFinish()
+bool measure_frame;
+GLuint primitives_query;
 
 //OpenGL draw variables
 GLuint buffer;
+GLuint index_buffer;
 GLuint vao;
+GLuint empty_vao;         //attribute-less, for the procedural globe
 GLuint  ModelViewEarth, ModelViewLight, NormalMatrix, Projection;
+GLuint  PositionScale, PositionBias, OctNormals;
+GLuint  GlobeSteps;
+GLint   vPosition, vNormal, vTexCoord;
+VertexFormat vertex_format;
+VertexLayout vertex_layout;
 bool wireframe;
 GLuint program;
 
@@ -28,6 +82,10 @@ GLuint month_texture;
 GLuint night_texture;
 GLuint cloud_texture;
 GLuint perlin_texture;
+GLuint elevation_texture;
+
+//Textures baked by assetc, used instead of the PNGs when present
+AssetBundle assets;
 
 //Animation variables
 float animate_time;
@@ -104,6 +162,228 @@ void loadFreeImageTexture(const char* lpszPathName, GLuint textureID, GLuint GLt
   image.clear();
 }
 
+//Same texture as loadFreeImageTexture(), uploaded straight from the mapped
+//bundle with its baked mip levels
+bool loadBundleTexture(const char* name, GLuint textureID, GLuint GLtex){
+  const AssetRecord *asset = assets.isOpen() ? assets.find(name, ASSET_TEXTURE) : NULL;
+  if( asset == NULL ){ return false; }
+
+  std::cout << "Image loaded from bundle: " << asset->width << " x " << asset->height
+            << ", " << asset->levels << " levels" << std::endl;
+
+  glActiveTexture( GLtex );
+  glBindTexture( GL_TEXTURE_2D, textureID );
+  for(unsigned int l=0; l < asset->levels; l++){
+    unsigned int width, height;
+    AssetSpan pixels = assets.level(*asset, 0, l, width, height);
+    glTexImage2D( GL_TEXTURE_2D, l, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data );
+  }
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, asset->levels-1 );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+  return true;
+}
+
+//The baked texture when the bundle has it, else the PNG under source_path
+void loadTexture(const char* name, GLuint textureID, GLuint GLtex){
+  if( loadBundleTexture(name, textureID, GLtex) ){ return; }
+  std::string path = source_path + name;
+  loadFreeImageTexture(path.c_str(), textureID, GLtex);
+}
+
+
+//(Re)fill the vertex buffer with the mesh in the current vertex_format
+void uploadMesh(){
+  /* fill to size of vertices */{
+    std::size_t vertices_size = mesh->vertices.size();
+    std::size_t uvs_size = mesh->uvs.size();
+    std::size_t normals_size = mesh->normals.size();
+    if (uvs_size < vertices_size) {
+      mesh->uvs.resize(vertices_size);
+      for (std::size_t j = uvs_size; j < vertices_size; ++j) {
+        mesh->uvs[j] = vec2(0.f,0.f);
+      }
+    }
+    if (normals_size < vertices_size) {
+      mesh->normals.resize(vertices_size);
+      for (std::size_t j = normals_size; j < vertices_size; ++j) {
+        mesh->normals[j] = vec3(1.f,1.f,1.f);
+      }
+    }
+  }
+
+  PackedVertices packed;
+  packVertices(mesh->vertices, mesh->normals, mesh->uvs, vertex_format, vertex_layout, packed);
+
+  glBindVertexArray( vao );
+  glBindBuffer( GL_ARRAY_BUFFER, buffer );
+  glBufferData( GL_ARRAY_BUFFER, packed.data.size(), packed.data.empty() ? NULL : &packed.data[0], GL_STATIC_DRAW );
+  setVertexAttribs(packed, vPosition, vNormal, vTexCoord);
+  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+  glBufferData( GL_ELEMENT_ARRAY_BUFFER, mesh->indices.size()*sizeof(unsigned int),
+                mesh->indices.empty() ? NULL : &mesh->indices[0], GL_STATIC_DRAW );
+
+  glUniform3fv( PositionScale, 1, packed.position_scale );
+  glUniform3fv( PositionBias, 1, packed.position_bias );
+  glUniform1i( OctNormals, packed.oct_normals );
+
+  printf("Sphere uploaded as %s %s vertices: %u bytes/vertex, %zu vertices, %u triangles, %zu KB\n",
+         vertex_format == VERTEX_COMPACT ? "compact" : "float",
+         vertex_layout == VERTEX_INTERLEAVED ? "interleaved" : "planar", (unsigned int) packed.vertex_bytes,
+         mesh->vertices.size(), mesh->getNumTri(),
+         (packed.data.size() + mesh->indices.size()*sizeof(unsigned int))/1024);
+}
+
+//Rebuild the globe at steps x steps vertices; the procedural globe only
+//needs the new count, the quadtree globe does not use it
+void setSphereSteps(int steps){
+  sphere_steps = (std::max)(4, (std::min)(steps, 4096));
+  if( globe_mode == GLOBE_PROCEDURAL ){
+    printf("Procedural globe: %d steps, %d triangles\n", sphere_steps, 2*(sphere_steps-1)*(sphere_steps-2));
+  }else if( globe_mode == GLOBE_MESH ){
+    mesh->makeSphere(sphere_steps);
+    uploadMesh();
+  }
+}
+
+//Size of the tessellated globe's triangles on screen
+void setTessEdgePixels(float pixels){
+  tess_edge_pixels = (std::max)(2.0f, (std::min)(pixels, 256.0f));
+  printf("Tessellated globe: edges of about %g pixels\n", tess_edge_pixels);
+}
+
+//Switch the way the globe is drawn, freeing the sphere mesh and its
+//buffers while they are not drawn
+void setGlobeMode(GlobeMode mode){
+  globe_mode = mode;
+  if( mode == GLOBE_QUADTREE ){
+    printf("Quadtree globe: %d x %d quads per patch, at most %u patches, elevation scale %g\n",
+           GLOBE_GRID, GLOBE_GRID, max_globe_patches, elevation_scale);
+  }
+  if( mode == GLOBE_TESSELLATED ){
+    printf("Tessellated globe: %d coarse patches, edges of about %g pixels\n",
+           6*tess_patches*tess_patches, tess_edge_pixels);
+  }
+  if( mode != GLOBE_MESH ){
+    Mesh().vertices.swap(mesh->vertices);
+    Mesh().normals.swap(mesh->normals);
+    Mesh().uvs.swap(mesh->uvs);
+    Mesh().indices.swap(mesh->indices);
+    glBindBuffer( GL_ARRAY_BUFFER, buffer );
+    glBufferData( GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW );
+  }
+  setSphereSteps(sphere_steps);
+}
+
+//The patch grid: (GLOBE_GRID+1)^2 integer grid coordinates, two counter
+//clockwise triangles per quad
+void uploadPatchGrid(){
+  std::vector< vec2 > grid;
+  std::vector< unsigned short > indices;
+  for(int j=0; j <= GLOBE_GRID; j++){
+    for(int i=0; i <= GLOBE_GRID; i++){ grid.push_back(vec2(i, j)); }
+  }
+  for(int j=0; j < GLOBE_GRID; j++){
+    for(int i=0; i < GLOBE_GRID; i++){
+      unsigned short v = (unsigned short)(j*(GLOBE_GRID+1) + i);
+      unsigned short quad[6] = { v, (unsigned short)(v+1), (unsigned short)(v+GLOBE_GRID+1),
+                                 (unsigned short)(v+GLOBE_GRID+1), (unsigned short)(v+1),
+                                 (unsigned short)(v+GLOBE_GRID+2) };
+      indices.insert(indices.end(), quad, quad+6);
+    }
+  }
+
+  glBindVertexArray( grid_vao );
+  glBindBuffer( GL_ARRAY_BUFFER, grid_buffer );
+  glBufferData( GL_ARRAY_BUFFER, grid.size()*sizeof(vec2), &grid[0], GL_STATIC_DRAW );
+  GLint vGrid = glGetAttribLocation( globe_program, "vGrid" );
+  glEnableVertexAttribArray( vGrid );
+  glVertexAttribPointer( vGrid, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, grid_index_buffer );
+  glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned short), &indices[0], GL_STATIC_DRAW );
+  glBindVertexArray( 0 );
+}
+
+//Elevation raster for the quadtree globe: /images/elevation.png (8 bit
+//heights, equirectangular like the day texture) when present, else flat
+void loadElevation(){
+  glGenTextures( 1, &elevation_texture );
+  std::string path = source_path + "/images/elevation.png";
+  FILE *file = fopen(path.c_str(), "rb");
+  bool found = (file != NULL) || (assets.isOpen() && assets.find("/images/elevation.png", ASSET_TEXTURE));
+  if( file ){ fclose(file); }
+  if( found ){
+    loadTexture("/images/elevation.png", elevation_texture, GL_TEXTURE4);
+    elevation_scale = 0.02f;
+  }else{
+    unsigned char zero[4] = { 0, 0, 0, 0 };
+    glActiveTexture( GL_TEXTURE4 );
+    glBindTexture( GL_TEXTURE_2D, elevation_texture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, zero );
+    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    elevation_scale = 0.0f;
+  }
+  glActiveTexture( GL_TEXTURE0 );
+}
+
+//Select the patches for the camera and draw them with one instanced call
+void drawQuadtreeGlobe(const mat4 &model_view, const mat4 &projection, const vec4 &light_position){
+  vec4 camera = invert(model_view)*vec4(0.0, 0.0, 0.0, 1.0);
+  quadtree->select(vec3(camera.x, camera.y, camera.z)/camera.w, projection*model_view,
+                   globe_patches, max_globe_patches, globe_stats);
+
+  std::vector< GLfloat > texels(8*globe_patches.size());
+  for(size_t i=0; i < globe_patches.size(); i++){
+    const GlobePatch &p = globe_patches[i];
+    GLfloat patch[8] = { p.face, p.x, p.y, p.size, p.morph_start, p.morph_end, 0.0f, 0.0f };
+    memcpy(&texels[8*i], patch, sizeof(patch));
+  }
+  glBindBuffer( GL_TEXTURE_BUFFER, patch_buffer );
+  glBufferData( GL_TEXTURE_BUFFER, texels.size()*sizeof(GLfloat), texels.empty() ? NULL : &texels[0], GL_STREAM_DRAW );
+
+  glUseProgram( globe_program );
+  glActiveTexture( GL_TEXTURE5 );
+  glBindTexture( GL_TEXTURE_BUFFER, patch_texture );
+  glActiveTexture( GL_TEXTURE0 );
+  glUniformMatrix4fv( GlobeModelViewEarth, 1, GL_TRUE, model_view );
+  glUniformMatrix4fv( GlobeModelViewLight, 1, GL_TRUE, model_view );
+  glUniformMatrix4fv( GlobeProjection, 1, GL_TRUE, projection );
+  glUniformMatrix4fv( GlobeNormalMatrix, 1, GL_TRUE, transpose(invert(model_view)) );
+  glUniform3f( GlobeCameraPosition, camera.x/camera.w, camera.y/camera.w, camera.z/camera.w );
+  glUniform1f( GlobeElevationScale, elevation_scale );
+  glUniform4fv( GlobeLightPosition, 1, light_position );
+  glUniform1f( GlobeAnimateTime, animate_time );
+
+  glBindVertexArray( grid_vao );
+  glDrawElementsInstanced( GL_TRIANGLES, 6*GLOBE_GRID*GLOBE_GRID, GL_UNSIGNED_SHORT, 0, (GLsizei) globe_patches.size() );
+  glUseProgram( program );
+}
+
+//Counts of the frame drawn with measure_frame set
+void printGlobeStats(GLuint primitives, double milliseconds){
+  if( globe_mode == GLOBE_MESH || globe_mode == GLOBE_PROCEDURAL ){
+    printf("Globe: %u triangles\n", (globe_mode == GLOBE_MESH) ? mesh->getNumTri()
+                                                               : 2u*(sphere_steps-1)*(sphere_steps-2));
+  }else if( globe_mode == GLOBE_TESSELLATED ){
+    printf("Tessellated globe: %d coarse patches\n", 6*tess_patches*tess_patches);
+  }else{
+    printf("Quadtree globe: %u patches, %u triangles, depth %u\n", globe_stats.patches, globe_stats.triangles,
+           globe_stats.depth);
+    if( quadtree->culling ){
+      printf("  culled %u outside the view, %u behind the horizon, %u facing away (%.0f%% of the patches reached)\n",
+             globe_stats.culled_frustum, globe_stats.culled_horizon, globe_stats.culled_backface,
+             100.0f*globe_stats.cullRatio());
+    }else{
+      printf("  culling off\n");
+    }
+  }
+  printf("  drew %u triangles in %.2f ms\n", primitives, milliseconds);
+}
 
 static void error_callback(int error, const char* description)
 {
@@ -117,6 +397,41 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
   if (key == GLFW_KEY_SPACE && action == GLFW_PRESS){
     wireframe = !wireframe;
   }
+  //Vertex formats only apply to the mesh globe's buffers
+  if (key == GLFW_KEY_C && action == GLFW_PRESS && globe_mode == GLOBE_MESH){
+    vertex_format = (vertex_format == VERTEX_COMPACT) ? VERTEX_FLOAT : VERTEX_COMPACT;
+    uploadMesh();
+  }
+  if (key == GLFW_KEY_L && action == GLFW_PRESS && globe_mode == GLOBE_MESH){
+    vertex_layout = (vertex_layout == VERTEX_INTERLEAVED) ? VERTEX_PLANAR : VERTEX_INTERLEAVED;
+    uploadMesh();
+  }
+  if (key == GLFW_KEY_MINUS && action == GLFW_PRESS){
+    if( globe_mode == GLOBE_TESSELLATED ){
+      setTessEdgePixels(tess_edge_pixels*2.0f);
+    }else{
+      setSphereSteps(sphere_steps/2);
+    }
+  }
+  if (key == GLFW_KEY_EQUAL && action == GLFW_PRESS){
+    if( globe_mode == GLOBE_TESSELLATED ){
+      setTessEdgePixels(tess_edge_pixels*0.5f);
+    }else{
+      setSphereSteps(sphere_steps*2);
+    }
+  }
+  if (key == GLFW_KEY_G && action == GLFW_PRESS){
+    GlobeMode next = (GlobeMode)((globe_mode+1)%GLOBE_MODES);
+    if( next == GLOBE_TESSELLATED && !tess_program ){ next = (GlobeMode)((next+1)%GLOBE_MODES); }
+    setGlobeMode(next);
+  }
+  if (key == GLFW_KEY_I && action == GLFW_PRESS){
+    measure_frame = true;
+  }
+  if (key == GLFW_KEY_H && action == GLFW_PRESS){
+    quadtree->culling = !quadtree->culling;
+    printf("Globe culling %s\n", quadtree->culling ? "on" : "off");
+  }
 }
 
 //User interaction handler
@@ -183,39 +498,123 @@ void mouse_move(GLFWwindow* window, double x, double y){
     }
 }
 
-void init(){
+//Compile a shader under source_path and attach it to linked
+void attachShader(GLuint linked, GLenum type, const char *shader_name){
+  std::string shader_file = source_path + shader_name;
+  GLchar* shader_source = readShaderSource(shader_file.c_str());
   
-  std::string vshader = source_path + "/shaders/vshader.glsl";
-  std::string fshader = source_path + "/shaders/fshader.glsl";
-  
-  GLchar* vertex_shader_source = readShaderSource(vshader.c_str());
-  GLchar* fragment_shader_source = readShaderSource(fshader.c_str());
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, (const GLchar**) &shader_source, NULL);
+  glCompileShader(shader);
+  check_shader_compilation(shader_file, shader);
+  glAttachShader(linked, shader);
+}
 
-  GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader, 1, (const GLchar**) &vertex_shader_source, NULL);
-  glCompileShader(vertex_shader);
-  check_shader_compilation(vshader, vertex_shader);
-  
-  GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader, 1, (const GLchar**) &fragment_shader_source, NULL);
-  glCompileShader(fragment_shader);
-  check_shader_compilation(fshader, fragment_shader);
-  
-  program = glCreateProgram();
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
+//Compile and link a vertex and fragment shader under source_path, and
+//optionally tessellation control and evaluation shaders (GL 4.0)
+GLuint buildProgram(const char *vshader_name, const char *fshader_name,
+                    const char *tcshader_name=NULL, const char *teshader_name=NULL){
+  GLuint linked = glCreateProgram();
+  attachShader(linked, GL_VERTEX_SHADER, vshader_name);
+  if( tcshader_name ){ attachShader(linked, GL_TESS_CONTROL_SHADER, tcshader_name); }
+  if( teshader_name ){ attachShader(linked, GL_TESS_EVALUATION_SHADER, teshader_name); }
+  attachShader(linked, GL_FRAGMENT_SHADER, fshader_name);
   
   // Bind fragment output before linking to guarantee color attachment 0
-  glBindFragDataLocation(program, 0, "fragColor");
-  glLinkProgram(program);
-  check_program_link(program);
+  glBindFragDataLocation(linked, 0, "fragColor");
+  glLinkProgram(linked);
+  check_program_link(linked);
+  return linked;
+}
+
+//Tessellated globe, on GL 4.0 and later: tess_patches x tess_patches quad
+//patches per cube face, corners as (face, u, v), refined and projected to
+//the sphere by the tessellation shaders.  On 3.x tess_program stays 0
+void initTessellation(){
+  GLint major = 0;
+  glGetIntegerv( GL_MAJOR_VERSION, &major );
+  patchParameteri = (major >= 4) ? (PatchParameteriProc) glfwGetProcAddress("glPatchParameteri") : NULL;
+  tess_program = 0;
+  if( !patchParameteri ){
+    printf("OpenGL %s: no tessellation shaders, 'g' skips the tessellated globe\n",
+           (const char *) glGetString(GL_VERSION));
+    return;
+  }
+  
+  tess_program = buildProgram("/shaders/tess_vshader.glsl", "/shaders/fshader.glsl",
+                              "/shaders/tess_cshader.glsl", "/shaders/tess_eshader.glsl");
+  glUseProgram(tess_program);
+  glUniform4fv( glGetUniformLocation(tess_program, "ambient"), 1, ambient );
+  glUniform1i( glGetUniformLocation(tess_program, "textureEarth"), 0 );
+  glUniform1i( glGetUniformLocation(tess_program, "textureNight"), 1 );
+  glUniform1i( glGetUniformLocation(tess_program, "textureCloud"), 2 );
+  glUniform1i( glGetUniformLocation(tess_program, "texturePerlin"), 3 );
+  TessModelViewEarth = glGetUniformLocation( tess_program, "ModelViewEarth" );
+  TessModelViewLight = glGetUniformLocation( tess_program, "ModelViewLight" );
+  TessProjection     = glGetUniformLocation( tess_program, "Projection" );
+  TessNormalMatrix   = glGetUniformLocation( tess_program, "NormalMatrix" );
+  TessViewportHeight = glGetUniformLocation( tess_program, "ViewportHeight" );
+  TessEdgePixels     = glGetUniformLocation( tess_program, "EdgePixels" );
+  TessLightPosition  = glGetUniformLocation( tess_program, "LightPosition" );
+  TessAnimateTime    = glGetUniformLocation( tess_program, "animate_time" );
+  
+  std::vector< vec3 > corners;
+  float size = 2.0f/tess_patches;
+  for(int face=0; face < 6; face++){
+    for(int j=0; j < tess_patches; j++){
+      for(int i=0; i < tess_patches; i++){
+        float x = -1.0f + size*i, y = -1.0f + size*j;
+        corners.push_back(vec3(face, x, y));
+        corners.push_back(vec3(face, x + size, y));
+        corners.push_back(vec3(face, x + size, y + size));
+        corners.push_back(vec3(face, x, y + size));
+      }
+    }
+  }
+  glGenVertexArrays( 1, &tess_vao );
+  glGenBuffers( 1, &tess_buffer );
+  glBindVertexArray( tess_vao );
+  glBindBuffer( GL_ARRAY_BUFFER, tess_buffer );
+  glBufferData( GL_ARRAY_BUFFER, corners.size()*sizeof(vec3), &corners[0], GL_STATIC_DRAW );
+  GLint vCorner = glGetAttribLocation( tess_program, "vCorner" );
+  glEnableVertexAttribArray( vCorner );
+  glVertexAttribPointer( vCorner, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+  glBindVertexArray( 0 );
+  patchParameteri( GL_PATCH_VERTICES, 4 );
+  glUseProgram(program);
+}
+
+//Draw the coarse patches, the tessellator sizes triangles to about
+//tess_edge_pixels on screen.  One draw per cube face: llvmpipe drops
+//output from larger tessellated draws
+void drawTessellatedGlobe(const mat4 &model_view, const mat4 &projection, const vec4 &light_position,
+                          int viewport_height){
+  glUseProgram( tess_program );
+  glUniformMatrix4fv( TessModelViewEarth, 1, GL_TRUE, model_view );
+  glUniformMatrix4fv( TessModelViewLight, 1, GL_TRUE, model_view );
+  glUniformMatrix4fv( TessProjection, 1, GL_TRUE, projection );
+  glUniformMatrix4fv( TessNormalMatrix, 1, GL_TRUE, transpose(invert(model_view)) );
+  glUniform1f( TessViewportHeight, (GLfloat) viewport_height );
+  glUniform1f( TessEdgePixels, tess_edge_pixels );
+  glUniform4fv( TessLightPosition, 1, light_position );
+  glUniform1f( TessAnimateTime, animate_time );
+
+  glBindVertexArray( tess_vao );
+  for(int face=0; face < 6; face++){
+    glDrawArrays( GL_PATCHES, 4*face*tess_patches*tess_patches, 4*tess_patches*tess_patches );
+  }
+  glUseProgram( program );
+}
+
+void init(){
   
+  program = buildProgram("/shaders/vshader.glsl", "/shaders/fshader.glsl");
   glUseProgram(program);
 
   //Per vertex attributes
-  GLuint vPosition = glGetAttribLocation( program, "vPosition" );
-  GLuint vNormal   = glGetAttribLocation( program, "vNormal" );
-  GLuint vTexCoord = glGetAttribLocation( program, "vTexCoord" );
+  vPosition = glGetAttribLocation( program, "vPosition" );
+  vNormal   = glGetAttribLocation( program, "vNormal" );
+  vTexCoord = glGetAttribLocation( program, "vTexCoord" );
   
   //Retrieve and set uniform variables
   glUniform4fv( glGetUniformLocation(program, "LightPosition"), 1, light_position);
@@ -226,83 +625,88 @@ void init(){
   ModelViewLight = glGetUniformLocation( program, "ModelViewLight" );
   NormalMatrix   = glGetUniformLocation( program, "NormalMatrix" );
   Projection     = glGetUniformLocation( program, "Projection" );
+
+  //Compact vertex decode uniforms
+  PositionScale  = glGetUniformLocation( program, "PositionScale" );
+  PositionBias   = glGetUniformLocation( program, "PositionBias" );
+  OctNormals     = glGetUniformLocation( program, "OctNormals" );
+  GlobeSteps     = glGetUniformLocation( program, "GlobeSteps" );
+  vertex_format  = VERTEX_COMPACT;
+  vertex_layout  = VERTEX_INTERLEAVED;
   
   //===== Send data to GPU ======
   glGenVertexArrays( 1, &vao );
+  glGenVertexArrays( 1, &empty_vao );
   glGenBuffers( 1, &buffer);
+  glGenBuffers( 1, &index_buffer);
   
   mesh = new Mesh();
-  mesh->makeSphere(32);
+  mesh->makeSphere(sphere_steps);
   
   glGenTextures( 1, &month_texture );
   glGenTextures( 1, &night_texture );
   glGenTextures( 1, &cloud_texture );
   glGenTextures( 1, &perlin_texture);
   
+  //Bake with: assetc <source>/assets.bundle --root <source> texture:/images/... (see assetc.cpp)
+  std::string assets_path = source_path + "/assets.bundle";
+  if( assets.open(assets_path.c_str()) ){
+    std::cout << assets_path << ": " << assets.size() << " baked assets\n";
+  }
+  
   // Load base day (earth) texture
-  std::string earth_img = source_path + "/images/world.200405.3.png";
-  loadFreeImageTexture(earth_img.c_str(), month_texture, GL_TEXTURE0);
+  loadTexture("/images/world.200405.3.png", month_texture, GL_TEXTURE0);
   glUniform1i( glGetUniformLocation(program, "textureEarth"), 0 );
 
   // Load night lights texture
-  std::string night_img = source_path + "/images/BlackMarble.png";
-  loadFreeImageTexture(night_img.c_str(), night_texture, GL_TEXTURE1);
+  loadTexture("/images/BlackMarble.png", night_texture, GL_TEXTURE1);
   glUniform1i( glGetUniformLocation(program, "textureNight"), 1 );
 
   // Load cloud texture
-  std::string cloud_img = source_path + "/images/cloud_combined.png";
-  loadFreeImageTexture(cloud_img.c_str(), cloud_texture, GL_TEXTURE2);
+  loadTexture("/images/cloud_combined.png", cloud_texture, GL_TEXTURE2);
   glUniform1i( glGetUniformLocation(program, "textureCloud"), 2 );
   
   // Load perlin noise texture (used to subtly move/distort clouds)
-  std::string perlin_img = source_path + "/images/perlin_noise.png";
-  loadFreeImageTexture(perlin_img.c_str(), perlin_texture, GL_TEXTURE3);
+  loadTexture("/images/perlin_noise.png", perlin_texture, GL_TEXTURE3);
   glUniform1i( glGetUniformLocation(program, "texturePerlin"), 3 );
 
-  glBindVertexArray( vao );
-  glBindBuffer( GL_ARRAY_BUFFER, buffer );
-  /* fill to size of vertices */{
-    std::size_t vertices_size = mesh->vertices.size();
-    std::size_t uvs_size = mesh->uvs.size();
-    std::size_t normals_size = mesh->normals.size();
-    if (uvs_size < vertices_size) {
-      mesh->uvs.resize(vertices_size);
-      for (std::size_t j = uvs_size; j < vertices_size; ++j) {
-        mesh->uvs[j] = vec2(0.f,0.f);
-      }
-    }
-    if (normals_size < vertices_size) {
-      mesh->normals.resize(vertices_size);
-      for (std::size_t j = normals_size; j < vertices_size; ++j) {
-        mesh->normals[j] = vec3(1.f,1.f,1.f);
-      }
-    }
-  }
-
-
-  unsigned int vertices_bytes = mesh->vertices.size()*sizeof(vec4);
-  unsigned int normals_bytes  = mesh->normals.size()*sizeof(vec3);
-  unsigned int uv_bytes =  mesh->uvs.size()*sizeof(vec2);
-
-  glBufferData( GL_ARRAY_BUFFER, vertices_bytes + normals_bytes+uv_bytes, NULL, GL_STATIC_DRAW );
-  unsigned int offset = 0;
-  if (vertices_bytes > 0)
-    glBufferSubData( GL_ARRAY_BUFFER, offset, vertices_bytes, &mesh->vertices[0] );
-  offset += vertices_bytes;
-  if (normals_bytes > 0)
-    glBufferSubData( GL_ARRAY_BUFFER, offset, normals_bytes,  &mesh->normals[0] );
-  offset += normals_bytes;
-  if (uv_bytes > 0)
-    glBufferSubData( GL_ARRAY_BUFFER, offset, uv_bytes,  &mesh->uvs[0] );
-
-  glEnableVertexAttribArray( vNormal );
-  glEnableVertexAttribArray( vPosition );
-  glEnableVertexAttribArray( vTexCoord );
-
-
-  glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
-  glVertexAttribPointer( vNormal, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(vertices_bytes) );
-  glVertexAttribPointer( vTexCoord, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(vertices_bytes+normals_bytes) );
+  uploadMesh();
+
+  //Quadtree globe: same fragment shader and textures, the elevation on
+  //unit 4 and the selected patches in a texture buffer on unit 5
+  loadElevation();
+  quadtree = new GlobeQuadtree(14, 4.0f, elevation_scale);
+  globe_program = buildProgram("/shaders/globe_vshader.glsl", "/shaders/fshader.glsl");
+  glUseProgram(globe_program);
+  glUniform4fv( glGetUniformLocation(globe_program, "ambient"), 1, ambient );
+  glUniform1i( glGetUniformLocation(globe_program, "textureEarth"), 0 );
+  glUniform1i( glGetUniformLocation(globe_program, "textureNight"), 1 );
+  glUniform1i( glGetUniformLocation(globe_program, "textureCloud"), 2 );
+  glUniform1i( glGetUniformLocation(globe_program, "texturePerlin"), 3 );
+  glUniform1i( glGetUniformLocation(globe_program, "textureElevation"), 4 );
+  glUniform1i( glGetUniformLocation(globe_program, "Patches"), 5 );
+  glUniform1f( glGetUniformLocation(globe_program, "GridSize"), (GLfloat) GLOBE_GRID );
+  GlobeModelViewEarth = glGetUniformLocation( globe_program, "ModelViewEarth" );
+  GlobeModelViewLight = glGetUniformLocation( globe_program, "ModelViewLight" );
+  GlobeProjection     = glGetUniformLocation( globe_program, "Projection" );
+  GlobeNormalMatrix   = glGetUniformLocation( globe_program, "NormalMatrix" );
+  GlobeCameraPosition = glGetUniformLocation( globe_program, "CameraPosition" );
+  GlobeElevationScale = glGetUniformLocation( globe_program, "ElevationScale" );
+  GlobeLightPosition  = glGetUniformLocation( globe_program, "LightPosition" );
+  GlobeAnimateTime    = glGetUniformLocation( globe_program, "animate_time" );
+  glGenVertexArrays( 1, &grid_vao );
+  glGenBuffers( 1, &grid_buffer );
+  glGenBuffers( 1, &grid_index_buffer );
+  uploadPatchGrid();
+  glGenBuffers( 1, &patch_buffer );
+  glGenTextures( 1, &patch_texture );
+  glBindTexture( GL_TEXTURE_BUFFER, patch_texture );
+  glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, patch_buffer );
+  glBindTexture( GL_TEXTURE_BUFFER, 0 );
+  glUseProgram(program);
+  
+  initTessellation();
+  glGenQueries( 1, &primitives_query );
 
   //===== End: Send data to GPU ======
 
@@ -317,6 +721,8 @@ void init(){
   animate_time = 0.0;
   rotation_angle = 0.0;
   wireframe = false;
+  measure_frame = false;
+  setGlobeMode(GLOBE_QUADTREE);
   //===== End: Initalize some program state variables ======
 
 }
@@ -414,14 +820,43 @@ int main(void){
     glUniform4fv( glGetUniformLocation(program, "LightPosition"), 1, moving_light_position );
 
     // ====== Draw ======
-    glBindVertexArray(vao);
+    glBindVertexArray(globe_mode == GLOBE_PROCEDURAL ? empty_vao : vao);
     
     glUniformMatrix4fv( ModelViewEarth, 1, GL_TRUE, user_MV*mesh->model_view);
     glUniformMatrix4fv( ModelViewLight, 1, GL_TRUE, user_MV*mesh->model_view);
     glUniformMatrix4fv( Projection, 1, GL_TRUE, projection );
     glUniformMatrix4fv( NormalMatrix, 1, GL_TRUE, transpose(invert(user_MV*mesh->model_view)));
 
-    glDrawArrays( GL_TRIANGLES, 0, mesh->vertices.size() );
+    uint64_t measure_start = 0;
+    if( measure_frame ){
+      glFinish();
+      measure_start = glfwGetTimerValue();
+      glBeginQuery( GL_PRIMITIVES_GENERATED, primitives_query );
+    }
+    
+    if( globe_mode == GLOBE_QUADTREE ){
+      drawQuadtreeGlobe(user_MV*mesh->model_view, projection, moving_light_position);
+    }else if( globe_mode == GLOBE_TESSELLATED ){
+      drawTessellatedGlobe(user_MV*mesh->model_view, projection, moving_light_position, height);
+    }else if( globe_mode == GLOBE_PROCEDURAL ){
+      glUniform1i( GlobeSteps, sphere_steps );
+      glDrawArrays( GL_TRIANGLES, 0, 6*(sphere_steps-1)*(sphere_steps-2) );
+      glUniform1i( GlobeSteps, 0 );
+    }else if( mesh->indices.empty() ){
+      glDrawArrays( GL_TRIANGLES, 0, mesh->vertices.size() );
+    }else{
+      glDrawElements( GL_TRIANGLES, mesh->indices.size(), GL_UNSIGNED_INT, 0 );
+    }
+    
+    if( measure_frame ){
+      glEndQuery( GL_PRIMITIVES_GENERATED );
+      glFinish();
+      double milliseconds = 1000.0*(glfwGetTimerValue() - measure_start)/glfwGetTimerFrequency();
+      GLuint primitives = 0;
+      glGetQueryObjectuiv( primitives_query, GL_QUERY_RESULT, &primitives );
+      printGlobeStats(primitives, milliseconds);
+      measure_frame = false;
+    }
     // ====== End: Draw ======
 
     
@@ -430,6 +865,7 @@ int main(void){
     
   }
   delete mesh;
+  delete quadtree;
   glfwDestroyWindow(window);
   glfwTerminate();
   exit(EXIT_SUCCESS);
@@ -7,19 +7,36 @@ uniform mat4 ModelView;
 uniform mat4 Projection;
 uniform mat4 NormalMatrix;
 
+//Decode of compact vertices (see VertexPack.h): positions are unorm16
+//against the bounding box, normals are octahedral snorm16x2 in vNormal.xy
+uniform vec3 PositionScale;
+uniform vec3 PositionBias;
+uniform bool OctNormals;
+
 out vec4 pos;
 out vec4 N;
 
 
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
 void main()
 {
+  vec4 position = vec4(vPosition.xyz*PositionScale + PositionBias, 1.0);
+  vec3 normal = OctNormals ? octDecode(vNormal.xy) : vNormal;
   
   // Transform vertex normal into eye coordinates
-  N = NormalMatrix*vec4(vNormal, 0.0); N.w = 0.0;
+  N = NormalMatrix*vec4(normal, 0.0); N.w = 0.0;
   N = normalize(N);
   
   // Transform vertex position into eye coordinates
-  pos = ModelView * vPosition;
+  pos = ModelView * position;
   gl_Position = Projection * pos;
   
 }
@@ -0,0 +1,280 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- assetc.cpp ---
+//
+//  Asset baker.  Packs meshes, textures and cubemaps into one bundle (see
+//  AssetBundle.h) that the programs map at startup instead of parsing OBJ
+//  and PNG files:
+//
+//    mesh:<name>     OBJ, optimized with LODs, meshlets and tangents like
+//                    Mesh::load
+//    texture:<name>  PNG, decoded to RGBA8 with a box filtered mip chain
+//    cubemap:<name>  directory of right, left, top, bottom, front and back
+//                    PNGs, decoded to six RGBA8 faces
+//
+//  Names are relative to --root (source_path by default) and are the names
+//  the programs look assets up by.  Without any items the inputs of
+//  model_mapping are baked, skipping the ones that are missing.
+//
+//  usage: assetc out.bundle [--root dir] [kind:name ...]
+//
+//    assetc model_mapping/assets.bundle
+//    assetc earth/assets.bundle --root earth texture:/images/world.200405.3.png
+//           texture:/images/BlackMarble.png texture:/images/cloud_combined.png
+//           texture:/images/perlin_noise.png
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "common.h"
+#include "SourcePath.h"
+#include "AssetBundle.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif //_WIN32
+
+using namespace Angel;
+
+struct BakeItem{
+  AssetType type;
+  std::string name;
+  bool optional;      //default inputs are skipped when missing
+};
+
+static const char *cube_faces[6] = { "right", "left", "top", "bottom", "front", "back" };
+
+static uint64_t filePosition(FILE *file){
+#ifdef _WIN32
+  return (uint64_t) _ftelli64(file);
+#else
+  return (uint64_t) ftello(file);
+#endif //_WIN32
+}
+
+//Zero pad the file to the next 16 byte boundary
+static bool alignFile(FILE *file){
+  static const char zeros[16] = {0};
+  size_t pad = (size_t)((16 - filePosition(file)%16)%16);
+  return fwrite(zeros, 1, pad, file) == pad;
+}
+
+static bool fileExists(const std::string &path){
+  FILE *file = fopen(path.c_str(), "rb");
+  if( file == NULL ){ return false; }
+  fclose(file);
+  return true;
+}
+
+//Write image and its mip levels, each halving with a 2x2 box filter
+static bool writeMipChain(FILE *file, std::vector< unsigned char > image, unsigned int width, unsigned int height,
+                          unsigned int levels){
+  for(unsigned int l=0; l < levels; l++){
+    if( fwrite(&image[0], 1, image.size(), file) != image.size() ){ return false; }
+    if( l+1 == levels ){ break; }
+
+    unsigned int w = (width > 1) ? width/2 : 1;
+    unsigned int h = (height > 1) ? height/2 : 1;
+    std::vector< unsigned char > next((size_t) w*h*4);
+    for(unsigned int y=0; y < h; y++){
+      unsigned int y0 = (std::min)(2*y, height-1), y1 = (std::min)(2*y+1, height-1);
+      for(unsigned int x=0; x < w; x++){
+        unsigned int x0 = (std::min)(2*x, width-1), x1 = (std::min)(2*x+1, width-1);
+        for(int c=0; c < 4; c++){
+          unsigned int sum = image[((size_t) y0*width + x0)*4 + c] + image[((size_t) y0*width + x1)*4 + c] +
+                             image[((size_t) y1*width + x0)*4 + c] + image[((size_t) y1*width + x1)*4 + c];
+          next[((size_t) y*w + x)*4 + c] = (unsigned char)((sum + 2)/4);
+        }
+      }
+    }
+    image.swap(next);
+    width = w;
+    height = h;
+  }
+  return true;
+}
+
+static bool bakeMesh(FILE *file, const std::string &path, AssetRecord &){
+  Mesh mesh;
+  if( !mesh.loadOBJ(path.c_str()) ){ return false; }
+  mesh.optimize();
+  mesh.buildLODs(Mesh::defaultLODRatios());
+  mesh.buildMeshlets();
+  if( mesh.hasUV ){ mesh.buildTangents(); }
+  printf("  %u triangles, %zu vertices, %zu levels, %zu meshlets\n", mesh.getNumTri(),
+         mesh.vertices.size(), mesh.lods.size(), mesh.meshlets.size());
+  return mesh.writeCache(file);
+}
+
+static bool bakeTexture(FILE *file, const std::string &path, AssetRecord &record){
+  std::vector< unsigned char > image;
+  unsigned int width, height;
+  unsigned error = lodepng::decode(image, width, height, path.c_str());
+  if( error ){
+    printf("  decoder error %u: %s\n", error, lodepng_error_text(error));
+    return false;
+  }
+  record.width = width;
+  record.height = height;
+  record.levels = assetMipLevels(width, height);
+  printf("  %u x %u, %u levels\n", width, height, record.levels);
+  return writeMipChain(file, image, width, height, record.levels);
+}
+
+static bool bakeCubemap(FILE *file, const std::string &path, AssetRecord &record){
+  record.levels = 1;
+  for(int face=0; face < 6; face++){
+    std::string face_path = path + "/" + cube_faces[face] + ".png";
+    std::vector< unsigned char > image;
+    unsigned int width, height;
+    unsigned error = lodepng::decode(image, width, height, face_path.c_str());
+    if( error ){
+      printf("  %s: decoder error %u: %s\n", face_path.c_str(), error, lodepng_error_text(error));
+      return false;
+    }
+    if( face == 0 ){
+      record.width = width;
+      record.height = height;
+    }else if( width != record.width || height != record.height ){
+      printf("  %s is %u x %u, the other faces %u x %u\n", face_path.c_str(), width, height,
+             record.width, record.height);
+      return false;
+    }
+    if( !writeMipChain(file, image, width, height, record.levels) ){ return false; }
+  }
+  printf("  6 faces of %u x %u\n", record.width, record.height);
+  return true;
+}
+
+static bool recordBefore(const AssetRecord &a, const AssetRecord &b){
+  return strncmp(a.name, b.name, sizeof(a.name)) < 0;
+}
+
+//Write the payloads, then the sorted table, then the header that points at it
+static bool writeBundle(FILE *file, const std::string &root, const std::vector< BakeItem > &items){
+  AssetBundleHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, ASSET_BUNDLE_MAGIC, sizeof(header.magic));
+  header.version = ASSET_BUNDLE_VERSION;
+  if( fwrite(&header, sizeof(header), 1, file) != 1 ){ return false; }
+
+  std::vector< AssetRecord > records;
+  for(size_t i=0; i < items.size(); i++){
+    const BakeItem &item = items[i];
+    std::string path = root + item.name;
+    bool exists = (item.type == ASSET_CUBEMAP) ? fileExists(path + "/" + cube_faces[0] + ".png") : fileExists(path);
+    if( !exists && item.optional ){
+      printf("%s: not found, skipped\n", path.c_str());
+      continue;
+    }
+
+    AssetRecord record;
+    memset(&record, 0, sizeof(record));
+    if( item.name.size() >= sizeof(record.name) ){
+      printf("%s: names are limited to %zu characters\n", item.name.c_str(), sizeof(record.name)-1);
+      return false;
+    }
+    memcpy(record.name, item.name.c_str(), item.name.size() + 1);   //with its terminator, the rest stays zero
+    record.type = item.type;
+
+    if( !alignFile(file) ){ return false; }
+    record.offset = filePosition(file);
+    printf("%s\n", path.c_str());
+    bool ok = (item.type == ASSET_MESH)    ? bakeMesh(file, path, record) :
+              (item.type == ASSET_TEXTURE) ? bakeTexture(file, path, record) :
+                                             bakeCubemap(file, path, record);
+    if( !ok ){
+      printf("Could not bake %s\n", path.c_str());
+      return false;
+    }
+    record.size = filePosition(file) - record.offset;
+    records.push_back(record);
+  }
+
+  if( records.empty() ){
+    printf("Nothing to bake\n");
+    return false;
+  }
+  std::sort(records.begin(), records.end(), recordBefore);
+  for(size_t i=1; i < records.size(); i++){
+    if( !recordBefore(records[i-1], records[i]) ){
+      printf("%s is baked twice\n", records[i].name);
+      return false;
+    }
+  }
+
+  if( !alignFile(file) ){ return false; }
+  header.num_assets = (uint32_t) records.size();
+  header.assets_offset = filePosition(file);
+  if( fwrite(&records[0], sizeof(AssetRecord), records.size(), file) != records.size() ){ return false; }
+  printf("%u assets, %.1f MB\n", header.num_assets, filePosition(file)/(1024.0*1024.0));
+  return fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+int main(int argc, char **argv){
+  if( argc < 2 ){
+    printf("usage: assetc out.bundle [--root dir] [mesh:name | texture:name | cubemap:name ...]\n");
+    return EXIT_FAILURE;
+  }
+  std::string out_path = argv[1];
+  std::string root = source_path;
+  std::vector< BakeItem > items;
+
+  for(int i=2; i < argc; i++){
+    std::string arg(argv[i]);
+    if( arg == "--root" && i+1 < argc ){
+      root = argv[++i];
+      continue;
+    }
+    size_t colon = arg.find(':');
+    std::string kind = arg.substr(0, colon);
+    BakeItem item;
+    item.optional = false;
+    if( colon == std::string::npos || colon+1 == arg.size() ){
+      printf("Expected kind:name, not %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    item.name = arg.substr(colon+1);
+    if( kind == "mesh" ){            item.type = ASSET_MESH; }
+    else if( kind == "texture" ){    item.type = ASSET_TEXTURE; }
+    else if( kind == "cubemap" ){    item.type = ASSET_CUBEMAP; }
+    else{
+      printf("Unknown asset kind %s\n", kind.c_str());
+      return EXIT_FAILURE;
+    }
+    items.push_back(item);
+  }
+
+  //What model_mapping loads
+  if( items.empty() ){
+    const char *models[] = { "/models/sphere.obj", "/models/wt_teapot.obj", "/models/bunny.obj", "/models/dragon.obj" };
+    for(int m=0; m < 4; m++){
+      BakeItem item = { ASSET_MESH, models[m], true };
+      items.push_back(item);
+    }
+    BakeItem skybox = { ASSET_CUBEMAP, "/skybox/2", true };
+    items.push_back(skybox);
+  }
+
+  //Bake next to the output and rename, so programs mapping the old bundle
+  //keep a consistent copy
+  std::string tmp = out_path + ".tmp";
+  FILE *file = fopen(tmp.c_str(), "wb");
+  if( file == NULL ){
+    printf("Could not write %s\n", tmp.c_str());
+    return EXIT_FAILURE;
+  }
+  bool ok = writeBundle(file, root, items);
+  ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+  if( ok ){ remove(out_path.c_str()); }
+#endif //_WIN32
+  if( ok ){ ok = rename(tmp.c_str(), out_path.c_str()) == 0; }
+  if( !ok ){
+    remove(tmp.c_str());
+    printf("Could not write %s\n", out_path.c_str());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,494 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- bench_mesh.cpp ---
+//
+//  Mesh loading benchmark.  Generates synthetic OBJ files (UV spheres, flat
+//  grids and noisy height fields, with or without uvs, with absolute or
+//  negative face indices) and times the stages of getting them on screen:
+//
+//    parse        tokenize the OBJ          bytes = OBJ file size
+//    normals      generate missing normals  bytes = corners*4 + positions*12
+//    deindex      weld (v, vt, vn) tuples   bytes = corners*12
+//    upload_prep  pack vertices and narrow  bytes = packed vertices + indices
+//                 indices like uploadMesh()
+//    tangents     buildTangents(), meshes   bytes = corners*4 + vertices*52
+//                 with uvs only
+//
+//  Each case is loaded --repeat times and the fastest run of every stage is
+//  kept.  Tangents are also built on one thread and must match bitwise.
+//
+//  With --codec the optimized mesh is also put through MeshCodec:
+//  compression ratio against the OBJ and the upload buffers, encode and
+//  decode throughput in upload bytes, and a bitwise check that every corner
+//  decodes to what uploadMesh() would send.  --models adds existing OBJ
+//  files to the generated ones.  Results go to a JSON file, summary tables
+//  to stdout.
+//
+//  usage: bench_mesh [--dir path] [--out results.json] [--sizes 10000,...]
+//                    [--meshes sphere,grid,noise] [--variants uv,nouv,neg]
+//                    [--models a.obj,...] [--codec 1] [--repeat n] [--threads n]
+//
+//  Generated files are named after their parameters and reused by later
+//  runs; sizes up to 50M triangles need about 2.5 GB of disk each.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "common.h"
+#include "MeshCodec.h"
+
+#include <chrono>
+#include <sstream>
+
+using namespace Angel;
+
+struct BenchCase{
+  std::string mesh;       //sphere, grid or noise
+  size_t triangles;       //requested, the generated count is close to it
+  bool uvs;
+  bool negative;          //relative face indices
+  std::string path;       //OBJ given with --models, generated when empty
+};
+
+struct CodecResult{
+  size_t encoded_bytes;
+  size_t upload_bytes;    //decoded vertices and indices
+  double encode_seconds;
+  double decode_seconds;
+  bool round_trip;
+};
+
+struct StageResult{
+  std::string name;
+  double seconds;
+  double bytes;
+};
+
+//Buffered OBJ writer, faces can use absolute or relative indices
+class ObjWriter{
+public:
+  ObjWriter(FILE *file, bool uvs, bool normals, bool negative)
+    : file(file), uvs(uvs), normals(normals), negative(negative), count(0) {}
+
+  void vertex(const vec3 &p, const vec2 &t, const vec3 &n){
+    print("v %.6f %.6f %.6f\n", p.x, p.y, p.z);
+    if( uvs ){ print("vt %.6f %.6f\n", t.x, t.y); }
+    if( normals ){ print("vn %.6f %.6f %.6f\n", n.x, n.y, n.z); }
+    count++;
+  }
+
+  //Zero-based vertex numbers, v/vt/vn always share them
+  void triangle(size_t a, size_t b, size_t c){
+    size_t corners[3] = { a, b, c };
+    append("f", 1);
+    for(int i=0; i < 3; i++){
+      long long index = negative ? (long long) corners[i] - (long long) count : (long long) corners[i] + 1;
+      if( uvs && normals ){ print(" %lld/%lld/%lld", index, index, index); }
+      else if( uvs ){       print(" %lld/%lld", index, index); }
+      else if( normals ){   print(" %lld//%lld", index, index); }
+      else{                 print(" %lld", index); }
+    }
+    append("\n", 1);
+  }
+
+  bool finish(){
+    bool ok = buffer.empty() || fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+    buffer.clear();
+    return ok;
+  }
+
+private:
+  FILE *file;
+  bool uvs, normals, negative;
+  size_t count;
+  std::string buffer;
+
+  void append(const char *text, size_t n){
+    buffer.append(text, n);
+    if( buffer.size() >= (1 << 20) ){ finish(); }
+  }
+
+  template< class... Args >
+  void print(const char *format, Args... args){
+    char line[128];
+    int n = snprintf(line, sizeof(line), format, args...);
+    append(line, (size_t)(std::min)(n, (int) sizeof(line)-1));
+  }
+};
+
+//Smooth value noise in [-1, 1] on the integer lattice
+static float latticeNoise(int x, int y){
+  unsigned int h = (unsigned int) x*374761393u + (unsigned int) y*668265263u;
+  h = (h ^ (h >> 13))*1274126177u;
+  return ((h ^ (h >> 16)) & 0xFFFF)/32767.5f - 1.0f;
+}
+
+static float valueNoise(float x, float y){
+  int ix = (int) floor(x), iy = (int) floor(y);
+  float fx = x - ix, fy = y - iy;
+  fx = fx*fx*(3 - 2*fx);
+  fy = fy*fy*(3 - 2*fy);
+  float a = latticeNoise(ix, iy),   b = latticeNoise(ix+1, iy);
+  float c = latticeNoise(ix, iy+1), d = latticeNoise(ix+1, iy+1);
+  return (a + (b - a)*fx) + ((c + (d - c)*fx) - (a + (b - a)*fx))*fy;
+}
+
+/**
+  Write the OBJ of a case: rows of vertices, each followed by the quads
+    joining it to the previous row, so negative indices stay small.
+    Spheres and grids carry normals; noise leaves them to the loader.
+**/
+static bool generateOBJ(const BenchCase &bench, const std::string &path){
+  FILE *file = fopen(path.c_str(), "wb");
+  if( file == NULL ){ return false; }
+  bool sphere = (bench.mesh == "sphere");
+  ObjWriter obj(file, bench.uvs, bench.mesh != "noise", bench.negative);
+  fprintf(file, "# bench_mesh %s, %zu triangles\n", bench.mesh.c_str(), bench.triangles);
+
+  //Spheres are rows x 2*rows quads, grids rows x rows, two triangles each
+  size_t rows = (size_t) ceil(sqrt(bench.triangles/(sphere ? 4.0 : 2.0)));
+  rows = (std::max)(rows, (size_t) 2);
+  size_t columns = sphere ? 2*rows : rows;
+  for(size_t r=0; r <= rows; r++){
+    for(size_t c=0; c <= columns; c++){
+      vec2 t((float) c/columns, (float) r/rows);
+      vec3 p, n;
+      if( sphere ){
+        float theta = t.y*M_PI, phi = t.x*2.0*M_PI;
+        n = vec3(sin(theta)*cos(phi), cos(theta), sin(theta)*sin(phi));
+        p = n;
+      }else if( bench.mesh == "grid" ){
+        p = vec3(t.x, t.y, 0.0);
+        n = vec3(0.0, 0.0, 1.0);
+      }else{
+        float frequency = 8.0f;
+        float height = 0;
+        for(int octave=0; octave < 4; octave++, frequency *= 2.0f){
+          height += valueNoise(t.x*frequency, t.y*frequency)/frequency;
+        }
+        p = vec3(t.x, t.y, height);
+      }
+      obj.vertex(p, t, n);
+    }
+    if( r == 0 ){ continue; }
+    for(size_t c=0; c < columns; c++){
+      size_t a = (r-1)*(columns+1) + c;
+      size_t b = a + columns+1;
+      obj.triangle(a, b, b+1);
+      obj.triangle(a, b+1, a+1);
+    }
+  }
+  bool ok = obj.finish();
+  ok = (fclose(file) == 0) && ok;
+  if( !ok ){ remove(path.c_str()); }
+  return ok;
+}
+
+static std::string casePath(const std::string &dir, const BenchCase &bench){
+  std::ostringstream name;
+  name << dir << "/bench_" << bench.mesh << "_" << bench.triangles
+       << (bench.uvs ? "_uv" : "_nouv") << (bench.negative ? "_neg" : "") << ".obj";
+  return name.str();
+}
+
+static bool fileExists(const std::string &path){
+  FILE *file = fopen(path.c_str(), "rb");
+  if( file ){ fclose(file); }
+  return file != NULL;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+}
+
+//The CPU side of uploadMesh(): pack vertices, 16-bit indices when they fit
+static size_t prepareUpload(const Mesh &mesh){
+  PackedVertices packed;
+  packVertices(mesh.vertices, mesh.normals, mesh.uvs, VERTEX_COMPACT, VERTEX_INTERLEAVED, packed);
+  size_t index_bytes;
+  if( mesh.vertices.size() <= 65536 ){
+    std::vector< GLushort > short_indices(mesh.indices.begin(), mesh.indices.end());
+    index_bytes = short_indices.size()*sizeof(GLushort);
+  }else{
+    std::vector< GLuint > all_indices(mesh.indices);
+    index_bytes = all_indices.size()*sizeof(GLuint);
+  }
+  return packed.data.size() + index_bytes;
+}
+
+/**
+  Optimize the mesh at path like Mesh::load(), encode it and decode it
+    repeat times into preallocated buffers standing in for mapped GL ones.
+**/
+static bool benchmarkCodec(const std::string &path, unsigned int threads, int repeat, CodecResult &result){
+  Mesh mesh;
+  if( !mesh.loadOBJ(path.c_str(), threads) ){ return false; }
+  mesh.optimize();
+
+  std::vector< unsigned char > encoded;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if( !encodeMesh(mesh, encoded) ){ return false; }
+  result.encode_seconds = secondsSince(start);
+  result.encoded_bytes = encoded.size();
+
+  MeshCodecHeader header;
+  if( !readMeshCodecHeader(&encoded[0], encoded.size(), header) ){ return false; }
+  PackedVertices decoded;
+  layoutVertices(header.num_vertices, (header.flags & MESH_CODEC_HAS_UV) != 0, VERTEX_COMPACT,
+                 VERTEX_INTERLEAVED, decoded);
+  decoded.data.resize(header.num_vertices*decoded.vertex_bytes);
+  size_t index_size = meshCodecIndexSize(header);
+  std::vector< unsigned char > indices(mesh.indices.size()*index_size);
+  result.upload_bytes = decoded.data.size() + indices.size();
+
+  result.decode_seconds = 1e30;
+  for(int r=0; r < (std::max)(repeat, 5); r++){
+    start = std::chrono::steady_clock::now();
+    if( !decodeMesh(&encoded[0], encoded.size(), VERTEX_INTERLEAVED, decoded, &decoded.data[0], &indices[0]) ){
+      return false;
+    }
+    result.decode_seconds = (std::min)(result.decode_seconds, secondsSince(start));
+  }
+
+  //Vertices are renumbered, so compare the bytes behind every corner
+  PackedVertices original;
+  packVertices(mesh.vertices, mesh.normals, mesh.hasUV ? mesh.uvs : std::vector< vec2 >(),
+               VERTEX_COMPACT, VERTEX_INTERLEAVED, original);
+  size_t vertex_bytes = original.vertex_bytes;
+  result.round_trip = (vertex_bytes == decoded.vertex_bytes);
+  for(int k=0; k < 3; k++){
+    result.round_trip = result.round_trip && original.position_scale[k] == decoded.position_scale[k] &&
+                        original.position_bias[k] == decoded.position_bias[k];
+  }
+  for(size_t i=0; i < mesh.indices.size() && result.round_trip; i++){
+    size_t index;
+    if( index_size == sizeof(GLushort) ){
+      GLushort v;
+      memcpy(&v, &indices[2*i], sizeof(v));
+      index = v;
+    }else{
+      GLuint v;
+      memcpy(&v, &indices[4*i], sizeof(v));
+      index = v;
+    }
+    result.round_trip = memcmp(&original.data[mesh.indices[i]*vertex_bytes],
+                               &decoded.data[index*vertex_bytes], vertex_bytes) == 0;
+  }
+  return true;
+}
+
+static void printJSONStage(FILE *out, const StageResult &stage, size_t triangles, bool last){
+  double seconds = (std::max)(stage.seconds, 1e-9);
+  fprintf(out, "        \"%s\": { \"seconds\": %.6g, \"mb_per_s\": %.6g, \"triangles_per_s\": %.6g }%s\n",
+          stage.name.c_str(), stage.seconds, stage.bytes/seconds/1e6, triangles/seconds, last ? "" : ",");
+}
+
+static std::vector< std::string > splitList(const char *list){
+  std::vector< std::string > items;
+  std::stringstream in(list);
+  std::string item;
+  while( std::getline(in, item, ',') ){
+    if( !item.empty() ){ items.push_back(item); }
+  }
+  return items;
+}
+
+int main(int argc, char **argv){
+  std::string dir = ".";
+  std::string out_path = "bench_mesh.json";
+  std::vector< std::string > sizes = splitList("10000,100000,1000000");
+  std::vector< std::string > meshes = splitList("sphere,grid,noise");
+  std::vector< std::string > variants = splitList("uv,nouv,neg");
+  std::vector< std::string > models;
+  bool codec = false;
+  int repeat = 3;
+  unsigned int threads = 0;
+
+  for(int i=1; i+1 < argc; i+=2){
+    std::string option(argv[i]);
+    if( option == "--dir" ){            dir = argv[i+1]; }
+    else if( option == "--out" ){       out_path = argv[i+1]; }
+    else if( option == "--sizes" ){     sizes = splitList(argv[i+1]); }
+    else if( option == "--meshes" ){    meshes = splitList(argv[i+1]); }
+    else if( option == "--variants" ){  variants = splitList(argv[i+1]); }
+    else if( option == "--models" ){    models = splitList(argv[i+1]); }
+    else if( option == "--codec" ){     codec = atoi(argv[i+1]) != 0; }
+    else if( option == "--repeat" ){    repeat = (std::max)(1, atoi(argv[i+1])); }
+    else if( option == "--threads" ){   threads = (unsigned int) atoi(argv[i+1]); }
+    else{
+      printf("Unknown option %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if( threads == 0 ){ threads = Parallel::workerCount(); }
+
+  std::vector< BenchCase > cases;
+  for(size_t s=0; s < sizes.size(); s++){
+    for(size_t m=0; m < meshes.size(); m++){
+      for(size_t v=0; v < variants.size(); v++){
+        BenchCase bench;
+        bench.mesh = meshes[m];
+        bench.triangles = (size_t) strtod(sizes[s].c_str(), NULL);
+        bench.uvs = (variants[v] != "nouv");
+        bench.negative = (variants[v] == "neg");
+        if( bench.mesh != "sphere" && bench.mesh != "grid" && bench.mesh != "noise" ){
+          printf("Unknown mesh %s\n", bench.mesh.c_str());
+          return EXIT_FAILURE;
+        }
+        cases.push_back(bench);
+      }
+    }
+  }
+  for(size_t m=0; m < models.size(); m++){
+    BenchCase bench;
+    size_t slash = models[m].find_last_of("/\\");
+    bench.mesh = (slash == std::string::npos) ? models[m] : models[m].substr(slash+1);
+    bench.triangles = 0;
+    bench.uvs = bench.negative = false;
+    bench.path = models[m];
+    cases.push_back(bench);
+  }
+
+  FILE *out = fopen(out_path.c_str(), "w");
+  if( out == NULL ){
+    printf("Could not write %s\n", out_path.c_str());
+    return EXIT_FAILURE;
+  }
+  fprintf(out, "{\n  \"threads\": %u,\n  \"repeat\": %d,\n  \"results\": [\n", threads, repeat);
+
+  std::ostringstream table;
+  char row[256];
+  snprintf(row, sizeof(row), "%-28s %10s %12s %12s %12s %12s %13s\n", "case", "triangles",
+           "parse MB/s", "normals MB/s", "deindex MB/s", "upload MB/s", "tangents ms");
+  table << row;
+  std::ostringstream codec_table;
+  snprintf(row, sizeof(row), "%-28s %12s %10s %10s %12s %12s %6s\n", "case", "encoded KB", "vs OBJ",
+           "vs upload", "encode MB/s", "decode MB/s", "exact");
+  codec_table << row;
+
+  bool ok = true, exact = true;
+  for(size_t c=0; c < cases.size(); c++){
+    const BenchCase &bench = cases[c];
+    std::string path = bench.path.empty() ? casePath(dir, bench) : bench.path;
+    if( bench.path.empty() && !fileExists(path) ){
+      printf("Generating %s\n", path.c_str());
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if( !generateOBJ(bench, path) ){
+        printf("Could not write %s\n", path.c_str());
+        ok = false;
+        break;
+      }
+      printf("Generated in %f s\n", secondsSince(start));
+    }
+
+    //Fastest of the repeats for every stage
+    StageResult stages[5] = { { "parse", 1e30, 0 }, { "normals", 1e30, 0 },
+                              { "deindex", 1e30, 0 }, { "upload_prep", 1e30, 0 }, { "tangents", 1e30, 0 } };
+    size_t file_bytes = 0, triangles = 0, vertices = 0, positions = 0;
+    bool generated_normals = false, has_uv = false;
+    for(int r=0; r < repeat && ok; r++){
+      Mesh mesh;
+      ObjLoadTimings timings;
+      if( !mesh.loadOBJ(path.c_str(), threads, 180.0f, &timings) ){
+        ok = false;
+        break;
+      }
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      size_t upload_bytes = prepareUpload(mesh);
+      double upload = secondsSince(start);
+      start = std::chrono::steady_clock::now();
+      mesh.buildTangents(threads);
+      double tangents = secondsSince(start);
+      if( r == 0 && !mesh.tangents.empty() ){
+        std::vector< vec4 > parallel_tangents(mesh.tangents);
+        mesh.buildTangents(1);
+        if( memcmp(&parallel_tangents[0], &mesh.tangents[0], parallel_tangents.size()*sizeof(vec4)) != 0 ){
+          printf("Tangents of %s depend on the thread count\n", path.c_str());
+          exact = false;
+        }
+      }
+
+      MappedFile file;
+      file.open(path.c_str());
+      file_bytes = file.size;
+      triangles = mesh.indices.size()/3;
+      vertices = mesh.vertices.size();
+      generated_normals = timings.normals > 0;
+      has_uv = mesh.hasUV;
+      if( r == 0 ){
+        //Positions in the file, for the normals stage's input size
+        const char *p = file.data, *end = file.data + file.size;
+        while( p < end ){
+          if( p+1 < end && p[0] == 'v' && p[1] == ' ' ){ positions++; }
+          p = ObjScan::skipLine(p, end);
+        }
+      }
+
+      double seconds[5] = { timings.parse, timings.normals, timings.deindex, upload, tangents };
+      double bytes[5] = { (double) file_bytes,
+                          generated_normals ? 3.0*triangles*sizeof(unsigned int) + positions*sizeof(vec3) : 0.0,
+                          3.0*triangles*3*sizeof(unsigned int),
+                          (double) upload_bytes,
+                          has_uv ? 3.0*triangles*sizeof(unsigned int) + vertices*52.0 : 0.0 };
+      for(int s=0; s < 5; s++){
+        stages[s].seconds = (std::min)(stages[s].seconds, seconds[s]);
+        stages[s].bytes = bytes[s];
+      }
+    }
+    CodecResult coded = CodecResult();
+    if( ok && codec && !benchmarkCodec(path, threads, repeat, coded) ){ ok = false; }
+    if( !ok ){
+      printf("Could not load %s\n", path.c_str());
+      break;
+    }
+
+    //Separator before every entry after the first, so a run that stops
+    //early still leaves valid JSON
+    fprintf(out, "%s    {\n      \"mesh\": \"%s\", \"triangles\": %zu, \"vertices\": %zu, \"uvs\": %s, "
+                 "\"negative_indices\": %s, \"normals\": \"%s\",\n      \"file\": \"%s\", \"file_bytes\": %zu,\n"
+                 "      \"stages\": {\n",
+            (c > 0) ? ",\n" : "", bench.mesh.c_str(), triangles, vertices, has_uv ? "true" : "false",
+            bench.negative ? "true" : "false", generated_normals ? "generated" : "file", path.c_str(), file_bytes);
+    int last_stage = has_uv ? 4 : 3;
+    for(int s=0; s <= last_stage; s++){
+      if( s == 1 && !generated_normals ){ continue; }
+      printJSONStage(out, stages[s], triangles, s == last_stage);
+    }
+    fprintf(out, "      }");
+    if( codec ){
+      fprintf(out, ",\n      \"codec\": { \"encoded_bytes\": %zu, \"ratio_to_obj\": %.6g, \"ratio_to_upload\": %.6g, "
+                   "\"encode_mb_per_s\": %.6g, \"decode_mb_per_s\": %.6g, \"round_trip\": %s }",
+              coded.encoded_bytes, (double) file_bytes/coded.encoded_bytes, (double) coded.upload_bytes/coded.encoded_bytes,
+              coded.upload_bytes/(std::max)(coded.encode_seconds, 1e-9)/1e6,
+              coded.upload_bytes/(std::max)(coded.decode_seconds, 1e-9)/1e6, coded.round_trip ? "true" : "false");
+      if( !coded.round_trip ){
+        printf("Codec round trip of %s does not match\n", path.c_str());
+        exact = false;
+      }
+    }
+    fprintf(out, "\n    }");
+
+    std::string name = bench.path.empty() ? bench.mesh + (bench.uvs ? " uv" : " nouv") + (bench.negative ? " neg" : "")
+                                          : bench.mesh;
+    double mb[4];
+    for(int s=0; s < 4; s++){ mb[s] = stages[s].bytes/(std::max)(stages[s].seconds, 1e-9)/1e6; }
+    snprintf(row, sizeof(row), "%-28s %10zu %12.1f %12s %12.1f %12.1f %13s\n", name.c_str(), triangles, mb[0],
+             generated_normals ? std::to_string((long long) mb[1]).c_str() : "-", mb[2], mb[3],
+             has_uv ? std::to_string((long long)(stages[4].seconds*1000.0)).c_str() : "-");
+    table << row;
+    if( codec ){
+      snprintf(row, sizeof(row), "%-28s %12.1f %10.2f %10.2f %12.1f %12.1f %6s\n", name.c_str(),
+               coded.encoded_bytes/1024.0, (double) file_bytes/coded.encoded_bytes,
+               (double) coded.upload_bytes/coded.encoded_bytes,
+               coded.upload_bytes/(std::max)(coded.encode_seconds, 1e-9)/1e6,
+               coded.upload_bytes/(std::max)(coded.decode_seconds, 1e-9)/1e6, coded.round_trip ? "yes" : "NO");
+      codec_table << row;
+    }
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  ok = (fclose(out) == 0) && ok;
+  std::cout << "\n" << table.str();
+  if( codec ){ std::cout << "\n" << codec_table.str(); }
+  if( ok ){ std::cout << "Results written to " << out_path << "\n"; }
+  return (ok && exact) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
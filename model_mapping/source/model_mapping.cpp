@@ -1,5 +1,7 @@
 #include "common.h"
 #include "SourcePath.h"
+#include "MeshChunks.h"
+#include "AssetBundle.h"
 
 
 using namespace Angel;
@@ -28,13 +30,39 @@ std::string files[_TOTAL_MODELS] = {"/models/sphere.obj",
                                     "/models/dragon.obj"};
 
 
-std::vector < Mesh > mesh;
-std::vector < GLuint > buffer;
-std::vector < GLuint > vao;
+MeshResidency *residency;
+size_t mesh_budget_mb = 256;    //CPU + GPU bytes of resident meshes, first argument
+GPUMesh placeholder;            //wire box drawn for meshes still loading
 CubeMap *cube;
+GLint vPosition, vNormal;
 GLuint ModelView_loc, NormalMatrix_loc, Projection_loc;
+GLuint PositionScale_loc, PositionBias_loc, OctNormals_loc;
+VertexFormat vertex_format;
+VertexLayout vertex_layout;
 bool wireframe;
 int current_draw;
+int forced_lod;                 //level of detail to draw (clamped per mesh), -1 picks it from screen-space error
+unsigned int auto_lod;          //last level picked by screen-space error, kept for hysteresis
+float lod_pixel_error = 1.0f;   //largest simplification error allowed on screen, in pixels
+bool meshlet_culling;           //frustum and normal cone culling of meshlets before drawing
+MeshletCullStats cull_stats;    //counts of the last frame
+std::vector< GLsizei > draw_counts;
+std::vector< const GLvoid * > draw_offsets;
+MeshBVH *pick_bvh;              //ray queries on the mesh at pick_path, built on the first pick
+std::string pick_path;
+mat4 frame_view, frame_projection;   //matrices of the last frame drawn, for picking
+std::string chunks_path;        //.meshchunks model drawn instead of files[], second argument
+std::vector< MeshChunkRecord > chunk_records;
+std::vector< unsigned int > chunk_lods;   //auto_lod of every chunk
+mat4 chunks_model_view;         //object space of every chunk to the unit frame
+std::string assets_path;        //bundle baked by assetc, used instead of the loose files when present
+AssetBundle assets;
+
+//Residency key of model i: its baked mesh when the bundle has one, else the OBJ
+std::string modelPath(int i){
+  if( assets.isOpen() && assets.find(files[i].c_str(), ASSET_MESH) ){ return assetPath(assets_path, files[i]); }
+  return source_path + files[i];
+}
 
 //==========Trackball Variables==========
 static float curquat[4],lastquat[4];
@@ -54,6 +82,364 @@ static float scalefactor;
 bool lbutton_down;
 
 
+//Pack mesh in the current vertex_format and (re)fill its GPU buffers
+void uploadMesh(const Mesh &mesh, GPUMesh &gpu){
+  PackedVertices packed;
+  packVertices(mesh.vertices, mesh.normals, std::vector< vec2 >(), vertex_format, vertex_layout, packed);
+  
+  gpu.position_scale = packed.position_scale;
+  gpu.position_bias  = packed.position_bias;
+  gpu.oct_normals    = packed.oct_normals;
+  
+  if( gpu.vao == 0 ){
+    glGenVertexArrays( 1, &gpu.vao );
+    glGenBuffers( 1, &gpu.vertex_buffer );
+    glGenBuffers( 1, &gpu.index_buffer );
+  }
+  glBindVertexArray( gpu.vao );
+  glBindBuffer( GL_ARRAY_BUFFER, gpu.vertex_buffer );
+  glBufferData( GL_ARRAY_BUFFER, packed.data.size(), packed.data.empty() ? NULL : &packed.data[0], GL_STATIC_DRAW );
+  setVertexAttribs(packed, vPosition, vNormal);
+  
+  //All levels of detail share one index buffer, full mesh first.
+  //16-bit indices whenever the welded vertex count allows it
+  std::vector< GLuint > all_indices(mesh.indices);
+  all_indices.insert(all_indices.end(), mesh.lod_indices.begin(), mesh.lod_indices.end());
+  size_t index_bytes;
+  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, gpu.index_buffer );
+  if( mesh.vertices.size() <= 65536 ){
+    std::vector< GLushort > short_indices(all_indices.begin(), all_indices.end());
+    index_bytes = short_indices.size()*sizeof(GLushort);
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, index_bytes,
+                  short_indices.empty() ? NULL : &short_indices[0], GL_STATIC_DRAW );
+    gpu.index_type = GL_UNSIGNED_SHORT;
+  }else{
+    index_bytes = all_indices.size()*sizeof(GLuint);
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, index_bytes,
+                  all_indices.empty() ? NULL : &all_indices[0], GL_STATIC_DRAW );
+    gpu.index_type = GL_UNSIGNED_INT;
+  }
+  glBindVertexArray( 0 );
+  
+  gpu.bytes = packed.data.size() + index_bytes;
+  std::cout << "Uploaded " << packed.vertex_bytes << " bytes/vertex "
+            << (vertex_layout == VERTEX_INTERLEAVED ? "interleaved" : "planar") << ", "
+            << gpu.bytes/1024 << " KB on GPU\n";
+}
+
+//Unit wire box matching the normalized extents of a loaded mesh
+void initPlaceholder(){
+  std::vector< vec4 > corners(8);
+  std::vector< vec3 > normals(8, vec3(0.0, 0.0, 1.0));
+  for(int c=0; c < 8; c++){
+    corners[c] = vec4((c & 1) ? 0.5 : -0.5, (c & 2) ? 0.5 : -0.5, (c & 4) ? 0.5 : -0.5, 1.0);
+  }
+  GLushort edges[24] = { 0,1, 2,3, 4,5, 6,7, 0,2, 1,3, 4,6, 5,7, 0,4, 1,5, 2,6, 3,7 };
+  
+  PackedVertices packed;
+  packVertices(corners, normals, std::vector< vec2 >(), VERTEX_FLOAT, VERTEX_INTERLEAVED, packed);
+  placeholder.position_scale = packed.position_scale;
+  placeholder.position_bias  = packed.position_bias;
+  placeholder.oct_normals    = packed.oct_normals;
+  placeholder.index_type     = GL_UNSIGNED_SHORT;
+  placeholder.bytes          = packed.data.size() + sizeof(edges);
+  
+  glGenVertexArrays( 1, &placeholder.vao );
+  glGenBuffers( 1, &placeholder.vertex_buffer );
+  glGenBuffers( 1, &placeholder.index_buffer );
+  glBindVertexArray( placeholder.vao );
+  glBindBuffer( GL_ARRAY_BUFFER, placeholder.vertex_buffer );
+  glBufferData( GL_ARRAY_BUFFER, packed.data.size(), &packed.data[0], GL_STATIC_DRAW );
+  setVertexAttribs(packed, vPosition, vNormal);
+  glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, placeholder.index_buffer );
+  glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(edges), edges, GL_STATIC_DRAW );
+  glBindVertexArray( 0 );
+}
+
+/*
+ * Draw a resident mesh (or the placeholder for NULL) as a grid of
+ * instances x instances copies with the program bound.  With stats the
+ * meshlets of every copy are culled first and the survivors drawn with
+ * one glMultiDrawElements; without, each copy is a single glDrawElements.
+ */
+void drawInstances(const MeshResidency::Entry *entry, const mat4 &view, const mat4 &projection, int instances,
+                   unsigned int lod_level, MeshletCullStats *stats=NULL){
+  const GPUMesh &g = entry ? entry->gpu : placeholder;
+  mat4 model = entry ? entry->mesh->model_view : mat4();
+  GLenum mode = entry ? GL_TRIANGLES : GL_LINES;
+  GLsizei count = 24;
+  size_t first = 0;
+  const MeshLOD *lod = NULL;
+  if( entry ){
+    const Mesh &m = *entry->mesh;
+    count = (GLsizei) m.indices.size();
+    if( !m.lods.empty() ){
+      lod = &m.lods[(std::min)((size_t) lod_level, m.lods.size()-1)];
+      first = lod->first_index;
+      count = (GLsizei) lod->index_count;
+    }
+  }
+  bool cull = stats && lod && lod->meshlet_count;
+  size_t index_size = (g.index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+  
+  glBindVertexArray( g.vao );
+  glUniformMatrix4fv( Projection_loc, 1, GL_TRUE, projection );
+  glUniform3fv( PositionScale_loc, 1, g.position_scale );
+  glUniform3fv( PositionBias_loc, 1, g.position_bias );
+  glUniform1i( OctNormals_loc, g.oct_normals );
+  
+  float spacing = 2.0f/instances;
+  for(int y=0; y < instances; y++){
+    for(int x=0; x < instances; x++){
+      mat4 mv = view * Translate(-1.0f + spacing*(x+0.5f), -1.0f + spacing*(y+0.5f), 0.0f) *
+                Scale(spacing*0.5f, spacing*0.5f, spacing*0.5f) * model;
+      glUniformMatrix4fv( ModelView_loc, 1, GL_TRUE, mv );
+      glUniformMatrix4fv( NormalMatrix_loc, 1, GL_TRUE, transpose(invert(mv)) );
+      if( cull ){
+        cullMeshlets(entry->mesh->meshlets, *lod, mv, projection, index_size, draw_counts, draw_offsets, *stats);
+        if( !draw_counts.empty() ){
+          glMultiDrawElements( mode, &draw_counts[0], g.index_type, &draw_offsets[0], (GLsizei) draw_counts.size() );
+        }
+      }else{
+        glDrawElements( mode, count, g.index_type, BUFFER_OFFSET(first*index_size) );
+      }
+    }
+  }
+  glBindVertexArray( 0 );
+}
+
+/*
+ * Draw the chunks of chunks_path whose bounds touch the frustum, each at
+ * the level its own screen-space error calls for.  Chunks are paged in by
+ * the residency on first sight and become the first to be evicted once
+ * they leave the view; nothing is drawn for them while they load.
+ */
+void drawChunks(const mat4 &view, const mat4 &projection, int height, MeshletCullStats *stats){
+  vec4 planes[6];
+  frustumPlanes(projection*view*chunks_model_view, planes);
+  for(size_t i=0; i < chunk_records.size(); i++){
+    const MeshChunkRecord &r = chunk_records[i];
+    vec3 box_min(r.box_min[0], r.box_min[1], r.box_min[2]);
+    vec3 box_max(r.box_max[0], r.box_max[1], r.box_max[2]);
+    vec3 center = (box_min + box_max)/2.0;
+    float radius = length(box_max - box_min)/2.0f;
+    bool inside = true;
+    for(int p=0; p < 6 && inside; p++){
+      inside = dot(vec3(planes[p].x, planes[p].y, planes[p].z), center) + planes[p].w >= -radius;
+    }
+    if( !inside ){ continue; }
+    
+    MeshResidency::Entry *entry = residency->draw(chunkPath(chunks_path, (unsigned int) i));
+    if( entry == NULL ){ continue; }
+    const Mesh &m = *entry->mesh;
+    unsigned int lod_level = (forced_lod >= 0) ? (unsigned int) forced_lod : 0;
+    if( forced_lod < 0 && !m.lods.empty() ){
+      float pixels = pixelsPerUnit(m.box_min, m.box_max, view*m.model_view, projection[1][1], (float) height);
+      lod_level = chunk_lods[i] = selectLOD(m.lods, pixels, lod_pixel_error, chunk_lods[i]);
+    }
+    drawInstances(entry, view, projection, 1, lod_level, stats);
+  }
+}
+
+//BVH over the resident mesh at path, rebuilt when the path changes; NULL while loading
+static const MeshBVH *pickBVH(const std::string &path, const Mesh **mesh){
+  MeshResidency::Entry *entry = residency->draw(path);
+  if( entry == NULL ){ return NULL; }
+  if( pick_bvh == NULL || pick_path != path ){
+    delete pick_bvh;
+    pick_bvh = new MeshBVH(entry->mesh->vertices, entry->mesh->indices);
+    pick_path = path;
+  }
+  *mesh = entry->mesh;
+  return pick_bvh;
+}
+
+//Object space ray through framebuffer pixel (x, y) of the last frame
+static void pickRay(const Mesh &mesh, double x, double y, int width, int height, vec3 &origin, vec3 &direction){
+  mat4 unproject = invert(frame_projection*frame_view*mesh.model_view);
+  float nx = float(2.0*x/width - 1.0);
+  float ny = float(1.0 - 2.0*y/height);
+  vec4 near_point = unproject*vec4(nx, ny, -1.0, 1.0);
+  vec4 far_point = unproject*vec4(nx, ny, 1.0, 1.0);
+  origin = vec3(near_point.x, near_point.y, near_point.z)/near_point.w;
+  direction = vec3(far_point.x, far_point.y, far_point.z)/far_point.w - origin;
+}
+
+//Report the triangle and OBJ space position under framebuffer pixel (x, y)
+void pick(const std::string &path, double x, double y, int width, int height){
+  const Mesh *mesh = NULL;
+  const MeshBVH *bvh = pickBVH(path, &mesh);
+  if( bvh == NULL ){
+    std::cout << path << " is still loading\n";
+    return;
+  }
+  vec3 origin, direction;
+  pickRay(*mesh, x, y, width, height, origin, direction);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  RayHit hit;
+  bool found = bvh->intersect(origin, direction, hit);
+  double us = std::chrono::duration< double, std::micro >(std::chrono::steady_clock::now() - start).count();
+  if( found ){
+    vec3 p = origin + direction*hit.t;
+    printf("Picked triangle %u at (%g, %g, %g) in %.1f us\n", hit.triangle, p.x, p.y, p.z, us);
+  }else{
+    printf("Nothing under the cursor (%.1f us)\n", us);
+  }
+}
+
+/*
+ * Picking benchmark: casts a 256x256 grid of rays through the last frame
+ * with the BVH, and a sample of them against every triangle to check the
+ * hits and compare the per-ray cost.
+ */
+void benchmarkPicking(const std::string &path, int width, int height){
+  const int GRID = 256;
+  const int BRUTE_FORCE_RAYS = 64;
+  const Mesh *mesh = NULL;
+  if( pick_path != path ){ delete pick_bvh; pick_bvh = NULL; }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const MeshBVH *bvh = pickBVH(path, &mesh);
+  if( bvh == NULL ){
+    std::cout << path << " is still loading\n";
+    return;
+  }
+  double build_ms = std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count();
+
+  unsigned int hits = 0;
+  start = std::chrono::steady_clock::now();
+  for(int y=0; y < GRID; y++){
+    for(int x=0; x < GRID; x++){
+      vec3 origin, direction;
+      pickRay(*mesh, (x+0.5)*width/GRID, (y+0.5)*height/GRID, width, height, origin, direction);
+      RayHit hit;
+      hits += bvh->intersect(origin, direction, hit);
+    }
+  }
+  double bvh_us = std::chrono::duration< double, std::micro >(std::chrono::steady_clock::now() - start).count()/(GRID*GRID);
+
+  //Moller-Trumbore over the whole index list
+  unsigned int rays = 0, mismatches = 0;
+  start = std::chrono::steady_clock::now();
+  for(; rays < BRUTE_FORCE_RAYS; rays++){
+    int x = (rays*37)%GRID;
+    int y = rays*GRID/BRUTE_FORCE_RAYS;
+    vec3 origin, direction;
+    pickRay(*mesh, (x+0.5)*width/GRID, (y+0.5)*height/GRID, width, height, origin, direction);
+    float best = (std::numeric_limits< float >::max)();
+    for(size_t i=0; i+2 < mesh->indices.size(); i+=3){
+      vec4 a = mesh->vertices[mesh->indices[i]];
+      vec4 b = mesh->vertices[mesh->indices[i+1]];
+      vec4 c = mesh->vertices[mesh->indices[i+2]];
+      vec3 e1(b.x-a.x, b.y-a.y, b.z-a.z), e2(c.x-a.x, c.y-a.y, c.z-a.z);
+      vec3 p = cross(direction, e2);
+      float det = dot(e1, p);
+      if( fabs(det) < 1e-30f ){ continue; }
+      vec3 s = origin - vec3(a.x, a.y, a.z);
+      float u = dot(s, p)/det;
+      vec3 q = cross(s, e1);
+      float v = dot(direction, q)/det;
+      float t = dot(e2, q)/det;
+      if( u >= 0 && v >= 0 && u + v <= 1 && t > 0 && t < best ){ best = t; }
+    }
+    RayHit hit;
+    bool found = bvh->intersect(origin, direction, hit);
+    if( found != (best < (std::numeric_limits< float >::max)()) || (found && fabs(hit.t - best) > 1e-5f*best) ){
+      mismatches++;
+    }
+  }
+  double brute_us = std::chrono::duration< double, std::micro >(std::chrono::steady_clock::now() - start).count()/rays;
+
+  printf("Picking %s: BVH %u nodes built in %.1f ms, %.2f us/ray (%u of %d rays hit), "
+         "brute force %.0f us/ray over %u rays, %u mismatches\n",
+         path.c_str(), (unsigned int) bvh->nodeCount(), build_ms, bvh_us, hits, GRID*GRID,
+         brute_us, rays, mismatches);
+}
+
+/*
+ * Vertex-bound microbenchmark: draws 10x10 instances of the current mesh
+ * for every format/layout combination and reports the average frame time.
+ * Frames are not swapped; glFinish brackets each measurement.
+ */
+void benchmarkLayouts(const std::string &path, int width, int height){
+  MeshResidency::Entry *entry = residency->draw(path);
+  if( entry == NULL ){
+    std::cout << path << " is still loading\n";
+    return;
+  }
+  const int INSTANCES = 10;
+  const int FRAMES = 20;
+  VertexFormat saved_format = vertex_format;
+  VertexLayout saved_layout = vertex_layout;
+  
+  mat4 projection = Perspective( 45.0, GLfloat(width)/height, 0.5, 5.0 );
+  mat4 view = Translate( 0.0, 0.0, -2.5 );
+  double triangles = double(entry->mesh->getNumTri())*INSTANCES*INSTANCES;
+  
+  glViewport(0, 0, width, height);
+  glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+  for(int f=0; f < 2; f++){
+    for(int l=0; l < 2; l++){
+      vertex_format = (VertexFormat) f;
+      vertex_layout = (VertexLayout) l;
+      residency->reupload(*entry);
+      
+      glUseProgram(program);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      drawInstances(entry, view, projection, INSTANCES, 0);    //warm up
+      glFinish();
+      
+      double start = glfwGetTime();
+      for(int frame=0; frame < FRAMES; frame++){
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawInstances(entry, view, projection, INSTANCES, 0);
+      }
+      glFinish();
+      double ms = (glfwGetTime() - start)*1000.0/FRAMES;
+      glUseProgram(0);
+      
+      printf("Benchmark %s %-11s %8.2f ms/frame  %7.1f Mtri/s\n",
+             f == VERTEX_COMPACT ? "compact" : "float  ", l == VERTEX_INTERLEAVED ? "interleaved" : "planar",
+             ms, triangles/(ms*1000.0));
+    }
+  }
+  
+  vertex_format = saved_format;
+  vertex_layout = saved_layout;
+  residency->reupload(*entry);
+}
+
+/*
+ * Subdivides the current mesh in place: one level of every edge, or with
+ * adaptive up to four levels of only the edges longer than 8 pixels in the
+ * last frame.  The working set is bounded by half the residency budget.
+ */
+void subdivideCurrent(const std::string &path, SubdivisionScheme scheme, bool adaptive, int width, int height){
+  MeshResidency::Entry *entry = residency->draw(path);
+  if( entry == NULL ){
+    std::cout << path << " is still loading\n";
+    return;
+  }
+  Mesh &mesh = *entry->mesh;
+  size_t max_bytes = residency->budget()/2;
+  unsigned int levels = adaptive ? mesh.subdivideAdaptive(frame_projection*frame_view*mesh.model_view,
+                                                          (float) width, (float) height, 8.0f, 4, max_bytes)
+                                 : mesh.subdivide(scheme, 1, max_bytes);
+  if( levels == 0 ){ return; }
+
+  mesh.optimize();
+  mesh.buildMeshlets();
+  if( mesh.hasUV ){ mesh.buildTangents(); }
+  residency->reupload(*entry);
+  forced_lod = -1;
+  auto_lod = 0;
+  if( pick_path == path ){
+    delete pick_bvh;
+    pick_bvh = NULL;
+    pick_path.clear();
+  }
+}
+
 static void error_callback(int error, const char* description)
 {
   fprintf(stderr, "Error: %s\n", description);
@@ -65,10 +451,57 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     glfwSetWindowShouldClose(window, GLFW_TRUE);
   if (key == GLFW_KEY_SPACE && action == GLFW_PRESS){
     current_draw = (current_draw+1)%_TOTAL_MODELS;
+    residency->request(modelPath(current_draw));
   }
   if (key == GLFW_KEY_W && action == GLFW_PRESS){
     wireframe = !wireframe;
   }
+  if (key == GLFW_KEY_C && action == GLFW_PRESS){
+    vertex_format = (vertex_format == VERTEX_COMPACT) ? VERTEX_FLOAT : VERTEX_COMPACT;
+    residency->reuploadAll();
+  }
+  if (key == GLFW_KEY_L && action == GLFW_PRESS){
+    vertex_layout = (vertex_layout == VERTEX_INTERLEAVED) ? VERTEX_PLANAR : VERTEX_INTERLEAVED;
+    residency->reuploadAll();
+  }
+  if (key == GLFW_KEY_D && action == GLFW_PRESS){
+    MeshResidency::Entry *entry = residency->draw(modelPath(current_draw));
+    int levels = (entry && !entry->mesh->lods.empty()) ? (int) entry->mesh->lods.size() : 1;
+    //Cycle automatic, 0, 1, ... levels-1, automatic
+    forced_lod = (forced_lod+1 < levels) ? forced_lod+1 : -1;
+    if( forced_lod < 0 ){
+      std::cout << "LOD automatic, " << lod_pixel_error << " pixel error\n";
+    }else if( entry && !entry->mesh->lods.empty() ){
+      const MeshLOD &lod = entry->mesh->lods[forced_lod];
+      std::cout << "LOD " << forced_lod << ": " << lod.index_count/3 << " triangles, error "
+                << lod.error << "\n";
+    }
+  }
+  if (key == GLFW_KEY_K && action == GLFW_PRESS){
+    meshlet_culling = !meshlet_culling;
+    std::cout << "Meshlet culling " << (meshlet_culling ? "on" : "off") << "\n";
+  }
+  if (key == GLFW_KEY_P && action == GLFW_PRESS){
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    benchmarkPicking(modelPath(current_draw), width, height);
+  }
+  if (key == GLFW_KEY_S && action == GLFW_PRESS){
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    subdivideCurrent(modelPath(current_draw), (mods & GLFW_MOD_SHIFT) ? SUBDIVIDE_CATMULL_CLARK : SUBDIVIDE_LOOP,
+                     false, width, height);
+  }
+  if (key == GLFW_KEY_A && action == GLFW_PRESS){
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    subdivideCurrent(modelPath(current_draw), SUBDIVIDE_LOOP, true, width, height);
+  }
+  if (key == GLFW_KEY_B && action == GLFW_PRESS){
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    benchmarkLayouts(modelPath(current_draw), width, height);
+  }
 }
 
 //User interaction handler
@@ -79,6 +512,17 @@ static void mouse_click(GLFWwindow* window, int button, int action, int mods){
     return;
   }
   
+  //Right click picks; the cursor is in window coordinates, the frame in pixels
+  if( button == GLFW_MOUSE_BUTTON_RIGHT ){
+    double xpos, ypos;
+    int window_width, window_height, width, height;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    glfwGetWindowSize(window, &window_width, &window_height);
+    glfwGetFramebufferSize(window, &width, &height);
+    pick(modelPath(current_draw), xpos*width/window_width, ypos*height/window_height, width, height);
+    return;
+  }
+  
   if( mods & GLFW_MOD_SHIFT){
     scaling=true;
   }else if( mods & GLFW_MOD_ALT ){
@@ -166,8 +610,8 @@ void init(){
   glBindFragDataLocation(program, 0, "fragColor");
 
   //Per vertex attributes
-  GLuint vPosition = glGetAttribLocation( program, "vPosition" );
-  GLuint vNormal = glGetAttribLocation( program, "vNormal" );
+  vPosition = glGetAttribLocation( program, "vPosition" );
+  vNormal = glGetAttribLocation( program, "vNormal" );
 
   //Compute ambient, diffuse, and specular terms
   color4 ambient_product  = light_ambient * material_ambient;
@@ -185,50 +629,50 @@ void init(){
   ModelView_loc = glGetUniformLocation( program, "ModelView" );
   NormalMatrix_loc = glGetUniformLocation( program, "NormalMatrix" );
   Projection_loc = glGetUniformLocation( program, "Projection" );
+  PositionScale_loc = glGetUniformLocation( program, "PositionScale" );
+  PositionBias_loc = glGetUniformLocation( program, "PositionBias" );
+  OctNormals_loc = glGetUniformLocation( program, "OctNormals" );
 
   //===== Send data to GPU ======
-  vao.resize(_TOTAL_MODELS);
-  glGenVertexArrays( _TOTAL_MODELS, &vao[0] );
-
-  buffer.resize(_TOTAL_MODELS);
-  glGenBuffers( _TOTAL_MODELS, &buffer[0] );
-
-  for(unsigned int i=0; i < _TOTAL_MODELS; i++){
-    mesh.push_back((source_path + files[i]).c_str());
-
-    glBindVertexArray( vao[i] );
-    glBindBuffer( GL_ARRAY_BUFFER, buffer[i] );
-    unsigned int vertices_bytes = mesh[i].vertices.size()*sizeof(vec4);
-    unsigned int normals_bytes  = mesh[i].normals.size()*sizeof(vec3);
-
-    glBufferData( GL_ARRAY_BUFFER, vertices_bytes + normals_bytes, NULL, GL_STATIC_DRAW );
-    unsigned int offset = 0;
-    glBufferSubData( GL_ARRAY_BUFFER, offset, vertices_bytes, &mesh[i].vertices[0] );
-    offset += vertices_bytes;
-    glBufferSubData( GL_ARRAY_BUFFER, offset, normals_bytes,  &mesh[i].normals[0] );
-
-    glEnableVertexAttribArray( vNormal );
-    glEnableVertexAttribArray( vPosition );
-
-    glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
-    glVertexAttribPointer( vNormal, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(mesh[i].vertices.size()*sizeof(vec4)) );
-
+  current_draw = 0;
+  vertex_format = VERTEX_COMPACT;
+  vertex_layout = VERTEX_INTERLEAVED;
+  initPlaceholder();
+  
+  //Meshes are loaded in the background when first drawn and uploaded by
+  //residency->update() as they finish, so the first frame never waits on
+  //a large model; least recently drawn ones are evicted over the budget
+  residency = new MeshResidency(mesh_budget_mb*1024*1024, uploadMesh);
+  residency->request(modelPath(current_draw));
+  
+  if( !chunks_path.empty() ){
+    MeshChunksHeader header;
+    if( readMeshChunks(chunks_path.c_str(), header, chunk_records) ){
+      std::cout << chunks_path << ": " << header.num_triangles << " triangles in "
+                << chunk_records.size() << " chunks\n";
+      chunk_lods.assign(chunk_records.size(), 0);
+      chunks_model_view = Scale(1.0/header.scale, 1.0/header.scale, 1.0/header.scale)*
+                          Translate(-header.center[0], -header.center[1], -header.center[2]);
+    }else{
+      std::cout << "Could not read " << chunks_path << "\n";
+    }
   }
   
   glUseProgram(0);
 
   //===== End: Send data to GPU ======
   
-  vector<std::string> faces(6);
-  faces[0] = source_path + "/skybox/2/right.png";
-  faces[1] = source_path + "/skybox/2/left.png";
-  faces[2] = source_path + "/skybox/2/top.png";
-  faces[3] = source_path + "/skybox/2/bottom.png";
-  faces[4] = source_path + "/skybox/2/front.png";
-  faces[5] = source_path + "/skybox/2/back.png";
-
   cube = new CubeMap();
-  cube->loadImages(faces);
+  if( !assets.isOpen() || !cube->loadBundle(assets, "/skybox/2") ){
+    vector<std::string> faces(6);
+    faces[0] = source_path + "/skybox/2/right.png";
+    faces[1] = source_path + "/skybox/2/left.png";
+    faces[2] = source_path + "/skybox/2/top.png";
+    faces[3] = source_path + "/skybox/2/bottom.png";
+    faces[4] = source_path + "/skybox/2/front.png";
+    faces[5] = source_path + "/skybox/2/back.png";
+    cube->loadImages(faces);
+  }
   cube->glInit();
 
 
@@ -256,7 +700,9 @@ void init(){
   scalefactor = 1.0;
   
   wireframe = false;
-  current_draw = 0;
+  forced_lod = -1;
+  meshlet_culling = true;
+  auto_lod = 0;
   
   lbutton_down = false;
 
@@ -266,10 +712,25 @@ void init(){
 }
 
 
-int main(void){
+int main(int argc, char **argv){
   
   GLFWwindow* window;
   
+  //model_mapping --convert model.obj model.meshchunks [memory_mb] converts and exits
+  if( argc > 3 && strcmp(argv[1], "--convert") == 0 ){
+    size_t memory_mb = (argc > 4) ? strtoul(argv[4], NULL, 10) : 256;
+    return convertOBJToChunks(argv[2], argv[3], memory_mb*1024*1024) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  
+  if( argc > 1 ){ mesh_budget_mb = strtoul(argv[1], NULL, 10); }
+  if( argc > 2 ){ chunks_path = argv[2]; }
+  
+  //Bake with: assetc <source>/assets.bundle
+  assets_path = source_path + "/assets.bundle";
+  if( assets.open(assets_path.c_str()) ){
+    std::cout << assets_path << ": " << assets.size() << " baked assets\n";
+  }
+  
   glfwSetErrorCallback(error_callback);
   
   if (!glfwInit())
@@ -300,10 +761,12 @@ int main(void){
   
   init();
   
-
+  bool first_frame = true;
   
   while (!glfwWindowShouldClose(window)){
     
+    residency->update();
+    
     //Display as wirframe, boolean tied to keystoke 'w'
     if(wireframe){
       glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
@@ -340,16 +803,29 @@ int main(void){
 
     // ====== Draw ======
     glUseProgram(program);
-    glBindVertexArray(vao[current_draw]);
-    glUniformMatrix4fv( ModelView_loc, 1, GL_TRUE, user_MV*mesh[current_draw].model_view);
-    glUniformMatrix4fv( Projection_loc, 1, GL_TRUE, projection );
-    glUniformMatrix4fv( NormalMatrix_loc, 1, GL_TRUE, transpose(invert(user_MV*mesh[current_draw].model_view)));
-
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cube->cubemapTexture);
-    glDrawArrays( GL_TRIANGLES, 0, mesh[current_draw].vertices.size() );
+    MeshletCullStats frame_stats;
+    frame_view = user_MV;
+    frame_projection = projection;
+    if( !chunk_records.empty() ){
+      drawChunks(user_MV, projection, height, meshlet_culling ? &frame_stats : NULL);
+    }else{
+      MeshResidency::Entry *entry = residency->draw(modelPath(current_draw));
+      unsigned int lod_level = (forced_lod >= 0) ? (unsigned int) forced_lod : 0;
+      if( entry && forced_lod < 0 && !entry->mesh->lods.empty() ){
+        const Mesh &m = *entry->mesh;
+        float pixels = pixelsPerUnit(m.box_min, m.box_max, user_MV*m.model_view, projection[1][1], (float) height);
+        unsigned int level = selectLOD(m.lods, pixels, lod_pixel_error, auto_lod);
+        if( level != auto_lod ){
+          std::cout << "LOD " << level << ": " << m.lods[level].index_count/3 << " triangles, "
+                    << m.lods[level].error*pixels << " pixel error\n";
+        }
+        lod_level = auto_lod = level;
+      }
+      drawInstances(entry, user_MV, projection, 1, lod_level, meshlet_culling ? &frame_stats : NULL);
+    }
     // ====== End: Draw ======
-    glBindVertexArray(0);
     glUseProgram(0);
     
     cube->draw(user_MV,projection);
@@ -358,8 +834,27 @@ int main(void){
     glfwSwapBuffers(window);
     glfwPollEvents();
     
+    //Culled meshlet counts of the frame in the title, rewritten only when they change
+    if( frame_stats.frustum_culled != cull_stats.frustum_culled ||
+        frame_stats.backface_culled != cull_stats.backface_culled ||
+        frame_stats.meshlets != cull_stats.meshlets ){
+      cull_stats = frame_stats;
+      char title[128];
+      snprintf(title, sizeof(title), "Assignment 3 - 3D Shading - meshlets culled: %u frustum, %u back-face of %u",
+               cull_stats.frustum_culled, cull_stats.backface_culled, cull_stats.meshlets);
+      glfwSetWindowTitle(window, title);
+    }
+    
+    if( first_frame ){
+      std::cout << "First frame after " << glfwGetTime()*1000.0 << " ms\n";
+      first_frame = false;
+    }
   }
   
+  residency->printStats();
+  delete pick_bvh;
+  delete residency;
+  
   glfwDestroyWindow(window);
   
   glfwTerminate();
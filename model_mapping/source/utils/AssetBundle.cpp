@@ -0,0 +1,103 @@
+#include "AssetBundle.h"
+
+#include <string.h>
+
+bool AssetBundle::open(const char * path){
+  close();
+  if( !file.open(path) || file.size < sizeof(AssetBundleHeader) ){ close(); return false; }
+
+  const AssetBundleHeader *h = (const AssetBundleHeader *) file.data;
+  if( strncmp(h->magic, ASSET_BUNDLE_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != ASSET_BUNDLE_VERSION ||
+      h->assets_offset % 8 != 0 || h->assets_offset > file.size ||
+      h->num_assets > (file.size - h->assets_offset)/sizeof(AssetRecord) ){
+    close();
+    return false;
+  }
+
+  //Check every payload once so lookups can trust the table
+  const AssetRecord *r = (const AssetRecord *)(file.data + h->assets_offset);
+  for(uint32_t i=0; i < h->num_assets; i++){
+    uint64_t needed = r[i].size;
+    if( r[i].type == ASSET_TEXTURE || r[i].type == ASSET_CUBEMAP ){
+      if( r[i].width == 0 || r[i].height == 0 || r[i].levels == 0 ||
+          r[i].levels > assetMipLevels(r[i].width, r[i].height) ){
+        close();
+        return false;
+      }
+      needed = assetMipChainBytes(r[i].width, r[i].height, r[i].levels)*(r[i].type == ASSET_CUBEMAP ? 6 : 1);
+    }
+    if( r[i].offset > file.size || r[i].size > file.size - r[i].offset || r[i].size < needed ||
+        (i > 0 && strncmp(r[i-1].name, r[i].name, sizeof(r[i].name)) >= 0) ){
+      close();
+      return false;
+    }
+  }
+
+  header = h;
+  records = r;
+  return true;
+}
+
+void AssetBundle::close(){
+  file.close();
+  header = NULL;
+  records = NULL;
+}
+
+const AssetRecord *AssetBundle::find(const char * name, AssetType type) const{
+  size_t lo = 0, hi = size();
+  while( lo < hi ){
+    size_t mid = (lo + hi)/2;
+    int c = strncmp(records[mid].name, name, sizeof(records[mid].name));
+    if( c == 0 ){ return (records[mid].type == (uint32_t) type) ? &records[mid] : NULL; }
+    if( c < 0 ){ lo = mid+1; }else{ hi = mid; }
+  }
+  return NULL;
+}
+
+AssetSpan AssetBundle::span(const AssetRecord &asset) const{
+  return AssetSpan((const unsigned char *) file.data + asset.offset, (size_t) asset.size);
+}
+
+AssetSpan AssetBundle::level(const AssetRecord &asset, unsigned int face, unsigned int level,
+                             unsigned int &width, unsigned int &height) const{
+  width = height = 0;
+  if( level >= asset.levels || level >= 32 || face >= (asset.type == ASSET_CUBEMAP ? 6u : 1u) ){ return AssetSpan(); }
+  uint64_t offset = assetMipChainBytes(asset.width, asset.height, asset.levels)*face +
+                    assetMipChainBytes(asset.width, asset.height, level);
+  width  = (asset.width  >> level) ? (asset.width  >> level) : 1;
+  height = (asset.height >> level) ? (asset.height >> level) : 1;
+  return AssetSpan((const unsigned char *) file.data + asset.offset + offset, (size_t) width*height*4);
+}
+
+uint64_t assetMipChainBytes(unsigned int width, unsigned int height, unsigned int levels){
+  uint64_t bytes = 0;
+  for(unsigned int l=0; l < levels && l < 32; l++){
+    uint64_t w = (width >> l) ? (width >> l) : 1;
+    uint64_t h = (height >> l) ? (height >> l) : 1;
+    bytes += w*h*4;
+  }
+  return bytes;
+}
+
+unsigned int assetMipLevels(unsigned int width, unsigned int height){
+  //Shifts of 32 or more are undefined, and 32 levels reach 1 x 1 from any
+  //unsigned dimension
+  unsigned int levels = 1;
+  while( levels < 32 && ((width >> levels) || (height >> levels)) ){ levels++; }
+  return levels;
+}
+
+bool splitAssetPath(const std::string &path, std::string &file, std::string &name){
+  static const std::string extension(".bundle");
+  size_t hash = path.find(extension + "#");
+  if( hash == std::string::npos || hash + extension.size() + 1 == path.size() ){ return false; }
+  file = path.substr(0, hash + extension.size());
+  name = path.substr(hash + extension.size() + 1);
+  return true;
+}
+
+std::string assetPath(const std::string &file, const std::string &name){
+  return file + "#" + name;
+}
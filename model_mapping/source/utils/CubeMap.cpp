@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "SourcePath.h"
+#include "AssetBundle.h"
 
 
 void CubeMap::loadImages(std::vector < string > files){
@@ -39,6 +40,30 @@ void CubeMap::loadImages(std::vector < string > files){
   
 }
 
+bool CubeMap::loadBundle(const AssetBundle &bundle, const char * name){
+  const AssetRecord *asset = bundle.find(name, ASSET_CUBEMAP);
+  if( asset == NULL ){
+    std::cout << "Cubemap " << name << " is not in the asset bundle" << std::endl;
+    return false;
+  }
+
+  glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+  for(unsigned int face=0; face < 6; face++){
+    for(unsigned int l=0; l < asset->levels; l++){
+      unsigned int width, height;
+      AssetSpan pixels = bundle.level(*asset, face, l, width, height);
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, l, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data);
+    }
+  }
+  std::cout << asset->width << " X " << asset->height << " cubemap loaded from bundle\n";
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, asset->levels-1);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, asset->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  return true;
+}
 
 void CubeMap::glInit(){
   
@@ -12,6 +12,8 @@
 
 using namespace std;
 
+class AssetBundle;
+
 class CubeMap{
 public:
   
@@ -27,6 +29,9 @@ public:
   
   void loadImages(std::vector < string > files);
   
+  //Upload the six baked faces of name straight from the mapped bundle
+  bool loadBundle(const AssetBundle &bundle, const char * name);
+  
   void glInit();
     
   void draw(mat4 modelview, mat4 projection);
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- LodSelect.h ---
+//
+//  Run-time level of detail choice from the on-screen size of each level's
+//  object space error (MeshLOD::error, see Mesh::buildLODs).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LOD_SELECT_H__
+#define __LOD_SELECT_H__
+
+#include "common.h"
+
+/**
+  Pixels covered by one object space unit at the point of the bounding box
+    closest to the eye (a conservative bound for the whole box).
+  @param model_view object to eye transform, uniform scale assumed
+  @param projection_scale Projection[1][1], the cotangent of half the
+    vertical field of view
+  @param viewport_height in pixels
+**/
+inline float pixelsPerUnit(const vec3 &box_min, const vec3 &box_max, const mat4 &model_view,
+                           float projection_scale, float viewport_height){
+  vec4 center = model_view * vec4((box_min + box_max)*0.5f, 1.0f);
+  float scale = length(vec3(model_view[0][0], model_view[1][0], model_view[2][0]));
+  float radius = length(box_max - box_min)*0.5f*scale;
+
+  //Inside the bounds or behind the eye: everything is at full detail
+  float distance = -center.z - radius;
+  if( distance <= 1e-4f ){ return (std::numeric_limits< float >::max)(); }
+  return scale*projection_scale*0.5f*viewport_height/distance;
+}
+
+/**
+  Coarsest level whose projected error stays under max_pixels.  A switch
+    to a coarser level than current also needs the level to be under
+    hysteresis*max_pixels, so zooming around the threshold does not make
+    levels flicker back and forth.
+**/
+inline unsigned int selectLOD(const std::vector< MeshLOD > &lods, float pixels_per_unit, float max_pixels,
+                              unsigned int current, float hysteresis=0.75f){
+  if( lods.empty() ){ return 0; }
+  if( current >= lods.size() ){ current = (unsigned int) lods.size()-1; }
+
+  unsigned int best = 0;
+  for(unsigned int l=0; l < lods.size(); l++){
+    if( lods[l].error*pixels_per_unit <= max_pixels ){ best = l; }
+  }
+  if( best <= current ){ return best; }
+
+  unsigned int coarser = current;
+  for(unsigned int l=current+1; l <= best; l++){
+    if( lods[l].error*pixels_per_unit <= hysteresis*max_pixels ){ coarser = l; }
+  }
+  return coarser;
+}
+
+#endif //__LOD_SELECT_H__
@@ -0,0 +1,200 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include "u8names.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif //_WIN32
+
+
+MappedFile::MappedFile()
+  : data(NULL),
+    size(0),
+    opened(false),
+    writable_map(false)
+#ifdef _WIN32
+  , file(NULL),
+    mapping(NULL)
+#else
+  , fd(-1)
+#endif //_WIN32
+{}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char * path){
+  close();
+
+  std::wstring wcfn;
+  if ( u8names_towc(path, wcfn) != 0 ){ return false; }
+
+  HANDLE f = CreateFileW(wcfn.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if( f == INVALID_HANDLE_VALUE ){ return false; }
+
+  LARGE_INTEGER li;
+  if( !GetFileSizeEx(f, &li) ){
+    CloseHandle(f);
+    return false;
+  }
+  file = f;
+  size = (size_t)li.QuadPart;
+  opened = true;
+
+  //Zero-length files can not be mapped, leave data NULL
+  if( size == 0 ){ return true; }
+
+  HANDLE m = CreateFileMapping(f, NULL, PAGE_READONLY, 0, 0, NULL);
+  if( m == NULL ){
+    close();
+    return false;
+  }
+  mapping = m;
+
+  data = (const char *) MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+  if( data == NULL ){
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool MappedFile::create(const char * path, size_t bytes){
+  close();
+
+  std::wstring wcfn;
+  if ( u8names_towc(path, wcfn) != 0 ){ return false; }
+
+  HANDLE f = CreateFileW(wcfn.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if( f == INVALID_HANDLE_VALUE ){ return false; }
+  file = f;
+  size = bytes;
+  opened = true;
+  writable_map = true;
+  if( size == 0 ){ return true; }
+
+  LARGE_INTEGER li;
+  li.QuadPart = (LONGLONG) bytes;
+  if( !SetFilePointerEx(f, li, NULL, FILE_BEGIN) || !SetEndOfFile(f) ){
+    close();
+    return false;
+  }
+  HANDLE m = CreateFileMapping(f, NULL, PAGE_READWRITE, 0, 0, NULL);
+  if( m == NULL ){
+    close();
+    return false;
+  }
+  mapping = m;
+
+  data = (const char *) MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, 0);
+  if( data == NULL ){
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::release(size_t offset, size_t bytes){
+  if( data == NULL || offset >= size ){ return; }
+  bytes = (std::min)(bytes, size - offset);
+  //Unlocking pages that were never locked takes them out of the working set
+  VirtualUnlock((LPVOID)(data + offset), bytes);
+}
+
+void MappedFile::close(){
+  if( data ){ UnmapViewOfFile(data); }
+  if( mapping ){ CloseHandle((HANDLE) mapping); }
+  if( file ){ CloseHandle((HANDLE) file); }
+  data = NULL;
+  mapping = NULL;
+  file = NULL;
+  size = 0;
+  opened = false;
+  writable_map = false;
+}
+
+#else
+
+bool MappedFile::open(const char * path){
+  close();
+
+  fd = ::open(path, O_RDONLY);
+  if( fd < 0 ){ return false; }
+
+  struct stat st;
+  if( fstat(fd, &st) != 0 ){
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  size = (size_t) st.st_size;
+  opened = true;
+
+  //Zero-length files can not be mapped, leave data NULL
+  if( size == 0 ){ return true; }
+
+  void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if( p == MAP_FAILED ){
+    close();
+    return false;
+  }
+  //The loaders read front to back exactly once
+  madvise(p, size, MADV_SEQUENTIAL);
+  data = (const char *) p;
+  return true;
+}
+
+bool MappedFile::create(const char * path, size_t bytes){
+  close();
+
+  fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if( fd < 0 ){ return false; }
+  size = bytes;
+  opened = true;
+  writable_map = true;
+  if( size == 0 ){ return true; }
+
+  if( ftruncate(fd, (off_t) bytes) != 0 ){
+    close();
+    return false;
+  }
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if( p == MAP_FAILED ){
+    close();
+    return false;
+  }
+  data = (const char *) p;
+  return true;
+}
+
+void MappedFile::release(size_t offset, size_t bytes){
+  if( data == NULL || offset >= size ){ return; }
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t begin = offset - offset%page;
+  size_t end = (bytes >= size - offset) ? size : offset + bytes;
+  //Dirty shared pages keep their changes in the page cache and the file;
+  //clean ones are simply read again
+  madvise((void *)(data + begin), end - begin, MADV_DONTNEED);
+}
+
+void MappedFile::close(){
+  if( data ){ munmap((void *) data, size); }
+  if( fd >= 0 ){ ::close(fd); }
+  data = NULL;
+  fd = -1;
+  size = 0;
+  opened = false;
+  writable_map = false;
+}
+
+#endif //_WIN32
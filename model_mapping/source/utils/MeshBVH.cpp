@@ -0,0 +1,343 @@
+#include "common.h"
+#include "MeshBVH.h"
+
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+//Centroid bins per axis for the surface area heuristic
+static const int SAH_BINS = 16;
+//Leaves never hold more triangles than this unless they can not be split
+static const unsigned int MAX_LEAF_TRIANGLES = 8;
+//Cost of visiting a node relative to one triangle test
+static const float TRAVERSAL_COST = 1.0f;
+//Traversal stack entries, far deeper than any binned SAH tree gets
+static const int MAX_DEPTH = 128;
+
+struct BuildBox{
+  vec3 lo, hi;
+
+  BuildBox() : lo( (std::numeric_limits< float >::max)()), hi(-(std::numeric_limits< float >::max)()) {}
+  void grow(const vec3 &p){
+    for(int k=0; k < 3; k++){
+      lo[k] = (std::min)(lo[k], p[k]);
+      hi[k] = (std::max)(hi[k], p[k]);
+    }
+  }
+  void grow(const BuildBox &b){ grow(b.lo); grow(b.hi); }
+  float area() const {
+    if( lo.x > hi.x ){ return 0; }
+    vec3 d = hi - lo;
+    return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+  }
+};
+
+//Per triangle bounds shared by all builders; order is permuted in place
+struct BuildInput{
+  std::vector< BuildBox > boxes;
+  std::vector< vec3 > centroids;
+  std::vector< unsigned int > order;
+};
+
+//A subtree left for a worker: its root is nodes[slot] of the top tree
+struct BuildTask{
+  unsigned int slot;
+  unsigned int begin, end;
+};
+
+class BVHBuilder{
+public:
+  std::vector< MeshBVH::Node > nodes;
+
+  //Ranges at most defer_size long become tasks instead of being split here
+  BVHBuilder(BuildInput &input, size_t defer_size, std::vector< BuildTask > *tasks)
+    : input(input), defer_size(defer_size), tasks(tasks) {}
+
+  void build(unsigned int begin, unsigned int end){
+    nodes.push_back(MeshBVH::Node());
+    split(0, begin, end);
+  }
+
+private:
+  BuildInput &input;
+  size_t defer_size;
+  std::vector< BuildTask > *tasks;
+
+  void makeLeaf(unsigned int node, unsigned int begin, unsigned int end){
+    nodes[node].first = begin;
+    nodes[node].count = end - begin;
+  }
+
+  void split(unsigned int node, unsigned int begin, unsigned int end){
+    BuildBox bounds, centroid_bounds;
+    for(unsigned int i=begin; i < end; i++){
+      bounds.grow(input.boxes[input.order[i]]);
+      centroid_bounds.grow(input.centroids[input.order[i]]);
+    }
+    nodes[node].box_min = bounds.lo;
+    nodes[node].box_max = bounds.hi;
+    unsigned int count = end - begin;
+
+    if( tasks && count <= defer_size ){
+      BuildTask task = { node, begin, end };
+      tasks->push_back(task);
+      return;
+    }
+    if( count <= 2 ){ makeLeaf(node, begin, end); return; }
+
+    //Binned SAH over the centroids on every axis
+    int best_axis = -1;
+    int best_bin = 0;
+    float best_cost = (std::numeric_limits< float >::max)();
+    for(int axis=0; axis < 3; axis++){
+      float lo = centroid_bounds.lo[axis];
+      float extent = centroid_bounds.hi[axis] - lo;
+      if( extent <= 0 ){ continue; }
+      float to_bin = SAH_BINS/extent;
+
+      BuildBox bins[SAH_BINS];
+      unsigned int counts[SAH_BINS] = {0};
+      for(unsigned int i=begin; i < end; i++){
+        unsigned int t = input.order[i];
+        int b = (std::min)(SAH_BINS-1, (int)((input.centroids[t][axis] - lo)*to_bin));
+        bins[b].grow(input.boxes[t]);
+        counts[b]++;
+      }
+
+      //Sweep from the right, then evaluate every plane from the left
+      float right_area[SAH_BINS];
+      unsigned int right_count[SAH_BINS];
+      BuildBox right;
+      unsigned int n = 0;
+      for(int b=SAH_BINS-1; b > 0; b--){
+        right.grow(bins[b]);
+        n += counts[b];
+        right_area[b] = right.area();
+        right_count[b] = n;
+      }
+      BuildBox left;
+      n = 0;
+      for(int b=0; b < SAH_BINS-1; b++){
+        left.grow(bins[b]);
+        n += counts[b];
+        if( n == 0 || right_count[b+1] == 0 ){ continue; }
+        float cost = left.area()*n + right_area[b+1]*right_count[b+1];
+        if( cost < best_cost ){
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+
+    float leaf_cost = bounds.area()*count;
+    float split_cost = bounds.area()*TRAVERSAL_COST + best_cost;
+    if( best_axis < 0 || (count <= MAX_LEAF_TRIANGLES && split_cost >= leaf_cost) ){
+      //Identical centroids can not be binned; halve large piles anyway
+      if( best_axis >= 0 || count <= MAX_LEAF_TRIANGLES ){ makeLeaf(node, begin, end); return; }
+      splitChildren(node, begin, begin + count/2, end);
+      return;
+    }
+
+    float lo = centroid_bounds.lo[best_axis];
+    float to_bin = SAH_BINS/(centroid_bounds.hi[best_axis] - lo);
+    unsigned int *first = &input.order[0] + begin;
+    unsigned int *last = &input.order[0] + end;
+    unsigned int *middle = std::partition(first, last, [&](unsigned int t){
+      return (std::min)(SAH_BINS-1, (int)((input.centroids[t][best_axis] - lo)*to_bin)) <= best_bin;
+    });
+    splitChildren(node, begin, (unsigned int)(middle - &input.order[0]), end);
+  }
+
+  void splitChildren(unsigned int node, unsigned int begin, unsigned int middle, unsigned int end){
+    unsigned int left = (unsigned int) nodes.size();
+    nodes[node].first = left;
+    nodes[node].count = 0;
+    nodes.push_back(MeshBVH::Node());
+    nodes.push_back(MeshBVH::Node());
+    split(left, begin, middle);
+    split(left+1, middle, end);
+  }
+};
+
+MeshBVH::MeshBVH(const std::vector< vec4 > &vertices, const std::vector< unsigned int > &indices, unsigned int threads){
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned int workers = threads ? threads : Parallel::workerCount();
+  size_t num_triangles = indices.size()/3;
+  if( num_triangles == 0 ){ return; }
+
+  BuildInput input;
+  input.boxes.resize(num_triangles);
+  input.centroids.resize(num_triangles);
+  input.order.resize(num_triangles);
+  Parallel::forRange(num_triangles, [&](size_t b, size_t e, unsigned int){
+    for(size_t t=b; t < e; t++){
+      BuildBox box;
+      for(int k=0; k < 3; k++){
+        const vec4 &p = vertices[indices[3*t+k]];
+        box.grow(vec3(p.x, p.y, p.z));
+      }
+      input.boxes[t] = box;
+      input.centroids[t] = (box.lo + box.hi)*0.5f;
+      input.order[t] = (unsigned int) t;
+    }
+  }, 1 << 16, workers);
+
+  //Top levels here, then one subtree per task on the workers
+  std::vector< BuildTask > tasks;
+  size_t defer_size = (std::max)((size_t) 4096, num_triangles/(4*workers));
+  BVHBuilder top(input, defer_size, &tasks);
+  top.build(0, (unsigned int) num_triangles);
+
+  std::vector< std::vector< Node > > subtrees(tasks.size());
+  Parallel::forRange(tasks.size(), [&](size_t b, size_t e, unsigned int){
+    for(size_t i=b; i < e; i++){
+      BVHBuilder builder(input, 0, NULL);
+      builder.build(tasks[i].begin, tasks[i].end);
+      subtrees[i].swap(builder.nodes);
+    }
+  }, 1, workers);
+
+  //Subtree roots replace their slots, the rest is appended with shifted links
+  nodes.swap(top.nodes);
+  for(size_t i=0; i < tasks.size(); i++){
+    const std::vector< Node > &sub = subtrees[i];
+    unsigned int shift = (unsigned int) nodes.size() - 1;
+    for(size_t n=0; n < sub.size(); n++){
+      Node node = sub[n];
+      if( node.count == 0 ){ node.first += shift; }
+      if( n == 0 ){ nodes[tasks[i].slot] = node; }
+      else{ nodes.push_back(node); }
+    }
+  }
+
+  triangles.resize(num_triangles);
+  triangle_ids.swap(input.order);
+  for(size_t i=0; i < num_triangles; i++){
+    const unsigned int *t = &indices[3*triangle_ids[i]];
+    vec3 a(vertices[t[0]].x, vertices[t[0]].y, vertices[t[0]].z);
+    vec3 b(vertices[t[1]].x, vertices[t[1]].y, vertices[t[1]].z);
+    vec3 c(vertices[t[2]].x, vertices[t[2]].y, vertices[t[2]].z);
+    triangles[i].v0 = a;
+    triangles[i].e1 = b - a;
+    triangles[i].e2 = c - a;
+  }
+
+  printf("Mesh BVH: %u triangles, %u nodes in %.1f ms\n", (unsigned int) num_triangles, (unsigned int) nodes.size(),
+         std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count());
+}
+
+#ifdef MESH_BVH_SSE
+//Entry distance of the ray into the box, FLT_MAX on a miss or beyond t_max
+static inline float boxDistance(const MeshBVH::Node &n, __m128 origin, __m128 inverse, float t_max){
+  __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&n.box_min.x), origin), inverse);
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&n.box_max.x), origin), inverse);
+  __m128 near4 = _mm_min_ps(t0, t1);
+  __m128 far4 = _mm_max_ps(t0, t1);
+  //Lane 3 holds the node's first/count bits and is left out
+  __m128 t_near = _mm_max_ss(_mm_max_ss(near4, _mm_shuffle_ps(near4, near4, 1)), _mm_shuffle_ps(near4, near4, 2));
+  __m128 t_far = _mm_min_ss(_mm_min_ss(far4, _mm_shuffle_ps(far4, far4, 1)), _mm_shuffle_ps(far4, far4, 2));
+  float enter = _mm_cvtss_f32(t_near);
+  float leave = _mm_cvtss_f32(t_far);
+  if( leave < enter || leave < 0 || enter >= t_max ){ return (std::numeric_limits< float >::max)(); }
+  return enter;
+}
+#else
+static inline float boxDistance(const MeshBVH::Node &n, const vec3 &origin, const vec3 &inverse, float t_max){
+  float enter = -(std::numeric_limits< float >::max)();
+  float leave = (std::numeric_limits< float >::max)();
+  for(int k=0; k < 3; k++){
+    float t0 = (n.box_min[k] - origin[k])*inverse[k];
+    float t1 = (n.box_max[k] - origin[k])*inverse[k];
+    enter = (std::max)(enter, (std::min)(t0, t1));
+    leave = (std::min)(leave, (std::max)(t0, t1));
+  }
+  if( leave < enter || leave < 0 || enter >= t_max ){ return (std::numeric_limits< float >::max)(); }
+  return enter;
+}
+#endif //MESH_BVH_SSE
+
+bool MeshBVH::intersect(const vec3 &origin, const vec3 &direction, RayHit &hit) const{
+  hit.t = (std::numeric_limits< float >::max)();
+  if( nodes.empty() ){ return false; }
+
+  //Zero components would turn the slabs into 0*inf
+  vec3 inverse;
+  for(int k=0; k < 3; k++){
+    float d = direction[k];
+    if( fabs(d) < 1e-20f ){ d = (d < 0) ? -1e-20f : 1e-20f; }
+    inverse[k] = 1.0f/d;
+  }
+#ifdef MESH_BVH_SSE
+  __m128 o = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+  __m128 inv = _mm_set_ps(0.0f, inverse.z, inverse.y, inverse.x);
+#else
+  const vec3 &o = origin;
+  const vec3 &inv = inverse;
+#endif //MESH_BVH_SSE
+
+  const float MISS = (std::numeric_limits< float >::max)();
+  if( boxDistance(nodes[0], o, inv, hit.t) == MISS ){ return false; }
+
+  struct Pending{ const Node *node; float distance; };
+  Pending stack[MAX_DEPTH];
+  int top = 0;
+  const Node *node = &nodes[0];
+  bool found = false;
+
+  while( true ){
+    if( node->count ){
+      for(unsigned int i=node->first; i < node->first + node->count; i++){
+        //Moller-Trumbore
+        const Triangle &tri = triangles[i];
+        vec3 p = cross(direction, tri.e2);
+        float det = dot(tri.e1, p);
+        if( fabs(det) < 1e-30f ){ continue; }
+        float inv_det = 1.0f/det;
+        vec3 s = origin - tri.v0;
+        float u = dot(s, p)*inv_det;
+        if( u < 0 || u > 1 ){ continue; }
+        vec3 q = cross(s, tri.e1);
+        float v = dot(direction, q)*inv_det;
+        if( v < 0 || u + v > 1 ){ continue; }
+        float t = dot(tri.e2, q)*inv_det;
+        if( t > 0 && t < hit.t ){
+          hit.t = t;
+          hit.u = u;
+          hit.v = v;
+          hit.triangle = triangle_ids[i];
+          found = true;
+        }
+      }
+    }else{
+      const Node *near_child = &nodes[node->first];
+      const Node *far_child = &nodes[node->first + 1];
+      float near_distance = boxDistance(*near_child, o, inv, hit.t);
+      float far_distance = boxDistance(*far_child, o, inv, hit.t);
+      if( far_distance < near_distance ){
+        std::swap(near_child, far_child);
+        std::swap(near_distance, far_distance);
+      }
+      if( near_distance != MISS ){
+        if( far_distance != MISS && top < MAX_DEPTH ){
+          Pending p = { far_child, far_distance };
+          stack[top++] = p;
+        }
+        node = near_child;
+        continue;
+      }
+    }
+
+    //Next pending node that can still be closer than the current hit
+    node = NULL;
+    while( top > 0 ){
+      Pending p = stack[--top];
+      if( p.distance < hit.t ){ node = p.node; break; }
+    }
+    if( node == NULL ){ break; }
+  }
+  return found;
+}
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshBVH.h ---
+//
+//  Bounding volume hierarchy over the triangles of an indexed mesh, for ray
+//  queries such as mouse picking.  Built top down with a binned surface
+//  area heuristic: the top levels are split on the calling thread, the
+//  subtrees below them are built in parallel.  Traversal tests node boxes
+//  with SSE when the compiler targets it, scalar slabs otherwise.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_BVH_H__
+#define __MESH_BVH_H__
+
+#include "common.h"
+
+struct RayHit{
+  float t;                    //origin + t*direction is the hit point
+  unsigned int triangle;      //triangle number in the index list (index/3)
+  float u, v;                 //barycentric weights of the second and third corner
+};
+
+class MeshBVH{
+public:
+  //Leaves have count > 0 and own triangles [first, first+count) in leaf
+  //order; interior nodes have their children at first and first+1
+  struct Node{
+    vec3 box_min;
+    unsigned int first;
+    vec3 box_max;
+    unsigned int count;
+  };
+
+  /**
+    Build over the triangle list indices into vertices.
+    @param threads workers for the subtree builds, 0 for all cores
+  **/
+  MeshBVH(const std::vector< vec4 > &vertices, const std::vector< unsigned int > &indices, unsigned int threads=0);
+
+  /**
+    Closest intersection along origin + t*direction, t > 0, with either
+      side of a triangle.
+    @return false if the ray misses every triangle
+  **/
+  bool intersect(const vec3 &origin, const vec3 &direction, RayHit &hit) const;
+
+  size_t nodeCount() const { return nodes.size(); }
+  size_t triangleCount() const { return triangle_ids.size(); }
+
+private:
+  struct Triangle{ vec3 v0, e1, e2; };
+
+  std::vector< Node > nodes;
+  std::vector< Triangle > triangles;          //leaf order
+  std::vector< unsigned int > triangle_ids;   //leaf order -> triangle number
+};
+
+#endif //__MESH_BVH_H__
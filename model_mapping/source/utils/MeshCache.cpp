@@ -0,0 +1,278 @@
+#include "common.h"
+#include "MeshCache.h"
+#include "AssetBundle.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+std::string meshCachePath(const char * obj_path){
+  std::string p(obj_path);
+  size_t slash = p.find_last_of("/\\");
+  size_t dot = p.find_last_of('.');
+  if( dot != std::string::npos && (slash == std::string::npos || dot > slash) ){
+    p.erase(dot);
+  }
+  return p + ".meshbin";
+}
+
+static int64_t fileModifiedTime(const char * path){
+#ifdef _WIN32
+  std::wstring wcfn;
+  if ( u8names_towc(path, wcfn) != 0 ){ return -1; }
+  struct _stat64 st;
+  if( _wstat64(wcfn.c_str(), &st) != 0 ){ return -1; }
+#else
+  struct stat st;
+  if( stat(path, &st) != 0 ){ return -1; }
+#endif //_WIN32
+  return (int64_t) st.st_mtime;
+}
+
+//64-bit multiply/xorshift mix over 8 byte words (tail bytes folded in last)
+static uint64_t hashBytes(uint64_t h, const char *data, size_t n){
+  const uint64_t k = 0x9E3779B97F4A7C15ull;
+  size_t i = 0;
+  for(; i+8 <= n; i+=8){
+    uint64_t w;
+    memcpy(&w, data+i, 8);
+    h = (h ^ w) * k;
+    h ^= h >> 29;
+  }
+  for(; i < n; i++){
+    h = (h ^ (unsigned char) data[i]) * k;
+  }
+  return h ^ (h >> 32);
+}
+
+bool meshSourceFingerprint(const char * obj_path, uint64_t &size, int64_t &mtime, uint64_t &hash){
+  const size_t EDGE = 64*1024;
+  const size_t BLOCK = 4*1024;
+  const size_t SAMPLES = 64;
+
+  MappedFile file;
+  if( !file.open(obj_path) ){ return false; }
+  mtime = fileModifiedTime(obj_path);
+  size = file.size;
+  hash = hashBytes(0xCBF29CE484222325ull ^ size, NULL, 0);
+  if( file.size == 0 ){ return true; }
+
+  if( file.size <= 2*EDGE + SAMPLES*BLOCK ){
+    hash = hashBytes(hash, file.data, file.size);
+    return true;
+  }
+  hash = hashBytes(hash, file.data, EDGE);
+  for(size_t s=0; s < SAMPLES; s++){
+    size_t at = EDGE + (file.size - 2*EDGE - BLOCK)*s/SAMPLES;
+    hash = hashBytes(hash, file.data + at, BLOCK);
+  }
+  hash = hashBytes(hash, file.data + file.size - EDGE, EDGE);
+  return true;
+}
+
+static size_t alignOffset(size_t offset){ return (offset + 15) & ~(size_t)15; }
+
+//Zero pad from written up to offset, then write bytes
+static bool writeAt(FILE *file, size_t &written, size_t offset, const void *data, size_t bytes){
+  static const char zeros[16] = {0};
+  if( offset < written || offset - written > sizeof(zeros) ){ return false; }
+  if( fwrite(zeros, 1, offset - written, file) != offset - written ){ return false; }
+  if( bytes && fwrite(data, 1, bytes, file) != bytes ){ return false; }
+  written = offset + bytes;
+  return true;
+}
+
+bool Mesh::loadCache(const char * obj_path){
+  uint64_t size, hash;
+  int64_t mtime;
+  if( !meshSourceFingerprint(obj_path, size, mtime, hash) ){ return false; }
+
+  MappedFile file;
+  if( !file.open(meshCachePath(obj_path).c_str()) ){ return false; }
+  if( file.size < sizeof(MeshCacheHeader) ){ return false; }
+
+  MeshCacheHeader header;
+  memcpy(&header, file.data, sizeof(header));
+  if( header.source_size != size || header.source_mtime != mtime || header.source_hash != hash ){
+    return false;
+  }
+  return readCache(file.data, file.size);
+}
+
+//Index range [first, first+count) lies within one of the two index streams,
+//indices or lod_indices, which are addressed one after the other
+static bool withinOneStream(uint64_t first, uint64_t count, const MeshCacheHeader &header){
+  if( first < header.num_indices ){ return first + count <= header.num_indices; }
+  return first + count <= header.num_indices + header.num_lod_indices;
+}
+
+//Attribute counts that match the vertices, indices below num_vertices,
+//and LOD and meshlet ranges within one index stream and the meshlets.
+//Caches from a bundle have no source fingerprint, so this is all that
+//stands between a corrupt file and the draw calls
+static bool validIndices(const char * data, const MeshCacheHeader &header){
+  bool has_uv = (header.flags & MESH_CACHE_HAS_UV) != 0;
+  if( header.num_vertices > 0xFFFFFFFFull ||
+      header.num_normals != header.num_vertices ||
+      header.num_uvs != (has_uv ? header.num_vertices : 0) ||
+      (header.num_tangents != 0 && header.num_tangents != header.num_vertices) ){
+    return false;
+  }
+  uint64_t total = header.num_indices + header.num_lod_indices;
+  const unsigned int *f = (const unsigned int *)(data + header.indices_offset);
+  const unsigned int *lf = (const unsigned int *)(data + header.lod_indices_offset);
+  unsigned int largest = 0;
+  for(uint64_t i=0; i < header.num_indices; i++){ largest = (std::max)(largest, f[i]); }
+  for(uint64_t i=0; i < header.num_lod_indices; i++){ largest = (std::max)(largest, lf[i]); }
+  if( total > 0 && largest >= header.num_vertices ){ return false; }
+
+  const MeshLOD *l = (const MeshLOD *)(data + header.lods_offset);
+  for(uint64_t i=0; i < header.num_lods; i++){
+    if( !withinOneStream(l[i].first_index, l[i].index_count, header) ||
+        (uint64_t) l[i].first_meshlet + l[i].meshlet_count > header.num_meshlets ){
+      return false;
+    }
+  }
+  const Meshlet *c = (const Meshlet *)(data + header.meshlets_offset);
+  for(uint64_t i=0; i < header.num_meshlets; i++){
+    if( !withinOneStream(c[i].first_index, c[i].index_count, header) ){ return false; }
+  }
+  return true;
+}
+
+bool Mesh::readCache(const char * data, size_t size){
+  if( size < sizeof(MeshCacheHeader) ){ return false; }
+
+  MeshCacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if( strncmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != MESH_CACHE_VERSION ){
+    return false;
+  }
+  if( !meshStreamFits(header.vertices_offset, header.num_vertices, sizeof(vec4), size) ||
+      !meshStreamFits(header.normals_offset,  header.num_normals,  sizeof(vec3), size) ||
+      !meshStreamFits(header.uvs_offset,      header.num_uvs,      sizeof(vec2), size) ||
+      !meshStreamFits(header.tangents_offset, header.num_tangents, sizeof(vec4), size) ||
+      !meshStreamFits(header.indices_offset,  header.num_indices,  sizeof(unsigned int), size) ||
+      !meshStreamFits(header.lod_indices_offset, header.num_lod_indices, sizeof(unsigned int), size) ||
+      !meshStreamFits(header.lods_offset,     header.num_lods,     sizeof(MeshLOD), size) ||
+      !meshStreamFits(header.meshlets_offset, header.num_meshlets, sizeof(Meshlet), size) ){
+    return false;
+  }
+  if( !validIndices(data, header) ){ return false; }
+
+  //One straight copy per stream out of the page cache
+  const vec4 *v = (const vec4 *)(data + header.vertices_offset);
+  const vec3 *n = (const vec3 *)(data + header.normals_offset);
+  const vec2 *t = (const vec2 *)(data + header.uvs_offset);
+  const vec4 *tf = (const vec4 *)(data + header.tangents_offset);
+  const unsigned int *f = (const unsigned int *)(data + header.indices_offset);
+  const unsigned int *lf = (const unsigned int *)(data + header.lod_indices_offset);
+  const MeshLOD *l = (const MeshLOD *)(data + header.lods_offset);
+  const Meshlet *c = (const Meshlet *)(data + header.meshlets_offset);
+  vertices.assign(v, v + header.num_vertices);
+  normals.assign(n, n + header.num_normals);
+  uvs.assign(t, t + header.num_uvs);
+  tangents.assign(tf, tf + header.num_tangents);
+  indices.assign(f, f + header.num_indices);
+  lod_indices.assign(lf, lf + header.num_lod_indices);
+  lods.assign(l, l + header.num_lods);
+  meshlets.assign(c, c + header.num_meshlets);
+
+  hasUV     = (header.flags & MESH_CACHE_HAS_UV) != 0;
+  optimized = (header.flags & MESH_CACHE_OPTIMIZED) != 0;
+  box_min = vec3(header.box_min[0], header.box_min[1], header.box_min[2]);
+  box_max = vec3(header.box_max[0], header.box_max[1], header.box_max[2]);
+  center  = vec3(header.center[0], header.center[1], header.center[2]);
+  scale   = header.scale;
+  updateModelView();
+
+  return true;
+}
+
+bool Mesh::writeCache(FILE * file, uint64_t source_size, int64_t source_mtime, uint64_t source_hash) const{
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  header.flags = (hasUV ? MESH_CACHE_HAS_UV : 0) | (optimized ? MESH_CACHE_OPTIMIZED : 0);
+  header.source_size  = source_size;
+  header.source_mtime = source_mtime;
+  header.source_hash  = source_hash;
+
+  header.num_vertices = vertices.size();
+  header.num_normals  = normals.size();
+  header.num_uvs      = uvs.size();
+  header.num_tangents = tangents.size();
+  header.num_indices  = indices.size();
+  header.num_lod_indices = lod_indices.size();
+  header.num_lods     = lods.size();
+  header.num_meshlets = meshlets.size();
+  header.vertices_offset = alignOffset(sizeof(header));
+  header.normals_offset  = alignOffset(header.vertices_offset + vertices.size()*sizeof(vec4));
+  header.uvs_offset      = alignOffset(header.normals_offset + normals.size()*sizeof(vec3));
+  header.tangents_offset = alignOffset(header.uvs_offset + uvs.size()*sizeof(vec2));
+  header.indices_offset  = alignOffset(header.tangents_offset + tangents.size()*sizeof(vec4));
+  header.lod_indices_offset = alignOffset(header.indices_offset + indices.size()*sizeof(unsigned int));
+  header.lods_offset     = alignOffset(header.lod_indices_offset + lod_indices.size()*sizeof(unsigned int));
+  header.meshlets_offset = alignOffset(header.lods_offset + lods.size()*sizeof(MeshLOD));
+
+  for(int i=0; i < 3; i++){
+    header.box_min[i] = box_min[i];
+    header.box_max[i] = box_max[i];
+    header.center[i]  = center[i];
+  }
+  header.scale = scale;
+
+  //Offsets are relative to where the header goes
+  size_t written = 0;
+  bool ok = writeAt(file, written, 0, &header, sizeof(header));
+  ok = ok && writeAt(file, written, header.vertices_offset, vertices.empty() ? NULL : &vertices[0], vertices.size()*sizeof(vec4));
+  ok = ok && writeAt(file, written, header.normals_offset,  normals.empty()  ? NULL : &normals[0],  normals.size()*sizeof(vec3));
+  ok = ok && writeAt(file, written, header.uvs_offset,      uvs.empty()      ? NULL : &uvs[0],      uvs.size()*sizeof(vec2));
+  ok = ok && writeAt(file, written, header.tangents_offset, tangents.empty() ? NULL : &tangents[0], tangents.size()*sizeof(vec4));
+  ok = ok && writeAt(file, written, header.indices_offset,  indices.empty()  ? NULL : &indices[0],  indices.size()*sizeof(unsigned int));
+  ok = ok && writeAt(file, written, header.lod_indices_offset, lod_indices.empty() ? NULL : &lod_indices[0], lod_indices.size()*sizeof(unsigned int));
+  ok = ok && writeAt(file, written, header.lods_offset,     lods.empty()     ? NULL : &lods[0],     lods.size()*sizeof(MeshLOD));
+  ok = ok && writeAt(file, written, header.meshlets_offset, meshlets.empty() ? NULL : &meshlets[0], meshlets.size()*sizeof(Meshlet));
+  return ok;
+}
+
+bool Mesh::saveCache(const char * obj_path) const{
+  uint64_t size, hash;
+  int64_t mtime;
+  if( !meshSourceFingerprint(obj_path, size, mtime, hash) ){ return false; }
+
+  //Write to a temporary name and rename so a crash never leaves a
+  //truncated cache that matches the OBJ
+  std::string path = meshCachePath(obj_path);
+  std::string tmp = path + ".tmp";
+#ifdef _WIN32
+  std::wstring wtmp, wpath;
+  if ( u8names_towc(tmp.c_str(), wtmp) != 0 || u8names_towc(path.c_str(), wpath) != 0 ){ return false; }
+  FILE * file = _wfopen(wtmp.c_str(), L"wb");
+#else
+  FILE * file = fopen(tmp.c_str(), "wb");
+#endif //_WIN32
+  if( file == NULL ){ return false; }
+
+  bool ok = writeCache(file, size, mtime, hash);
+  ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+  if( ok ){ _wremove(wpath.c_str()); ok = _wrename(wtmp.c_str(), wpath.c_str()) == 0; }
+  if( !ok ){ _wremove(wtmp.c_str()); }
+#else
+  if( ok ){ ok = rename(tmp.c_str(), path.c_str()) == 0; }
+  if( !ok ){ remove(tmp.c_str()); }
+#endif //_WIN32
+  return ok;
+}
+
+bool Mesh::loadAsset(const char * bundle_path, const char * name){
+  AssetBundle bundle;
+  if( !bundle.open(bundle_path) ){ return false; }
+  const AssetRecord *asset = bundle.find(name, ASSET_MESH);
+  if( asset == NULL ){ return false; }
+  AssetSpan span = bundle.span(*asset);
+  return readCache((const char *) span.data, span.size);
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshCache.h ---
+//
+//  On-disk layout of the binary mesh cache (.meshbin) written next to each
+//  OBJ file after its first parse.  The file is the header below followed
+//  by the raw attribute arrays, each starting at a 16 byte aligned offset.
+//  Everything is stored in native (little endian) byte order.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+
+#define MESH_CACHE_MAGIC   "MESHBIN"
+#define MESH_CACHE_VERSION 5
+
+enum{ MESH_CACHE_HAS_UV = 1, MESH_CACHE_OPTIMIZED = 2 };
+
+struct MeshCacheHeader{
+  char     magic[8];          //MESH_CACHE_MAGIC, null padded
+  uint32_t version;           //MESH_CACHE_VERSION
+  uint32_t flags;             //MESH_CACHE_* bits
+
+  //Identity of the OBJ this cache was built from
+  uint64_t source_size;
+  int64_t  source_mtime;
+  uint64_t source_hash;
+
+  uint64_t num_vertices;      //vec4 positions
+  uint64_t num_normals;       //vec3 normals
+  uint64_t num_uvs;           //vec2 texture coordinates
+  uint64_t num_tangents;      //vec4 tangent frames, 0 unless built
+  uint64_t num_indices;       //unsigned int triangle list
+  uint64_t num_lod_indices;   //unsigned int, levels after the first
+  uint64_t num_lods;          //MeshLOD records
+  uint64_t num_meshlets;      //Meshlet records
+
+  uint64_t vertices_offset;   //byte offsets from the start of the file
+  uint64_t normals_offset;
+  uint64_t uvs_offset;
+  uint64_t tangents_offset;
+  uint64_t indices_offset;
+  uint64_t lod_indices_offset;
+  uint64_t lods_offset;
+  uint64_t meshlets_offset;
+
+  float box_min[3];
+  float box_max[3];
+  float center[3];
+  float scale;
+};
+
+//Count items of item_bytes at offset lie within size bytes.  Division
+//form, so corrupt 64-bit counts and offsets cannot wrap around
+inline bool meshStreamFits(uint64_t offset, uint64_t count, size_t item_bytes, size_t size){
+  return offset <= size && count <= (size - offset)/item_bytes;
+}
+
+//"models/dragon.obj" -> "models/dragon.meshbin"
+std::string meshCachePath(const char * obj_path);
+
+/**
+  Fingerprint of an OBJ file used to invalidate its cache: size and
+    modification time plus a hash of sampled blocks (head, tail and 64
+    evenly spaced 4 KB blocks), so checking it costs a few page reads
+    rather than a full pass over the OBJ.
+  @return false if the file can not be read
+**/
+bool meshSourceFingerprint(const char * obj_path, uint64_t &size, int64_t &mtime, uint64_t &hash);
+
+#endif //__MESH_CACHE_H__
@@ -0,0 +1,738 @@
+#include "common.h"
+#include "MeshChunks.h"
+#include "MeshCache.h"
+
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif //_WIN32
+
+//Worst case bytes per triangle while a chunk is welded: the triangle
+//records, their sorted corners and up to three new vertices each
+static const size_t CHUNK_BYTES_PER_TRIANGLE = 224;
+
+//Smallest block of triangles a bucket collects before spilling it
+static const size_t MIN_BLOCK_TRIANGLES = 64;
+
+static FILE * openFile(const std::string &path, const char * mode){
+#ifdef _WIN32
+  std::wstring wpath, wmode;
+  if ( u8names_towc(path.c_str(), wpath) != 0 || u8names_towc(mode, wmode) != 0 ){ return NULL; }
+  return _wfopen(wpath.c_str(), wmode.c_str());
+#else
+  return fopen(path.c_str(), mode);
+#endif //_WIN32
+}
+
+static void removeFile(const std::string &path){
+#ifdef _WIN32
+  std::wstring wpath;
+  if ( u8names_towc(path.c_str(), wpath) == 0 ){ _wremove(wpath.c_str()); }
+#else
+  remove(path.c_str());
+#endif //_WIN32
+}
+
+static bool seekFile(FILE *file, uint64_t offset){
+#ifdef _WIN32
+  return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif //_WIN32
+}
+
+//Peak resident set of this process in bytes, 0 where the OS does not say
+static size_t peakResidentBytes(){
+#ifdef __linux__
+  FILE *status = fopen("/proc/self/status", "r");
+  if( status == NULL ){ return 0; }
+  char line[256];
+  size_t kb = 0;
+  while( fgets(line, sizeof(line), status) ){
+    if( strncmp(line, "VmHWM:", 6) == 0 ){ kb = strtoul(line+6, NULL, 10); break; }
+  }
+  fclose(status);
+  return kb*1024;
+#else
+  return 0;
+#endif //__linux__
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+}
+
+//A mapped spill file for random access.  Its pages are dropped from the
+//resident set again after a fixed number of lookups, which bounds what a
+//scattered access pattern can pin whatever the file size
+class PagedLookup{
+public:
+  MappedFile file;
+
+  PagedLookup() : lookups(0), max_lookups(1) {}
+
+  //Each lookup may touch two pages, budget is split accordingly
+  void setBudget(size_t bytes){ max_lookups = (std::max)((size_t) 1, bytes/(2*4096)); }
+
+  const float * at(size_t offset){ touch(); return (const float *)(file.data + offset); }
+  float * writableAt(size_t offset){ touch(); return (float *)(file.writable() + offset); }
+
+private:
+  size_t lookups;
+  size_t max_lookups;
+
+  void touch(){
+    if( ++lookups >= max_lookups ){
+      file.release();
+      lookups = 0;
+    }
+  }
+};
+
+//Call line(p, end) at the start of every line of an OBJ, dropping the
+//pages behind the cursor whenever window bytes have been passed.  Stops
+//early when line() returns false
+template< class F >
+static bool forEachLine(MappedFile &file, size_t window, F line){
+  const char *p = file.data;
+  const char *end = file.data + file.size;
+  size_t released = 0;
+  while( p < end ){
+    p = ObjScan::skipSpace(p, end);
+    if( p >= end ){ break; }
+    if( !line(p, end) ){ return false; }
+    p = ObjScan::skipLine(p, end);
+
+    size_t at = (size_t)(p - file.data);
+    if( at - released >= window ){
+      file.release(released, at - released);
+      released = at;
+    }
+  }
+  file.release();
+  return true;
+}
+
+//The v/vt/vn triples of a face line ("f ..." from p+2), false if malformed
+static bool parseFace(const char *p, const char *end, std::vector< int > &corners){
+  corners.clear();
+  while( true ){
+    p = ObjScan::skipSpace(p, end);
+    if( ObjScan::atLineEnd(p, end) ){ break; }
+    int idx[3];
+    p = ObjScan::parseFaceCorner(p, end, idx);
+    if( p == NULL || idx[0] == 0 ){ return false; }
+    corners.insert(corners.end(), idx, idx+3);
+  }
+  return corners.size() >= 9;
+}
+
+//Zero-based one, or ~0u when the OBJ index is missing or out of range
+static inline uint32_t resolveIndex(int index, uint64_t count){
+  int64_t i = (index < 0) ? (int64_t) count + index : (int64_t) index - 1;
+  return (index == 0 || i < 0 || (uint64_t) i >= count) ? ~0u : (uint32_t) i;
+}
+
+//Bucketed triangle: zero-based v/vt/vn per corner and the centroid it was
+//bucketed by.  vt is ~0u without uvs; vn repeats v when normals are generated
+struct ChunkTriangle{
+  uint32_t v[3], t[3], n[3];
+  float centroid[3];
+};
+
+//The triangles of many buckets in one append-only spill file.  Each bucket
+//collects a block in memory and appends it to the file when it is full, so
+//the memory used is buckets*block whatever the number of triangles
+class BucketSpill{
+public:
+  BucketSpill() : file(NULL), file_end(0) {}
+  ~BucketSpill(){ if( file ){ fclose(file); } }
+
+  bool create(const std::string &path){
+    file = openFile(path, "w+b");
+    return file != NULL;
+  }
+
+  //Open n empty buckets, returns the id of the first
+  size_t addBuckets(size_t n, size_t block_triangles){
+    size_t first = buckets.size();
+    buckets.resize(first + n);
+    for(size_t b=first; b < buckets.size(); b++){
+      buckets[b].block_triangles = (std::max)(MIN_BLOCK_TRIANGLES, block_triangles);
+    }
+    return first;
+  }
+
+  bool add(size_t bucket, const ChunkTriangle &triangle){
+    Bucket &b = buckets[bucket];
+    if( b.pending.empty() ){ b.pending.reserve(b.block_triangles); }
+    b.pending.push_back(triangle);
+    b.count++;
+    for(int i=0; i < 3; i++){
+      b.box_min[i] = (std::min)(b.box_min[i], triangle.centroid[i]);
+      b.box_max[i] = (std::max)(b.box_max[i], triangle.centroid[i]);
+    }
+    return b.pending.size() < b.block_triangles || writeBlock(b);
+  }
+
+  //Spill every partial block and free the memory of all buckets
+  bool flush(){
+    for(size_t b=0; b < buckets.size(); b++){
+      if( !buckets[b].pending.empty() && !writeBlock(buckets[b]) ){ return false; }
+      std::vector< ChunkTriangle >().swap(buckets[b].pending);
+    }
+    return true;
+  }
+
+  size_t count(size_t bucket) const { return buckets[bucket].count; }
+  size_t blockCount(size_t bucket) const { return buckets[bucket].blocks.size(); }
+  const float * boxMin(size_t bucket) const { return buckets[bucket].box_min; }
+  const float * boxMax(size_t bucket) const { return buckets[bucket].box_max; }
+
+  //Append one spilled block of a flushed bucket to out
+  bool readBlock(size_t bucket, size_t block, std::vector< ChunkTriangle > &out){
+    const Block &b = buckets[bucket].blocks[block];
+    size_t first = out.size();
+    out.resize(first + b.count);
+    return seekFile(file, b.offset) &&
+           fread(&out[first], sizeof(ChunkTriangle), b.count, file) == b.count;
+  }
+
+private:
+  struct Block{
+    uint64_t offset;
+    size_t count;
+  };
+  struct Bucket{
+    std::vector< Block > blocks;
+    std::vector< ChunkTriangle > pending;
+    size_t block_triangles;
+    size_t count;
+    float box_min[3], box_max[3];   //of the centroids
+
+    Bucket() : block_triangles(MIN_BLOCK_TRIANGLES), count(0) {
+      for(int i=0; i < 3; i++){
+        box_min[i] =  (std::numeric_limits< float >::max)();
+        box_max[i] = -(std::numeric_limits< float >::max)();
+      }
+    }
+  };
+
+  FILE *file;
+  uint64_t file_end;
+  std::vector< Bucket > buckets;
+
+  bool writeBlock(Bucket &b){
+    Block block = { file_end, b.pending.size() };
+    if( !seekFile(file, file_end) ||
+        fwrite(&b.pending[0], sizeof(ChunkTriangle), block.count, file) != block.count ){
+      return false;
+    }
+    file_end += block.count*sizeof(ChunkTriangle);
+    b.blocks.push_back(block);
+    b.pending.clear();
+    return true;
+  }
+};
+
+//Positions, uvs and normals of the OBJ, spilled by the first pass
+struct ObjSpill{
+  PagedLookup positions, uvs, normals;
+  uint64_t num_positions, num_uvs, num_normals, num_triangles;
+  bool has_uv, has_normals;     //every face has them
+  float box_min[3], box_max[3];
+};
+
+//Pass 1: count everything, find the bounds and copy the vertex attributes
+//out to flat float files
+static bool spillVertices(MappedFile &obj, size_t window, const std::string &base, ObjSpill &spill){
+  FILE *files[3] = { openFile(base + ".positions.tmp", "wb"),
+                     openFile(base + ".uvs.tmp", "wb"),
+                     openFile(base + ".normals.tmp", "wb") };
+  bool ok = files[0] && files[1] && files[2];
+  for(int f=0; f < 3; f++){
+    if( files[f] ){ setvbuf(files[f], NULL, _IOFBF, 1 << 16); }
+  }
+
+  spill.num_positions = spill.num_uvs = spill.num_normals = spill.num_triangles = 0;
+  spill.has_uv = spill.has_normals = true;
+  for(int i=0; i < 3; i++){
+    spill.box_min[i] =  (std::numeric_limits< float >::max)();
+    spill.box_max[i] = -(std::numeric_limits< float >::max)();
+  }
+
+  std::vector< int > corners;
+  ok = ok && forEachLine(obj, window, [&](const char *p, const char *end){
+    char c0 = p[0];
+    char c1 = (p+1 < end) ? p[1] : '\n';
+    float value[3] = { 0, 0, 0 };
+    if ( c0 == 'v' && ObjScan::isSpace(c1) ){
+      ObjScan::parseFloats(p+2, end, value, 3);
+      for(int i=0; i < 3; i++){
+        spill.box_min[i] = (std::min)(spill.box_min[i], value[i]);
+        spill.box_max[i] = (std::max)(spill.box_max[i], value[i]);
+      }
+      spill.num_positions++;
+      return fwrite(value, sizeof(float), 3, files[0]) == 3;
+    }else if ( c0 == 'v' && c1 == 't' ){
+      ObjScan::parseFloats(p+2, end, value, 2);
+      spill.num_uvs++;
+      return fwrite(value, sizeof(float), 2, files[1]) == 2;
+    }else if ( c0 == 'v' && c1 == 'n' ){
+      ObjScan::parseFloats(p+2, end, value, 3);
+      spill.num_normals++;
+      return fwrite(value, sizeof(float), 3, files[2]) == 3;
+    }else if ( c0 == 'f' && ObjScan::isSpace(c1) ){
+      if( !parseFace(p+2, end, corners) ){
+        printf("Malformed face in OBJ\n");
+        return false;
+      }
+      for(size_t c=0; c < corners.size(); c+=3){
+        if( corners[c+1] == 0 ){ spill.has_uv = false; }
+        if( corners[c+2] == 0 ){ spill.has_normals = false; }
+      }
+      spill.num_triangles += corners.size()/3 - 2;
+    }
+    return true;
+  });
+
+  for(int f=0; f < 3; f++){
+    if( files[f] && fclose(files[f]) != 0 ){ ok = false; }
+  }
+  if( !ok ){ return false; }
+
+  //Empty files can not be mapped
+  if( spill.num_uvs == 0 ){ spill.has_uv = false; }
+  if( spill.num_normals == 0 ){ spill.has_normals = false; }
+  if( spill.num_positions == 0 || spill.num_triangles == 0 ||
+      !spill.positions.file.open((base + ".positions.tmp").c_str()) ){ return false; }
+  if( spill.has_uv && !spill.uvs.file.open((base + ".uvs.tmp").c_str()) ){ return false; }
+  if( spill.has_normals && !spill.normals.file.open((base + ".normals.tmp").c_str()) ){ return false; }
+  return true;
+}
+
+static inline vec3 spilledVec3(PagedLookup &file, uint32_t index){
+  const float *f = file.at((size_t) index*3*sizeof(float));
+  return vec3(f[0], f[1], f[2]);
+}
+
+//Pass 2: triangulate the faces and drop every triangle into the grid cell
+//holding its centroid.  Without OBJ normals the angle weighted face normals
+//are summed per position into accumulator
+static bool bucketTriangles(MappedFile &obj, size_t window, ObjSpill &spill, const int grid[3],
+                            BucketSpill &buckets, PagedLookup *accumulator){
+  vec3 box_min(spill.box_min[0], spill.box_min[1], spill.box_min[2]);
+  vec3 extent = vec3(spill.box_max[0], spill.box_max[1], spill.box_max[2]) - box_min;
+
+  uint64_t seen[3] = { 0, 0, 0 };   //v, vt, vn so far, for relative indices
+  std::vector< int > corners;
+  return forEachLine(obj, window, [&](const char *p, const char *end){
+    char c0 = p[0];
+    char c1 = (p+1 < end) ? p[1] : '\n';
+    if ( c0 == 'v' && ObjScan::isSpace(c1) ){ seen[0]++; return true; }
+    if ( c0 == 'v' && c1 == 't' ){ seen[1]++; return true; }
+    if ( c0 == 'v' && c1 == 'n' ){ seen[2]++; return true; }
+    if ( c0 != 'f' || !ObjScan::isSpace(c1) ){ return true; }
+
+    parseFace(p+2, end, corners);
+    for(size_t c=0; c < corners.size(); c+=3){
+      for(int k=0; k < 3; k++){ corners[c+k] = (int) resolveIndex(corners[c+k], seen[k]); }
+      if( (uint32_t) corners[c] == ~0u ||
+          (spill.has_uv && (uint32_t) corners[c+1] == ~0u) ||
+          (spill.has_normals && (uint32_t) corners[c+2] == ~0u) ){
+        printf("Face index out of range in OBJ\n");
+        return false;
+      }
+    }
+
+    //Triangle fan around the first corner, like Mesh::loadOBJ
+    for(size_t k=2; k < corners.size()/3; k++){
+      size_t fan[3] = { 0, k-1, k };
+      ChunkTriangle tri;
+      vec3 pos[3];
+      for(int i=0; i < 3; i++){
+        const int *corner = &corners[3*fan[i]];
+        tri.v[i] = (uint32_t) corner[0];
+        tri.t[i] = spill.has_uv ? (uint32_t) corner[1] : ~0u;
+        tri.n[i] = spill.has_normals ? (uint32_t) corner[2] : tri.v[i];
+        pos[i] = spilledVec3(spill.positions, tri.v[i]);
+      }
+      vec3 centroid = (pos[0] + pos[1] + pos[2])/3.0;
+      int cell[3];
+      for(int i=0; i < 3; i++){
+        tri.centroid[i] = centroid[i];
+        float f = (extent[i] > 0) ? (centroid[i] - box_min[i])/extent[i] : 0.0f;
+        cell[i] = (std::max)(0, (std::min)(grid[i]-1, (int)(f*grid[i])));
+      }
+      if( !buckets.add((cell[2]*grid[1] + cell[1])*grid[0] + cell[0], tri) ){ return false; }
+
+      if( accumulator ){
+        vec3 n = cross(pos[1] - pos[0], pos[2] - pos[0]);
+        float l = length(n);
+        if( l == 0 ){ continue; }
+        n /= l;
+        for(int i=0; i < 3; i++){
+          vec3 e1 = pos[(i+1)%3] - pos[i];
+          vec3 e2 = pos[(i+2)%3] - pos[i];
+          float le = length(e1)*length(e2);
+          float angle = (le > 0) ? acosf((std::max)(-1.0f, (std::min)(1.0f, dot(e1, e2)/le))) : 0.0f;
+          float *sum = accumulator->writableAt((size_t) tri.v[i]*3*sizeof(float));
+          sum[0] += n.x*angle;
+          sum[1] += n.y*angle;
+          sum[2] += n.z*angle;
+        }
+      }
+    }
+    return true;
+  });
+}
+
+//Zero pad the output to a 16 byte boundary, then write bytes there
+static bool writeAligned(FILE *file, uint64_t &written, const void *data, size_t bytes, uint64_t &offset){
+  static const char zeros[16] = {0};
+  offset = (written + 15) & ~(uint64_t)15;
+  if( fwrite(zeros, 1, (size_t)(offset - written), file) != offset - written ){ return false; }
+  if( bytes && fwrite(data, 1, bytes, file) != bytes ){ return false; }
+  written = offset + bytes;
+  return true;
+}
+
+struct CornerKey{
+  uint32_t v, t, n, corner;
+  bool operator < (const CornerKey &o) const {
+    if( v != o.v ){ return v < o.v; }
+    if( t != o.t ){ return t < o.t; }
+    return n < o.n;
+  }
+  bool sameVertex(const CornerKey &o) const { return v == o.v && t == o.t && n == o.n; }
+};
+
+//Pass 3: weld the triangles of one bucket into an indexed chunk and append
+//it to the output
+static bool writeChunk(std::vector< ChunkTriangle > &triangles, ObjSpill &spill, PagedLookup *accumulator,
+                       FILE *out, uint64_t &written, std::vector< MeshChunkRecord > &records){
+  //Sorting by position keeps the spill lookups below in file order
+  std::vector< CornerKey > keys(3*triangles.size());
+  for(size_t t=0; t < triangles.size(); t++){
+    for(int i=0; i < 3; i++){
+      CornerKey key = { triangles[t].v[i], triangles[t].t[i], triangles[t].n[i], (uint32_t)(3*t+i) };
+      keys[3*t+i] = key;
+    }
+  }
+  std::vector< ChunkTriangle >().swap(triangles);
+  std::sort(keys.begin(), keys.end());
+
+  std::vector< vec4 > vertices;
+  std::vector< vec3 > normals;
+  std::vector< vec2 > uvs;
+  std::vector< unsigned int > indices(keys.size());
+  MeshChunkRecord record;
+  memset(&record, 0, sizeof(record));
+  for(int i=0; i < 3; i++){
+    record.box_min[i] =  (std::numeric_limits< float >::max)();
+    record.box_max[i] = -(std::numeric_limits< float >::max)();
+  }
+
+  for(size_t k=0; k < keys.size(); k++){
+    const CornerKey &key = keys[k];
+    if( k == 0 || !keys[k-1].sameVertex(key) ){
+      vec3 p = spilledVec3(spill.positions, key.v);
+      vertices.push_back(vec4(p, 1.0));
+      for(int i=0; i < 3; i++){
+        record.box_min[i] = (std::min)(record.box_min[i], p[i]);
+        record.box_max[i] = (std::max)(record.box_max[i], p[i]);
+      }
+      if( spill.has_uv ){
+        const float *t = spill.uvs.at((size_t) key.t*2*sizeof(float));
+        uvs.push_back(vec2(t[0], t[1]));
+      }
+      if( accumulator ){
+        vec3 n = spilledVec3(*accumulator, key.v);
+        float l = length(n);
+        normals.push_back((l > 0) ? n/l : vec3(0,0,1));
+      }else{
+        normals.push_back(spilledVec3(spill.normals, key.n));
+      }
+    }
+    indices[key.corner] = (unsigned int)(vertices.size()-1);
+  }
+  std::vector< CornerKey >().swap(keys);
+
+  record.num_vertices = (uint32_t) vertices.size();
+  record.num_indices  = (uint32_t) indices.size();
+  bool ok = writeAligned(out, written, &vertices[0], vertices.size()*sizeof(vec4), record.vertices_offset);
+  ok = ok && writeAligned(out, written, &normals[0], normals.size()*sizeof(vec3), record.normals_offset);
+  if( !uvs.empty() ){
+    ok = ok && writeAligned(out, written, &uvs[0], uvs.size()*sizeof(vec2), record.uvs_offset);
+  }
+  ok = ok && writeAligned(out, written, &indices[0], indices.size()*sizeof(unsigned int), record.indices_offset);
+  records.push_back(record);
+  return ok;
+}
+
+//Pass 3: write every bucket small enough as a chunk, split the others into
+//eight by the octants of their centroid bounds (or in two by file order
+//when the centroids do not separate) and try again
+static bool writeChunks(BucketSpill &buckets, size_t num_buckets, size_t max_triangles, size_t block_budget,
+                        ObjSpill &spill, PagedLookup *accumulator,
+                        FILE *out, uint64_t &written, std::vector< MeshChunkRecord > &records){
+  std::vector< size_t > work;
+  std::vector< bool > by_order(num_buckets, false);
+  for(size_t b=num_buckets; b-- > 0; ){ work.push_back(b); }
+
+  std::vector< ChunkTriangle > triangles;
+  while( !work.empty() ){
+    size_t bucket = work.back();
+    work.pop_back();
+    size_t count = buckets.count(bucket);
+    if( count == 0 ){ continue; }
+
+    if( count <= max_triangles ){
+      triangles.reserve(count);
+      for(size_t k=0; k < buckets.blockCount(bucket); k++){
+        if( !buckets.readBlock(bucket, k, triangles) ){ return false; }
+      }
+      if( !writeChunk(triangles, spill, accumulator, out, written, records) ){ return false; }
+      continue;
+    }
+
+    const float *lo = buckets.boxMin(bucket);
+    const float *hi = buckets.boxMax(bucket);
+    float mid[3];
+    for(int i=0; i < 3; i++){ mid[i] = lo[i] + (hi[i] - lo[i])*0.5f; }
+    bool split_by_order = by_order[bucket];
+
+    size_t first = buckets.addBuckets(8, block_budget/(8*sizeof(ChunkTriangle)));
+    by_order.resize(first + 8, false);
+    size_t seen = 0;
+    for(size_t k=0; k < buckets.blockCount(bucket); k++){
+      triangles.clear();
+      if( !buckets.readBlock(bucket, k, triangles) ){ return false; }
+      for(size_t t=0; t < triangles.size(); t++, seen++){
+        size_t child = 0;
+        if( split_by_order ){
+          child = (2*seen)/count;
+        }else{
+          for(int i=0; i < 3; i++){
+            if( triangles[t].centroid[i] > mid[i] ){ child |= (size_t) 1 << i; }
+          }
+        }
+        if( !buckets.add(first + child, triangles[t]) ){ return false; }
+      }
+    }
+    std::vector< ChunkTriangle >().swap(triangles);
+    if( !buckets.flush() ){ return false; }
+
+    for(size_t c=first+8; c-- > first; ){
+      //Coincident or nearly coincident centroids all land in one octant
+      if( buckets.count(c) == count ){ by_order[c] = true; }
+      work.push_back(c);
+    }
+  }
+  return true;
+}
+
+bool convertOBJToChunks(const char * obj_path, const char * chunks_path, size_t memory_limit,
+                        size_t chunk_triangles){
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  memory_limit = (std::max)(memory_limit, (size_t) 16 << 20);
+
+  //Share of the limit for each consumer: the OBJ read window, random
+  //lookups into each of the spill files, bucket blocks and one chunk
+  size_t read_window  = memory_limit/8;
+  size_t lookup_budget = memory_limit/16;
+  size_t block_budget = memory_limit/8;
+  size_t max_triangles = (std::min)(chunk_triangles, (memory_limit/2)/CHUNK_BYTES_PER_TRIANGLE);
+  max_triangles = (std::max)(max_triangles, (size_t) 1);
+
+  MappedFile obj;
+  if( !obj.open(obj_path) ){
+    printf("Could not open %s\n", obj_path);
+    return false;
+  }
+
+  std::string base(chunks_path);
+  std::string temps[] = { base + ".positions.tmp", base + ".uvs.tmp", base + ".normals.tmp",
+                          base + ".accumulator.tmp", base + ".triangles.tmp" };
+  ObjSpill spill;
+  PagedLookup accumulator;
+  BucketSpill buckets;
+  FILE *out = NULL;
+  std::vector< MeshChunkRecord > records;
+  MeshChunksHeader header;
+  memset(&header, 0, sizeof(header));
+  bool ok = spillVertices(obj, read_window, base, spill);
+  if( !ok ){ printf("Could not read %s\n", obj_path); }
+
+  if( ok ){
+    printf("Scanned %llu vertices, %llu triangles in %f s\n", (unsigned long long) spill.num_positions,
+           (unsigned long long) spill.num_triangles, secondsSince(start));
+    spill.positions.setBudget(lookup_budget);
+    spill.uvs.setBudget(lookup_budget);
+    spill.normals.setBudget(lookup_budget);
+    accumulator.setBudget(lookup_budget);
+    if( !spill.has_normals ){
+      ok = accumulator.file.create(temps[3].c_str(), spill.num_positions*3*sizeof(float));
+    }
+  }
+
+  //About n^2 cells of a surface in an n^3 grid are occupied; aim for full
+  //chunks there while keeping a block of every cell inside block_budget.
+  //Axes shorter than the longest get proportionally fewer cells
+  int grid[3] = { 1, 1, 1 };
+  size_t cells = 1;
+  if( ok ){
+    int max_grid = (int) cbrt((double)(block_budget/(MIN_BLOCK_TRIANGLES*sizeof(ChunkTriangle))));
+    int n = (int) ceil(sqrt((double) spill.num_triangles/max_triangles));
+    n = (std::max)(1, (std::min)(n, (std::max)(1, max_grid)));
+    float longest = 0;
+    for(int i=0; i < 3; i++){ longest = (std::max)(longest, spill.box_max[i] - spill.box_min[i]); }
+    for(int i=0; i < 3; i++){
+      float f = (longest > 0) ? (spill.box_max[i] - spill.box_min[i])/longest : 1.0f;
+      grid[i] = (std::max)(1, (int) ceil(n*f - 0.5f));
+      cells *= grid[i];
+    }
+    ok = buckets.create(temps[4]);
+    buckets.addBuckets(cells, block_budget/(cells*sizeof(ChunkTriangle)));
+    ok = ok && bucketTriangles(obj, read_window, spill, grid, buckets,
+                               spill.has_normals ? NULL : &accumulator) && buckets.flush();
+    if( ok ){
+      printf("Bucketed into a %dx%dx%d grid after %f s\n", grid[0], grid[1], grid[2], secondsSince(start));
+    }
+  }
+  obj.close();
+
+  uint64_t written = 0;
+  if( ok ){
+    out = openFile(base, "wb");
+    ok = out != NULL;
+    uint64_t offset;
+    ok = ok && writeAligned(out, written, &header, sizeof(header), offset);
+    ok = ok && writeChunks(buckets, cells, max_triangles, block_budget,
+                           spill, spill.has_normals ? NULL : &accumulator, out, written, records);
+  }
+
+  if( ok ){
+    strncpy(header.magic, MESH_CHUNKS_MAGIC, sizeof(header.magic));
+    header.version = MESH_CHUNKS_VERSION;
+    header.flags = spill.has_uv ? MESH_CHUNKS_HAS_UV : 0;
+    header.num_chunks = records.size();
+    header.num_triangles = spill.num_triangles;
+    for(int i=0; i < 3; i++){
+      header.box_min[i] = spill.box_min[i];
+      header.box_max[i] = spill.box_max[i];
+      header.center[i] = spill.box_min[i] + (spill.box_max[i] - spill.box_min[i])/2.0f;
+    }
+    header.scale = (std::max)(spill.box_max[0] - spill.box_min[0], spill.box_max[1] - spill.box_min[1]);
+    ok = writeAligned(out, written, &records[0], records.size()*sizeof(MeshChunkRecord), header.chunks_offset);
+    ok = ok && seekFile(out, 0) && fwrite(&header, sizeof(header), 1, out) == 1;
+  }
+  if( out && fclose(out) != 0 ){ ok = false; }
+
+  spill.positions.file.close();
+  spill.uvs.file.close();
+  spill.normals.file.close();
+  accumulator.file.close();
+  for(size_t t=0; t < sizeof(temps)/sizeof(temps[0]); t++){ removeFile(temps[t]); }
+
+  if( !ok ){
+    printf("Could not convert %s to %s\n", obj_path, chunks_path);
+    if( out ){ removeFile(base); }
+    return false;
+  }
+  printf("Wrote %u chunks of at most %u triangles to %s in %f s, peak resident %u MB (limit %u MB)\n",
+         (unsigned int) records.size(), (unsigned int) max_triangles, chunks_path, secondsSince(start),
+         (unsigned int)(peakResidentBytes() >> 20), (unsigned int)(memory_limit >> 20));
+  return true;
+}
+
+//Header and record table of a mapped .meshchunks file, NULL if invalid
+static const MeshChunkRecord * chunkTable(const MappedFile &file, MeshChunksHeader &header){
+  if( file.size < sizeof(MeshChunksHeader) ){ return NULL; }
+  memcpy(&header, file.data, sizeof(header));
+  if( strncmp(header.magic, MESH_CHUNKS_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != MESH_CHUNKS_VERSION ||
+      !meshStreamFits(header.chunks_offset, header.num_chunks, sizeof(MeshChunkRecord), file.size) ){
+    return NULL;
+  }
+  return (const MeshChunkRecord *)(file.data + header.chunks_offset);
+}
+
+bool readMeshChunks(const char * chunks_path, MeshChunksHeader &header, std::vector< MeshChunkRecord > &chunks){
+  MappedFile file;
+  if( !file.open(chunks_path) ){ return false; }
+  const MeshChunkRecord *table = chunkTable(file, header);
+  if( table == NULL ){ return false; }
+  chunks.assign(table, table + header.num_chunks);
+  return true;
+}
+
+bool splitChunkPath(const std::string &path, std::string &file, unsigned int &chunk){
+  static const std::string extension(".meshchunks");
+  size_t hash = path.find_last_of('#');
+  if( hash == std::string::npos || hash < extension.size() || hash+1 == path.size() ||
+      path.compare(hash - extension.size(), extension.size(), extension) != 0 ){
+    return false;
+  }
+  for(size_t i=hash+1; i < path.size(); i++){
+    if( !ObjScan::isDigit(path[i]) ){ return false; }
+  }
+  file = path.substr(0, hash);
+  chunk = (unsigned int) strtoul(path.c_str() + hash+1, NULL, 10);
+  return true;
+}
+
+std::string chunkPath(const std::string &file, unsigned int chunk){
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "#%u", chunk);
+  return file + suffix;
+}
+
+bool Mesh::loadChunk(const char * chunks_path, unsigned int chunk){
+  MappedFile file;
+  if( !file.open(chunks_path) ){ return false; }
+  MeshChunksHeader header;
+  const MeshChunkRecord *table = chunkTable(file, header);
+  if( table == NULL || chunk >= header.num_chunks ){ return false; }
+  const MeshChunkRecord &record = table[chunk];
+  bool has_uv = (header.flags & MESH_CHUNKS_HAS_UV) != 0;
+  if( !meshStreamFits(record.vertices_offset, record.num_vertices, sizeof(vec4), file.size) ||
+      !meshStreamFits(record.normals_offset,  record.num_vertices, sizeof(vec3), file.size) ||
+      (has_uv && !meshStreamFits(record.uvs_offset, record.num_vertices, sizeof(vec2), file.size)) ||
+      !meshStreamFits(record.indices_offset,  record.num_indices,  sizeof(unsigned int), file.size) ){
+    return false;
+  }
+
+  //Every index must name one of the chunk's own vertices
+  const unsigned int *f = (const unsigned int *)(file.data + record.indices_offset);
+  unsigned int largest = 0;
+  for(uint32_t i=0; i < record.num_indices; i++){ largest = (std::max)(largest, f[i]); }
+  if( record.num_indices > 0 && largest >= record.num_vertices ){ return false; }
+
+  const vec4 *v = (const vec4 *)(file.data + record.vertices_offset);
+  const vec3 *n = (const vec3 *)(file.data + record.normals_offset);
+  vertices.assign(v, v + record.num_vertices);
+  normals.assign(n, n + record.num_vertices);
+  uvs.clear();
+  tangents.clear();
+  if( has_uv ){
+    const vec2 *t = (const vec2 *)(file.data + record.uvs_offset);
+    uvs.assign(t, t + record.num_vertices);
+  }
+  indices.assign(f, f + record.num_indices);
+  lod_indices.clear();
+  lods.clear();
+  meshlets.clear();
+
+  //The chunk's own bounds for culling and LOD selection, the whole model's
+  //framing so that all chunks line up
+  hasUV = has_uv;
+  optimized = false;
+  box_min = vec3(record.box_min[0], record.box_min[1], record.box_min[2]);
+  box_max = vec3(record.box_max[0], record.box_max[1], record.box_max[2]);
+  center  = vec3(header.center[0], header.center[1], header.center[2]);
+  scale   = header.scale;
+  updateModelView();
+  return true;
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshChunks.h ---
+//
+//  Spatially bucketed mesh files (.meshchunks) for models too large to load
+//  at once.  convertOBJToChunks() streams an OBJ of any size through a
+//  bounded amount of memory; every chunk is then an independent indexed
+//  mesh that Mesh::load pages in as "model.meshchunks#<chunk>".
+//
+//  Layout: the header below, the chunk payloads (vec4 positions, vec3
+//  normals, vec2 uvs when MESH_CHUNKS_HAS_UV, unsigned int indices, each at
+//  a 16 byte aligned offset), then num_chunks MeshChunkRecords at
+//  chunks_offset.  Native (little endian) byte order.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_CHUNKS_H__
+#define __MESH_CHUNKS_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define MESH_CHUNKS_MAGIC   "MESHCHK"
+#define MESH_CHUNKS_VERSION 1
+
+enum{ MESH_CHUNKS_HAS_UV = 1 };
+
+struct MeshChunksHeader{
+  char     magic[8];          //MESH_CHUNKS_MAGIC, null padded
+  uint32_t version;           //MESH_CHUNKS_VERSION
+  uint32_t flags;             //MESH_CHUNKS_* bits
+  uint64_t num_chunks;
+  uint64_t chunks_offset;     //byte offset of the MeshChunkRecord table
+  uint64_t num_triangles;
+
+  //Whole model, framed like Mesh::loadOBJ so the chunks line up
+  float box_min[3];
+  float box_max[3];
+  float center[3];
+  float scale;
+};
+
+struct MeshChunkRecord{
+  float    box_min[3];
+  float    box_max[3];
+  uint32_t num_vertices;
+  uint32_t num_indices;
+  uint64_t vertices_offset;
+  uint64_t normals_offset;
+  uint64_t uvs_offset;        //0 without uvs
+  uint64_t indices_offset;
+};
+
+/**
+  Convert an OBJ into a .meshchunks file in a few streaming passes.
+    Vertex data is spilled to temporary mapped files next to the output,
+    triangles are bucketed on a grid and oversized buckets split into
+    octants until every chunk fits.  Faces without normals get smooth
+    angle weighted ones.
+  @param memory_limit bytes the conversion may keep resident (16 MB or more)
+  @param chunk_triangles largest chunk to write
+  @return false if the OBJ can not be read or the output not written
+**/
+bool convertOBJToChunks(const char * obj_path, const char * chunks_path, size_t memory_limit,
+                        size_t chunk_triangles=1 << 18);
+
+//Header and chunk table of a .meshchunks file
+bool readMeshChunks(const char * chunks_path, MeshChunksHeader &header, std::vector< MeshChunkRecord > &chunks);
+
+//"model.meshchunks#12" <-> ("model.meshchunks", 12)
+bool splitChunkPath(const std::string &path, std::string &file, unsigned int &chunk);
+std::string chunkPath(const std::string &file, unsigned int chunk);
+
+#endif //__MESH_CHUNKS_H__
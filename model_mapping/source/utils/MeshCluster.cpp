@@ -0,0 +1,165 @@
+#include "common.h"
+#include "MeshOptimize.h"
+
+#include <chrono>
+#include <algorithm>
+
+/*
+ * Meshlet builder.  Each level of detail is cut into clusters by greedy
+ * region growing: a cluster starts at the first unused triangle (in the
+ * cache optimized order) and keeps taking the neighbouring triangle that
+ * adds the fewest new vertices until either limit is reached.  Within a
+ * cluster the triangles keep their original relative order, so the vertex
+ * cache order of optimize()/buildLODs() is mostly preserved.
+ *
+ * Every cluster gets a bounding sphere for frustum culling and a cone
+ * around its face normals for back-face culling (see MeshletCull.h).
+ */
+
+//Bounding sphere and normal cone of the triangles tris of idx
+static void meshletBounds(const std::vector< vec4 > &vertices, const unsigned int *idx,
+                          const std::vector< unsigned int > &tris, const std::vector< vec3 > &face_normals,
+                          Meshlet &m){
+  vec3 lo( (std::numeric_limits< float >::max)());
+  vec3 hi(-(std::numeric_limits< float >::max)());
+  for(size_t t=0; t < tris.size(); t++){
+    for(int k=0; k < 3; k++){
+      const vec4 &p = vertices[idx[3*tris[t]+k]];
+      for(int a=0; a < 3; a++){
+        lo[a] = (std::min)(lo[a], p[a]);
+        hi[a] = (std::max)(hi[a], p[a]);
+      }
+    }
+  }
+  m.center = (lo + hi)*0.5f;
+  float radius2 = 0;
+  for(size_t t=0; t < tris.size(); t++){
+    for(int k=0; k < 3; k++){
+      const vec4 &p = vertices[idx[3*tris[t]+k]];
+      vec3 d = vec3(p.x, p.y, p.z) - m.center;
+      radius2 = (std::max)(radius2, dot(d, d));
+    }
+  }
+  m.radius = sqrtf(radius2);
+
+  vec3 sum(0,0,0);
+  for(size_t t=0; t < tris.size(); t++){ sum += face_normals[tris[t]]; }
+  m.cone_axis = vec3(0,0,1);
+  m.cone_cutoff = 1.0f;
+  float l = length(sum);
+  if( l < 1e-6f ){ return; }
+  m.cone_axis = sum/l;
+
+  float min_dot = 1.0f;
+  for(size_t t=0; t < tris.size(); t++){
+    const vec3 &n = face_normals[tris[t]];
+    if( dot(n, n) > 0 ){ min_dot = (std::min)(min_dot, dot(n, m.cone_axis)); }
+  }
+  //Cones reaching past 90 degrees can never be entirely back facing
+  if( min_dot > 0 ){ m.cone_cutoff = sqrtf((std::max)(0.0f, 1.0f - min_dot*min_dot)); }
+}
+
+/**
+  Cluster the triangle list idx[0, index_count) in place and append its meshlets.
+  @param first_index position of idx[0] in indices followed by lod_indices
+**/
+static void clusterLevel(const std::vector< vec4 > &vertices, unsigned int *idx, size_t index_count,
+                         unsigned int first_index, std::vector< Meshlet > &meshlets){
+  size_t num_triangles = index_count/3;
+  std::vector< unsigned int > level(idx, idx + num_triangles*3);
+  VertexAdjacency adjacency(level, vertices.size());
+
+  std::vector< vec3 > face_normals(num_triangles);
+  for(size_t t=0; t < num_triangles; t++){
+    const vec4 &a = vertices[level[3*t]];
+    const vec4 &b = vertices[level[3*t+1]];
+    const vec4 &c = vertices[level[3*t+2]];
+    vec3 n = cross(vec3(b.x-a.x, b.y-a.y, b.z-a.z), vec3(c.x-a.x, c.y-a.y, c.z-a.z));
+    float l = length(n);
+    face_normals[t] = (l > 0) ? n/l : vec3(0,0,0);
+  }
+
+  std::vector< bool > used(num_triangles, false);
+  std::vector< unsigned int > in_meshlet(vertices.size(), ~0u);   //meshlet number holding the vertex
+  std::vector< unsigned int > tris, candidates;
+  size_t written = 0;
+  size_t seed = 0;
+  unsigned int number = 0;
+
+  while( written < num_triangles ){
+    while( used[seed] ){ seed++; }
+    tris.clear();
+    candidates.clear();
+    unsigned int vertex_count = 0;
+
+    size_t next = seed;
+    while( true ){
+      used[next] = true;
+      tris.push_back((unsigned int) next);
+      for(int k=0; k < 3; k++){
+        unsigned int v = level[3*next+k];
+        if( in_meshlet[v] == number ){ continue; }
+        in_meshlet[v] = number;
+        vertex_count++;
+        for(unsigned int a=adjacency.offsets[v]; a < adjacency.offsets[v+1]; a++){
+          if( !used[adjacency.triangles[a]] ){ candidates.push_back(adjacency.triangles[a]); }
+        }
+      }
+      if( tris.size() >= MESHLET_MAX_TRIANGLES ){ break; }
+
+      //Neighbour adding the fewest vertices, oldest first; drop used ones on the way
+      size_t best_new = 4;
+      size_t kept = 0;
+      for(size_t c=0; c < candidates.size(); c++){
+        unsigned int t = candidates[c];
+        if( used[t] ){ continue; }
+        candidates[kept++] = t;
+        if( best_new == 0 ){ continue; }
+        size_t added = 0;
+        for(int k=0; k < 3; k++){ added += (in_meshlet[level[3*t+k]] != number); }
+        if( added < best_new && vertex_count + added <= MESHLET_MAX_VERTICES ){
+          best_new = added;
+          next = t;
+        }
+      }
+      candidates.resize(kept);
+      if( best_new == 4 ){ break; }
+    }
+
+    std::sort(tris.begin(), tris.end());
+    Meshlet m;
+    m.first_index = first_index + (unsigned int)(3*written);
+    m.index_count = (unsigned int)(3*tris.size());
+    meshletBounds(vertices, &level[0], tris, face_normals, m);
+    meshlets.push_back(m);
+
+    for(size_t t=0; t < tris.size(); t++, written++){
+      for(int k=0; k < 3; k++){ idx[3*written+k] = level[3*tris[t]+k]; }
+    }
+    number++;
+  }
+}
+
+void Mesh::buildMeshlets(){
+  meshlets.clear();
+  if( lods.empty() ){
+    MeshLOD full = { 0, (unsigned int) indices.size(), 0.0f, 0, 0 };
+    lods.push_back(full);
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(size_t l=0; l < lods.size(); l++){
+    MeshLOD &lod = lods[l];
+    lod.first_meshlet = (unsigned int) meshlets.size();
+    if( lod.index_count ){
+      unsigned int *idx = (lod.first_index < indices.size()) ? &indices[lod.first_index]
+                                                             : &lod_indices[lod.first_index - indices.size()];
+      clusterLevel(vertices, idx, lod.index_count, lod.first_index, meshlets);
+    }
+    lod.meshlet_count = (unsigned int) meshlets.size() - lod.first_meshlet;
+  }
+
+  printf("Mesh meshlets: %u clusters (%.1f triangles each) in %.0f ms\n", (unsigned int) meshlets.size(),
+         meshlets.empty() ? 0.0 : (indices.size() + lod_indices.size())/3.0/meshlets.size(),
+         std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count());
+}
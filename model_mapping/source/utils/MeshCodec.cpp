@@ -0,0 +1,263 @@
+#include "common.h"
+#include "MeshCodec.h"
+
+//Values per bit packed group: 16 vertices (one group per component), or 8
+//indices, where smaller groups keep rare long references local
+static const size_t VERTEX_GROUP = 16;
+static const size_t INDEX_GROUP = 8;
+
+//Up to seven 16-bit components: position xyz, octahedral normal, half uv
+static const int MAX_COMPONENTS = 7;
+
+//Zero bytes after each stream, so unpacking may always load 8 bytes
+static const size_t STREAM_PADDING = 8;
+
+static inline uint16_t zigzag16(uint16_t delta){
+  int16_t d = (int16_t) delta;
+  return (uint16_t)(((uint16_t) d << 1) ^ (uint16_t)(d >> 15));
+}
+
+static inline uint16_t unzigzag16(uint32_t z){
+  return (uint16_t)((z >> 1) ^ (0u - (z & 1)));
+}
+
+//Append a byte with the bit width of the largest of the N values, then the
+//values packed LSB first at that width
+template< size_t N >
+static void packGroup(const uint32_t values[N], std::vector< unsigned char > &out){
+  uint32_t all = 0;
+  for(size_t k=0; k < N; k++){ all |= values[k]; }
+  unsigned int width = 0;
+  while( width < 32 && (all >> width) ){ width++; }
+  out.push_back((unsigned char) width);
+
+  uint64_t bits = 0;
+  unsigned int used = 0;
+  for(size_t k=0; k < N; k++){
+    bits |= (uint64_t) values[k] << used;
+    used += width;
+    while( used >= 8 ){
+      out.push_back((unsigned char) bits);
+      bits >>= 8;
+      used -= 8;
+    }
+  }
+  if( used ){ out.push_back((unsigned char) bits); }
+}
+
+//Read one group written by packGroup(), NULL if it is corrupt or runs
+//into the stream's padding
+template< size_t N >
+static inline const unsigned char * unpackGroup(const unsigned char *p, const unsigned char *end, uint32_t values[N]){
+  if( (size_t)(end - p) < 1 + STREAM_PADDING ){ return NULL; }
+  unsigned int width = *p++;
+  size_t bytes = (N*width + 7)/8;
+  if( width > 32 || (size_t)(end - p) < bytes + STREAM_PADDING ){ return NULL; }
+  if( width == 0 ){
+    for(size_t k=0; k < N; k++){ values[k] = 0; }
+    return p;
+  }
+  //Any value starts in some byte and spans at most 39 bits from there
+  uint64_t mask = ((uint64_t) 1 << width) - 1;
+  for(size_t k=0; k < N; k++){
+    size_t bit = k*width;
+    uint64_t word;
+    memcpy(&word, p + bit/8, sizeof(word));
+    values[k] = (uint32_t)((word >> (bit%8)) & mask);
+  }
+  return p + bytes;
+}
+
+bool encodeMesh(const Mesh &mesh, std::vector< unsigned char > &encoded){
+  size_t n = mesh.vertices.size();
+  if( n == 0 || n > 0xFFFFFFFFu || mesh.normals.size() < n ){ return false; }
+  bool with_uvs = mesh.hasUV && mesh.uvs.size() >= n;
+
+  //Quantize exactly like uploadMesh(); planar makes every component a
+  //strided array of 16-bit values
+  PackedVertices packed;
+  packVertices(mesh.vertices, mesh.normals, with_uvs ? mesh.uvs : std::vector< vec2 >(),
+               VERTEX_COMPACT, VERTEX_PLANAR, packed);
+  const unsigned char *base = &packed.data[0];
+  const unsigned char *component[MAX_COMPONENTS] = { base, base+2, base+4,
+                                                     base + packed.normal.offset, base + packed.normal.offset+2,
+                                                     base + packed.uv.offset, base + packed.uv.offset+2 };
+  size_t stride[MAX_COMPONENTS] = { 8, 8, 8, 4, 4, 4, 4 };
+  int components = with_uvs ? 7 : 5;
+
+  //Renumber in first use order while coding the indices
+  size_t total = mesh.indices.size() + mesh.lod_indices.size();
+  if( total > 0xFFFFFFFFu ){ return false; }
+  std::vector< unsigned int > renumber(n, ~0u);
+  std::vector< unsigned int > order;     //new -> old
+  order.reserve(n);
+  std::vector< unsigned char > index_stream;
+  index_stream.reserve(total + total/INDEX_GROUP + STREAM_PADDING + 1);
+  uint32_t codes[INDEX_GROUP];
+  for(size_t i=0; i < total; i++){
+    unsigned int old = (i < mesh.indices.size()) ? mesh.indices[i] : mesh.lod_indices[i - mesh.indices.size()];
+    if( old >= n ){ return false; }
+    if( renumber[old] == ~0u ){
+      renumber[old] = (unsigned int) order.size();
+      order.push_back(old);
+      codes[i%INDEX_GROUP] = 0;
+    }else{
+      codes[i%INDEX_GROUP] = (uint32_t)(order.size() - renumber[old]);
+    }
+    if( i%INDEX_GROUP == INDEX_GROUP-1 ){ packGroup< INDEX_GROUP >(codes, index_stream); }
+  }
+  if( total%INDEX_GROUP ){
+    for(size_t k=total%INDEX_GROUP; k < INDEX_GROUP; k++){ codes[k] = 0; }
+    packGroup< INDEX_GROUP >(codes, index_stream);
+  }
+  index_stream.resize(index_stream.size() + STREAM_PADDING, 0);
+  if( order.empty() ){ return false; }
+
+  //Component deltas along the new order, 16 vertices per group
+  std::vector< unsigned char > vertex_stream;
+  vertex_stream.reserve(order.size()*components*2);
+  uint16_t previous[MAX_COMPONENTS] = { 0 };
+  uint32_t deltas[VERTEX_GROUP];
+  for(size_t first=0; first < order.size(); first += VERTEX_GROUP){
+    size_t count = (std::min)(VERTEX_GROUP, order.size() - first);
+    for(int c=0; c < components; c++){
+      for(size_t k=0; k < VERTEX_GROUP; k++){
+        if( k >= count ){ deltas[k] = 0; continue; }
+        uint16_t value;
+        memcpy(&value, component[c] + order[first+k]*stride[c], 2);
+        deltas[k] = zigzag16((uint16_t)(value - previous[c]));
+        previous[c] = value;
+      }
+      packGroup< VERTEX_GROUP >(deltas, vertex_stream);
+    }
+  }
+  vertex_stream.resize(vertex_stream.size() + STREAM_PADDING, 0);
+
+  MeshCodecHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, MESH_CODEC_MAGIC, sizeof(header.magic));
+  header.version = MESH_CODEC_VERSION;
+  header.flags = with_uvs ? MESH_CODEC_HAS_UV : 0;
+  header.num_vertices = (uint32_t) order.size();
+  header.num_indices = (uint32_t) mesh.indices.size();
+  header.num_lod_indices = (uint32_t) mesh.lod_indices.size();
+  for(int i=0; i < 3; i++){
+    header.position_scale[i] = packed.position_scale[i];
+    header.position_bias[i] = packed.position_bias[i];
+  }
+  header.vertex_bytes = vertex_stream.size();
+  header.index_bytes = index_stream.size();
+
+  encoded.resize(sizeof(header) + vertex_stream.size() + index_stream.size());
+  memcpy(&encoded[0], &header, sizeof(header));
+  memcpy(&encoded[sizeof(header)], &vertex_stream[0], vertex_stream.size());
+  if( !index_stream.empty() ){
+    memcpy(&encoded[sizeof(header) + vertex_stream.size()], &index_stream[0], index_stream.size());
+  }
+  return true;
+}
+
+bool readMeshCodecHeader(const unsigned char *data, size_t size, MeshCodecHeader &header){
+  if( size < sizeof(MeshCodecHeader) ){ return false; }
+  memcpy(&header, data, sizeof(header));
+  if( strncmp(header.magic, MESH_CODEC_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != MESH_CODEC_VERSION ||
+      header.vertex_bytes > size - sizeof(header) ||
+      header.index_bytes > size - sizeof(header) - header.vertex_bytes ){
+    return false;
+  }
+
+  //Every group takes at least its width byte, so the counts cannot ask for
+  //more output than the streams could hold
+  uint64_t components = (header.flags & MESH_CODEC_HAS_UV) ? 7 : 5;
+  uint64_t total = (uint64_t) header.num_indices + header.num_lod_indices;
+  return header.vertex_bytes >= (header.num_vertices + VERTEX_GROUP - 1)/VERTEX_GROUP*components &&
+         header.index_bytes >= (total + INDEX_GROUP - 1)/INDEX_GROUP;
+}
+
+//Write the decoded indices at the output width
+template< class Index >
+static bool decodeIndices(const unsigned char *p, const unsigned char *end, size_t total, uint32_t num_vertices,
+                          Index *out){
+  uint32_t codes[INDEX_GROUP];
+  uint32_t next = 0;
+  for(size_t first=0; first < total; first += INDEX_GROUP){
+    p = unpackGroup< INDEX_GROUP >(p, end, codes);
+    if( p == NULL ){ return false; }
+    size_t count = (std::min)(INDEX_GROUP, total - first);
+    for(size_t k=0; k < count; k++){
+      uint32_t code = codes[k];
+      if( code > next || (code == 0 && next == num_vertices) ){ return false; }
+      out[first+k] = (Index)(code ? next - code : next++);
+    }
+  }
+  return true;
+}
+
+bool decodeMesh(const unsigned char *data, size_t size, VertexLayout layout, PackedVertices &packed,
+                unsigned char *vertices, unsigned char *indices){
+  MeshCodecHeader header;
+  if( !readMeshCodecHeader(data, size, header) ){ return false; }
+  size_t n = header.num_vertices;
+  bool with_uvs = (header.flags & MESH_CODEC_HAS_UV) != 0;
+  int components = with_uvs ? 7 : 5;
+  layoutVertices(n, with_uvs, VERTEX_COMPACT, layout, packed);
+  packed.position_scale = vec3(header.position_scale[0], header.position_scale[1], header.position_scale[2]);
+  packed.position_bias  = vec3(header.position_bias[0], header.position_bias[1], header.position_bias[2]);
+
+  size_t stride[3] = { packed.position.stride ? (size_t) packed.position.stride : 8,
+                       packed.normal.stride   ? (size_t) packed.normal.stride   : 4,
+                       packed.uv.stride       ? (size_t) packed.uv.stride       : 4 };
+  unsigned char *position = vertices + packed.position.offset;
+  unsigned char *normal   = vertices + packed.normal.offset;
+  unsigned char *uv       = vertices + packed.uv.offset;
+
+  const unsigned char *p = data + sizeof(header);
+  const unsigned char *end = p + header.vertex_bytes;
+  uint16_t previous[MAX_COMPONENTS] = { 0 };
+  uint16_t values[MAX_COMPONENTS][VERTEX_GROUP];
+  uint32_t deltas[VERTEX_GROUP];
+  for(size_t first=0; first < n; first += VERTEX_GROUP){
+    size_t count = (std::min)(VERTEX_GROUP, n - first);
+    for(int c=0; c < components; c++){
+      p = unpackGroup< VERTEX_GROUP >(p, end, deltas);
+      if( p == NULL ){ return false; }
+      uint16_t value = previous[c];
+      for(size_t k=0; k < VERTEX_GROUP; k++){
+        value = (uint16_t)(value + unzigzag16(deltas[k]));
+        values[c][k] = value;
+      }
+      previous[c] = values[c][count-1];
+    }
+    for(size_t k=0; k < count; k++){
+      size_t i = first + k;
+      uint16_t xyzw[4] = { values[0][k], values[1][k], values[2][k], 0 };
+      uint16_t oct[2] = { values[3][k], values[4][k] };
+      memcpy(position + i*stride[0], xyzw, sizeof(xyzw));
+      memcpy(normal + i*stride[1], oct, sizeof(oct));
+      if( with_uvs ){
+        uint16_t t[2] = { values[5][k], values[6][k] };
+        memcpy(uv + i*stride[2], t, sizeof(t));
+      }
+    }
+  }
+
+  p = end;
+  end = p + header.index_bytes;
+  size_t total = (size_t) header.num_indices + header.num_lod_indices;
+  if( meshCodecIndexSize(header) == sizeof(GLushort) ){
+    return decodeIndices(p, end, total, header.num_vertices, (GLushort *) indices);
+  }
+  return decodeIndices(p, end, total, header.num_vertices, (GLuint *) indices);
+}
+
+bool decodeMesh(const unsigned char *data, size_t size, VertexLayout layout, PackedVertices &packed,
+                std::vector< unsigned char > &indices){
+  MeshCodecHeader header;
+  if( !readMeshCodecHeader(data, size, header) ){ return false; }
+  layoutVertices(header.num_vertices, (header.flags & MESH_CODEC_HAS_UV) != 0, VERTEX_COMPACT, layout, packed);
+  packed.data.resize(header.num_vertices*packed.vertex_bytes);
+  indices.resize(((size_t) header.num_indices + header.num_lod_indices)*meshCodecIndexSize(header));
+  return decodeMesh(data, size, layout, packed, packed.data.empty() ? NULL : &packed.data[0],
+                    indices.empty() ? NULL : &indices[0]);
+}
@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshCodec.h ---
+//
+//  Compact storage of a Mesh in the VERTEX_COMPACT format of VertexPack.h:
+//  unorm16 positions against the bounding box, octahedral snorm16 normals
+//  and half uvs, so decoding reproduces exactly what uploadMesh() sends.
+//
+//  Vertices are renumbered in order of first use along the index buffer.
+//  Every 16 bit attribute component is then stored as the zigzag delta to
+//  the previous vertex, and every index as 0 for the next new vertex or as
+//  its distance back from it.  Both streams are bit packed in groups behind
+//  a byte holding the group's width in bits (0 to 32): 16 vertices with all
+//  components in turn, so decoding writes the output in a single pass, or
+//  8 indices.
+//
+//  Layout: the header below, the vertex stream, the index stream; each
+//  stream ends in 8 zero bytes.  Native (little endian) byte order.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_CODEC_H__
+#define __MESH_CODEC_H__
+
+#include "common.h"
+
+#define MESH_CODEC_MAGIC   "MESHCDC"
+#define MESH_CODEC_VERSION 1
+
+enum{ MESH_CODEC_HAS_UV = 1 };
+
+struct MeshCodecHeader{
+  char     magic[8];          //MESH_CODEC_MAGIC, null padded
+  uint32_t version;           //MESH_CODEC_VERSION
+  uint32_t flags;             //MESH_CODEC_* bits
+  uint32_t num_vertices;      //referenced by the indices, unreferenced ones are dropped
+  uint32_t num_indices;       //Mesh::indices followed by
+  uint32_t num_lod_indices;   //Mesh::lod_indices, concatenated like uploadMesh() does
+  uint32_t reserved;
+  float    position_scale[3]; //PackedVertices::position_scale/position_bias
+  float    position_bias[3];
+  uint64_t vertex_bytes;      //size of the encoded streams
+  uint64_t index_bytes;
+};
+
+/**
+  Encode the vertices, indices and lod_indices of mesh.  Meshes after
+    optimize() compress best, their vertices are already in first use order.
+  @return false for meshes without vertices or with indices out of range
+**/
+bool encodeMesh(const Mesh &mesh, std::vector< unsigned char > &encoded);
+
+//Check the header and the stream sizes of an encoded mesh
+bool readMeshCodecHeader(const unsigned char *data, size_t size, MeshCodecHeader &header);
+
+//Bytes per decoded index: 16-bit whenever the vertex count allows it
+inline size_t meshCodecIndexSize(const MeshCodecHeader &header){
+  return (header.num_vertices <= 65536) ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+/**
+  Decode straight into upload buffers, for example ones mapped with
+    glMapBufferRange.
+  @param packed receives the attribute layout and decode scale/bias of the
+    VERTEX_COMPACT vertices; its data is left alone
+  @param vertices num_vertices*packed.vertex_bytes bytes (layoutVertices()
+    gives vertex_bytes up front)
+  @param indices (num_indices + num_lod_indices)*meshCodecIndexSize() bytes
+  @return false if the data is truncated or inconsistent
+**/
+bool decodeMesh(const unsigned char *data, size_t size, VertexLayout layout, PackedVertices &packed,
+                unsigned char *vertices, unsigned char *indices);
+
+//Decode into packed.data and indices
+bool decodeMesh(const unsigned char *data, size_t size, VertexLayout layout, PackedVertices &packed,
+                std::vector< unsigned char > &indices);
+
+#endif //__MESH_CODEC_H__
@@ -0,0 +1,68 @@
+#include "common.h"
+
+MeshLoader::MeshLoader(unsigned int threads) : in_progress(0), stopping(false) {
+  if( threads == 0 ){ threads = 1; }
+  for(unsigned int t=0; t < threads; t++){
+    workers.push_back(std::thread(&MeshLoader::workerMain, this));
+  }
+}
+
+MeshLoader::~MeshLoader(){
+  {
+    std::lock_guard< std::mutex > lock(mutex);
+    stopping = true;
+    jobs.clear();
+  }
+  wake.notify_all();
+  for(size_t t=0; t < workers.size(); t++){ workers[t].join(); }
+  for(size_t r=0; r < ready.size(); r++){ delete ready[r].mesh; }
+}
+
+void MeshLoader::request(unsigned int id, const std::string &path){
+  Job job;
+  job.id = id;
+  job.path = path;
+  {
+    std::lock_guard< std::mutex > lock(mutex);
+    jobs.push_back(job);
+  }
+  wake.notify_one();
+}
+
+bool MeshLoader::poll(Result &result){
+  std::lock_guard< std::mutex > lock(mutex);
+  if( ready.empty() ){ return false; }
+  result = ready.front();
+  ready.pop_front();
+  return true;
+}
+
+size_t MeshLoader::pending(){
+  std::lock_guard< std::mutex > lock(mutex);
+  return jobs.size() + in_progress + ready.size();
+}
+
+void MeshLoader::workerMain(){
+  for(;;){
+    Job job;
+    {
+      std::unique_lock< std::mutex > lock(mutex);
+      while( !stopping && jobs.empty() ){ wake.wait(lock); }
+      if( stopping ){ return; }
+      job = jobs.front();
+      jobs.pop_front();
+      in_progress++;
+    }
+
+    Result result;
+    result.id = job.id;
+    result.path = job.path;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    result.mesh = new Mesh(job.path.c_str());
+    result.seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard< std::mutex > lock(mutex);
+    in_progress--;
+    ready.push_back(result);
+  }
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshLoader.h ---
+//
+//  Loads meshes on background threads.  Requests go into a job queue,
+//  finished meshes come back through a ready queue that the render thread
+//  drains with poll() and uploads to GL itself (the GL context stays on the
+//  main thread).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_LOADER_H__
+#define __MESH_LOADER_H__
+
+#include "common.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MeshLoader{
+public:
+  struct Result{
+    unsigned int id;      //as passed to request()
+    std::string path;
+    Mesh *mesh;           //owned by the caller once returned by poll()
+    double seconds;       //wall time spent in Mesh::load
+  };
+
+  /**
+    @param threads number of loader threads.  Each load already parses on
+      every core (see Mesh::loadOBJ), so a couple of loaders are enough to
+      keep small meshes from queuing behind a large one.
+  **/
+  MeshLoader(unsigned int threads=2);
+
+  //Drops queued requests and waits for loads in progress
+  ~MeshLoader();
+
+  //Queue path for loading; id identifies it in the Result
+  void request(unsigned int id, const std::string &path);
+
+  //Take one finished mesh without blocking
+  bool poll(Result &result);
+
+  //Requests queued, loading or waiting to be polled
+  size_t pending();
+
+private:
+  struct Job{
+    unsigned int id;
+    std::string path;
+  };
+
+  void workerMain();
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque< Job > jobs;
+  std::deque< Result > ready;
+  std::vector< std::thread > workers;
+  size_t in_progress;
+  bool stopping;
+
+  MeshLoader(const MeshLoader &);
+  MeshLoader &operator=(const MeshLoader &);
+};
+
+#endif //__MESH_LOADER_H__
@@ -0,0 +1,204 @@
+#include "common.h"
+#include "MeshOptimize.h"
+
+//Post-transform cache size assumed by the optimizer and the statistics
+static const unsigned int VERTEX_CACHE_SIZE = 16;
+
+void Mesh::vertexCacheStats(float &acmr, float &atvr) const{
+  acmr = atvr = 0;
+  if( indices.empty() || vertices.empty() ){ return; }
+
+  //FIFO cache, timestamps tell whether a vertex is still inside it
+  std::vector< size_t > stamp(vertices.size(), 0);
+  size_t time = VERTEX_CACHE_SIZE+1;
+  size_t misses = 0;
+  for(size_t i=0; i < indices.size(); i++){
+    unsigned int v = indices[i];
+    if( time - stamp[v] > VERTEX_CACHE_SIZE ){
+      stamp[v] = time++;
+      misses++;
+    }
+  }
+
+  std::vector< bool > used(vertices.size(), false);
+  size_t unique = 0;
+  for(size_t i=0; i < indices.size(); i++){
+    if( !used[indices[i]] ){ used[indices[i]] = true; unique++; }
+  }
+
+  acmr = float(misses)/float(indices.size()/3);
+  atvr = float(misses)/float(unique);
+}
+
+/*
+ * Tipsify (Sander, Nehab, Barczak 2007).  Fans around the vertex that is
+ * most likely to still be in the cache, falling back to the dead-end stack
+ * and then a linear scan.  Every fallback starts a new cluster, which is
+ * the unit the overdraw pass reorders.
+ */
+static void tipsify(const std::vector< unsigned int > &indices, size_t num_vertices,
+                    std::vector< unsigned int > &out, std::vector< unsigned int > &cluster_starts){
+  VertexAdjacency adjacency(indices, num_vertices);
+
+  std::vector< unsigned int > live(num_vertices);
+  for(size_t v=0; v < num_vertices; v++){ live[v] = adjacency.offsets[v+1] - adjacency.offsets[v]; }
+
+  std::vector< size_t > stamp(num_vertices, 0);
+  std::vector< bool > emitted(indices.size()/3, false);
+  std::vector< unsigned int > dead_end;
+  std::vector< unsigned int > candidates;
+
+  out.clear();
+  out.reserve(indices.size());
+  cluster_starts.clear();
+  cluster_starts.push_back(0);
+
+  size_t time = VERTEX_CACHE_SIZE+1;
+  size_t cursor = 0;
+  long fan = num_vertices ? 0 : -1;
+
+  while( fan >= 0 ){
+    candidates.clear();
+    for(unsigned int a=adjacency.offsets[fan]; a < adjacency.offsets[fan+1]; a++){
+      unsigned int t = adjacency.triangles[a];
+      if( emitted[t] ){ continue; }
+      for(int k=0; k < 3; k++){
+        unsigned int v = indices[3*t+k];
+        out.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if( time - stamp[v] > VERTEX_CACHE_SIZE ){ stamp[v] = time++; }
+      }
+      emitted[t] = true;
+    }
+
+    //Prefer the candidate that stays in cache longest and still has work
+    long next = -1;
+    long best = -1;
+    for(size_t c=0; c < candidates.size(); c++){
+      unsigned int v = candidates[c];
+      if( live[v] == 0 ){ continue; }
+      long priority = 0;
+      if( time - stamp[v] + 2*live[v] <= VERTEX_CACHE_SIZE ){ priority = (long)(time - stamp[v]); }
+      if( priority > best ){ best = priority; next = v; }
+    }
+
+    if( next < 0 ){
+      while( !dead_end.empty() ){
+        unsigned int v = dead_end.back();
+        dead_end.pop_back();
+        if( live[v] > 0 ){ next = v; break; }
+      }
+      while( next < 0 && cursor < num_vertices ){
+        if( live[cursor] > 0 ){ next = (long)cursor; }
+        cursor++;
+      }
+      if( next >= 0 && out.size()/3 > cluster_starts.back() ){
+        cluster_starts.push_back((unsigned int)(out.size()/3));
+      }
+    }
+    fan = next;
+  }
+}
+
+void optimizeVertexCache(std::vector< unsigned int > &indices, size_t num_vertices){
+  std::vector< unsigned int > reordered, cluster_starts;
+  tipsify(indices, num_vertices, reordered, cluster_starts);
+  indices.swap(reordered);
+}
+
+/*
+ * Linear-speed overdraw ordering from the same paper: clusters whose
+ * surface faces away from the mesh centroid are likely to occlude the rest,
+ * so they are drawn first.
+ */
+static void sortClustersForOverdraw(const std::vector< vec4 > &vertices, std::vector< unsigned int > &indices,
+                                    const std::vector< unsigned int > &cluster_starts, const vec3 &mesh_center){
+  size_t num_clusters = cluster_starts.size();
+  size_t num_triangles = indices.size()/3;
+  std::vector< std::pair< float, unsigned int > > order(num_clusters);
+
+  for(size_t c=0; c < num_clusters; c++){
+    size_t begin = cluster_starts[c];
+    size_t end = (c+1 < num_clusters) ? cluster_starts[c+1] : num_triangles;
+    vec3 centroid(0,0,0), normal(0,0,0);
+    float area = 0;
+    for(size_t t=begin; t < end; t++){
+      vec3 a = vec3(vertices[indices[3*t+0]].x, vertices[indices[3*t+0]].y, vertices[indices[3*t+0]].z);
+      vec3 b = vec3(vertices[indices[3*t+1]].x, vertices[indices[3*t+1]].y, vertices[indices[3*t+1]].z);
+      vec3 d = vec3(vertices[indices[3*t+2]].x, vertices[indices[3*t+2]].y, vertices[indices[3*t+2]].z);
+      vec3 n = cross(b-a, d-a);
+      float w = length(n);
+      centroid += (a+b+d)*(w/3.0f);
+      normal += n;
+      area += w;
+    }
+    float key = 0;
+    if( area > 0 ){
+      centroid /= area;
+      float len = length(normal);
+      if( len > 0 ){ key = dot(centroid - mesh_center, normal/len); }
+    }
+    order[c] = std::make_pair(-key, (unsigned int)c);
+  }
+  std::stable_sort(order.begin(), order.end());
+
+  std::vector< unsigned int > sorted;
+  sorted.reserve(indices.size());
+  for(size_t i=0; i < num_clusters; i++){
+    unsigned int c = order[i].second;
+    size_t begin = cluster_starts[c];
+    size_t end = (c+1 < num_clusters) ? cluster_starts[c+1] : num_triangles;
+    sorted.insert(sorted.end(), indices.begin()+3*begin, indices.begin()+3*end);
+  }
+  indices.swap(sorted);
+}
+
+//Renumber vertices in order of first use so fetches walk memory forward
+template< class T >
+static void remapStream(std::vector< T > &stream, const std::vector< unsigned int > &remap, size_t count){
+  if( stream.empty() ){ return; }
+  std::vector< T > out(count);
+  for(size_t v=0; v < remap.size(); v++){
+    if( remap[v] != ~0u ){ out[remap[v]] = stream[v]; }
+  }
+  stream.swap(out);
+}
+
+void Mesh::optimize(){
+  if( indices.empty() ){ return; }
+
+  float acmr_before, atvr_before;
+  vertexCacheStats(acmr_before, atvr_before);
+
+  std::vector< unsigned int > reordered, cluster_starts;
+  tipsify(indices, vertices.size(), reordered, cluster_starts);
+  sortClustersForOverdraw(vertices, reordered, cluster_starts, center);
+  indices.swap(reordered);
+
+  std::vector< unsigned int > remap(vertices.size(), ~0u);
+  unsigned int next = 0;
+  for(size_t i=0; i < indices.size(); i++){
+    unsigned int &v = indices[i];
+    if( remap[v] == ~0u ){ remap[v] = next++; }
+    v = remap[v];
+  }
+  //Coarser LODs only use vertices of the full mesh
+  for(size_t i=0; i < lod_indices.size(); i++){ lod_indices[i] = remap[lod_indices[i]]; }
+  remapStream(vertices, remap, next);
+  remapStream(normals, remap, next);
+  remapStream(uvs, remap, next);
+  remapStream(tangents, remap, next);
+
+  //The full level's triangles moved, so its clusters have to be rebuilt
+  meshlets.clear();
+  for(size_t l=0; l < lods.size(); l++){ lods[l].first_meshlet = lods[l].meshlet_count = 0; }
+
+  optimized = true;
+
+  float acmr_after, atvr_after;
+  vertexCacheStats(acmr_after, atvr_after);
+  printf("Mesh optimized (%u clusters): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+         (unsigned int) cluster_starts.size(), acmr_before, acmr_after, atvr_before, atvr_after);
+}
@@ -0,0 +1,42 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshOptimize.h ---
+//
+//  Index buffer helpers shared by the optimizer and the simplifier.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_OPTIMIZE_H__
+#define __MESH_OPTIMIZE_H__
+
+#include "Parallel.h"
+
+#include <vector>
+#include <cstddef>
+
+//Triangles touching every vertex, in compressed row form
+struct VertexAdjacency{
+  std::vector< unsigned int > offsets;    //vertex -> first entry in triangles
+  std::vector< unsigned int > triangles;
+
+  VertexAdjacency(const std::vector< unsigned int > &indices, size_t num_vertices)
+    : offsets(num_vertices+1, 0), triangles(indices.size()) {
+    for(size_t i=0; i < indices.size(); i++){ offsets[indices[i]+1]++; }
+    for(size_t v=0; v < num_vertices; v++){ offsets[v+1] += offsets[v]; }
+    std::vector< unsigned int > fill(offsets.begin(), offsets.end()-1);
+    for(size_t i=0; i < indices.size(); i++){ triangles[fill[indices[i]]++] = (unsigned int)(i/3); }
+  }
+
+  //The same lists built on threads workers (0 for all cores), see
+  //Parallel::groupBy()
+  VertexAdjacency(const std::vector< unsigned int > &indices, size_t num_vertices, unsigned int threads){
+    Parallel::groupBy(indices.size(), num_vertices,
+                      [&](size_t i){ return indices[i]; }, [](size_t i){ return (unsigned int)(i/3); },
+                      offsets, triangles, threads);
+  }
+};
+
+//Reorder a triangle list for the post-transform vertex cache (Tipsify)
+void optimizeVertexCache(std::vector< unsigned int > &indices, size_t num_vertices);
+
+#endif //__MESH_OPTIMIZE_H__
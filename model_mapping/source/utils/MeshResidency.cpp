@@ -0,0 +1,126 @@
+#include "common.h"
+
+static size_t meshBytes(const Mesh &mesh){
+  return mesh.vertices.size()*sizeof(vec4) + mesh.normals.size()*sizeof(vec3) +
+         mesh.uvs.size()*sizeof(vec2) + mesh.tangents.size()*sizeof(vec4) + (mesh.indices.size() + mesh.lod_indices.size())*sizeof(unsigned int) +
+         mesh.lods.size()*sizeof(MeshLOD) + mesh.meshlets.size()*sizeof(Meshlet);
+}
+
+MeshResidency::MeshResidency(size_t budget_bytes, UploadFunction upload)
+  : hits(0), misses(0), evictions(0),
+    budget_bytes(budget_bytes), cpu_bytes(0), gpu_bytes(0), frame(0), upload(upload) {}
+
+MeshResidency::~MeshResidency(){
+  for(size_t i=0; i < entries.size(); i++){
+    if( entries[i]->mesh ){ evict(*entries[i]); }
+    delete entries[i];
+  }
+}
+
+MeshResidency::Entry &MeshResidency::entry(const std::string &path){
+  std::map< std::string, unsigned int >::iterator found = lookup.find(path);
+  if( found != lookup.end() ){ return *entries[found->second]; }
+
+  Entry *e = new Entry();
+  e->path = path;
+  e->mesh = NULL;
+  e->loading = false;
+  e->cpu_bytes = 0;
+  e->last_drawn = frame;
+  lookup[path] = (unsigned int) entries.size();
+  entries.push_back(e);
+  return *e;
+}
+
+void MeshResidency::load(Entry &e){
+  if( e.mesh || e.loading ){ return; }
+  e.loading = true;
+  loader.request(lookup[e.path], e.path);
+}
+
+void MeshResidency::request(const std::string &path){
+  Entry &e = entry(path);
+  if( e.mesh ){
+    hits++;
+  }else{
+    misses++;
+    load(e);
+  }
+  e.last_drawn = frame;
+  printStats();
+}
+
+MeshResidency::Entry *MeshResidency::draw(const std::string &path){
+  Entry &e = entry(path);
+  e.last_drawn = frame;
+  if( !e.mesh ){
+    load(e);
+    return NULL;
+  }
+  return &e;
+}
+
+void MeshResidency::update(){
+  frame++;
+
+  MeshLoader::Result loaded;
+  while( loader.poll(loaded) ){
+    Entry &e = *entries[loaded.id];
+    e.loading = false;
+    e.mesh = loaded.mesh;
+    e.cpu_bytes = meshBytes(*e.mesh);
+    upload(*e.mesh, e.gpu);
+    cpu_bytes += e.cpu_bytes;
+    gpu_bytes += e.gpu.bytes;
+    std::cout << e.path << ": " << e.mesh->getNumTri() << " triangles, "
+              << e.mesh->vertices.size() << " vertices loaded in "
+              << loaded.seconds*1000.0 << " ms, "
+              << (e.cpu_bytes + e.gpu.bytes)/1024 << " KB resident\n";
+  }
+
+  //Least recently drawn first; whatever was drawn last frame stays
+  while( residentBytes() > budget_bytes ){
+    Entry *victim = NULL;
+    for(size_t i=0; i < entries.size(); i++){
+      Entry *e = entries[i];
+      if( !e->mesh || e->last_drawn + 1 >= frame ){ continue; }
+      if( victim == NULL || e->last_drawn < victim->last_drawn ){ victim = e; }
+    }
+    if( victim == NULL ){ break; }
+    std::cout << "Evicting " << victim->path << " ("
+              << (victim->cpu_bytes + victim->gpu.bytes)/1024 << " KB)\n";
+    evict(*victim);
+    evictions++;
+  }
+}
+
+void MeshResidency::evict(Entry &e){
+  cpu_bytes -= e.cpu_bytes;
+  gpu_bytes -= e.gpu.bytes;
+  glDeleteVertexArrays(1, &e.gpu.vao);
+  glDeleteBuffers(1, &e.gpu.vertex_buffer);
+  glDeleteBuffers(1, &e.gpu.index_buffer);
+  e.gpu = GPUMesh();
+  delete e.mesh;
+  e.mesh = NULL;
+  e.cpu_bytes = 0;
+}
+
+void MeshResidency::reupload(Entry &e){
+  if( !e.mesh ){ return; }
+  cpu_bytes -= e.cpu_bytes;
+  gpu_bytes -= e.gpu.bytes;
+  e.cpu_bytes = meshBytes(*e.mesh);
+  upload(*e.mesh, e.gpu);
+  cpu_bytes += e.cpu_bytes;
+  gpu_bytes += e.gpu.bytes;
+}
+
+void MeshResidency::reuploadAll(){
+  for(size_t i=0; i < entries.size(); i++){ reupload(*entries[i]); }
+}
+
+void MeshResidency::printStats() const{
+  printf("Residency: %.1f MB CPU + %.1f MB GPU of %.1f MB budget, %lu hits, %lu misses, %lu evictions\n",
+         cpu_bytes/1048576.0, gpu_bytes/1048576.0, budget_bytes/1048576.0, hits, misses, evictions);
+}
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshResidency.h ---
+//
+//  Keeps meshes resident (CPU copy plus GL buffers) under a byte budget.
+//  Meshes are keyed by path and loaded through a MeshLoader on demand;
+//  when the total goes over budget the least recently drawn ones are
+//  evicted and reloaded the next time they are requested.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_RESIDENCY_H__
+#define __MESH_RESIDENCY_H__
+
+#include "common.h"
+
+#include <map>
+#include <string>
+
+//GPU side of a resident mesh
+struct GPUMesh{
+  GLuint vao;
+  GLuint vertex_buffer;
+  GLuint index_buffer;
+  GLenum index_type;
+  size_t bytes;
+
+  //Vertex shader decode of the packed attributes, see VertexPack.h
+  vec3 position_scale;
+  vec3 position_bias;
+  bool oct_normals;
+
+  GPUMesh() : vao(0), vertex_buffer(0), index_buffer(0), index_type(GL_UNSIGNED_INT), bytes(0),
+              position_scale(1,1,1), position_bias(0,0,0), oct_normals(false) {}
+};
+
+class MeshResidency{
+public:
+  /**
+    Fills gpu from mesh, creating the GL objects when gpu.vao is 0, and
+      sets gpu.bytes.  Called on the GL thread only.
+  **/
+  typedef void (*UploadFunction)(const Mesh &mesh, GPUMesh &gpu);
+
+  struct Entry{
+    std::string path;
+    Mesh *mesh;                 //NULL unless resident
+    GPUMesh gpu;
+    bool loading;
+    size_t cpu_bytes;
+    unsigned long last_drawn;   //frame number
+  };
+
+  //Counters since construction
+  unsigned long hits, misses, evictions;
+
+  MeshResidency(size_t budget_bytes, UploadFunction upload);
+  ~MeshResidency();
+
+  /**
+    Ask for path to become resident, counting a hit when it already is
+      and a miss (queuing the load) when it is not.
+  **/
+  void request(const std::string &path);
+
+  /**
+    Mark path drawn this frame.
+    @return the entry to draw, or NULL while its mesh is still loading
+  **/
+  Entry *draw(const std::string &path);
+
+  //Once per frame: upload finished loads, then evict down to the budget
+  void update();
+
+  //Upload the resident meshes again (e.g. after the vertex format or the mesh changed)
+  void reupload(Entry &entry);
+  void reuploadAll();
+
+  size_t budget() const { return budget_bytes; }
+  size_t residentBytes() const { return cpu_bytes + gpu_bytes; }
+
+  //One line summary of usage and counters
+  void printStats() const;
+
+private:
+  size_t budget_bytes;
+  size_t cpu_bytes;
+  size_t gpu_bytes;
+  unsigned long frame;
+  UploadFunction upload;
+
+  MeshLoader loader;
+  std::vector< Entry* > entries;                  //by loader id
+  std::map< std::string, unsigned int > lookup;   //path -> loader id
+
+  Entry &entry(const std::string &path);
+  void load(Entry &entry);
+  void evict(Entry &entry);
+
+  MeshResidency(const MeshResidency &);
+  MeshResidency &operator=(const MeshResidency &);
+};
+
+#endif //__MESH_RESIDENCY_H__
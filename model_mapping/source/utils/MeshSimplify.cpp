@@ -0,0 +1,455 @@
+#include "common.h"
+#include "MeshOptimize.h"
+
+#include <chrono>
+#include <stdint.h>
+
+/*
+ * Quadric error edge collapse (Garland & Heckbert 1997) restricted to
+ * half-edge collapses, so every level of detail keeps a subset of the
+ * original vertices and can share their buffers.
+ *
+ *  - Collapse cost is the plane quadric error of the kept vertex plus a
+ *    penalty for the normal/uv difference of the two vertices.
+ *  - Open borders get extra planes perpendicular to their faces and only
+ *    collapse along the border; vertices on attribute seams (one position,
+ *    several vertices) or non-manifold edges never move.
+ *  - Each pass sorts all edges by cost and collapses an independent set of
+ *    them, rejecting collapses that would flip a triangle.
+ *  - Large meshes are first cut into spatial cells that are simplified on
+ *    separate threads with their shared vertices frozen; a final pass over
+ *    the whole mesh then cleans up along the cuts.
+ */
+
+//Weight of the planes holding open borders in place, relative to faces
+static const double BORDER_WEIGHT = 10.0;
+//Cost of a unit squared normal/uv change per unit area (normalized scale)
+static const double ATTRIBUTE_WEIGHT = 1e-3;
+//Reject collapses turning a face by more than ~75 degrees
+static const double MAX_FLIP_COS = 0.25;
+//Levels smaller than this are not worth keeping
+static const size_t MIN_LOD_TRIANGLES = 16;
+//Partition only when every cell gets at least this many triangles
+static const size_t MIN_CELL_TRIANGLES = 16384;
+
+enum{ KIND_MANIFOLD, KIND_BORDER, KIND_LOCKED };
+
+struct Quadric{
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+  double w;   //area the quadric was accumulated over
+
+  Quadric() : a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0), w(0) {}
+
+  //Squared distance to the plane n.p + d = 0 (n unit length), times weight
+  void addPlane(double nx, double ny, double nz, double d, double weight){
+    a00 += weight*nx*nx; a01 += weight*nx*ny; a02 += weight*nx*nz;
+    a11 += weight*ny*ny; a12 += weight*ny*nz; a22 += weight*nz*nz;
+    b0 += weight*nx*d; b1 += weight*ny*d; b2 += weight*nz*d;
+    c += weight*d*d;
+    w += weight;
+  }
+
+  void add(const Quadric &q){
+    a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+    b0 += q.b0; b1 += q.b1; b2 += q.b2;
+    c += q.c;
+    w += q.w;
+  }
+
+  double eval(const vec3 &p) const{
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00*x*x + a11*y*y + a22*z*z + 2.0*(a01*x*y + a02*x*z + a12*y*z) +
+               2.0*(b0*x + b1*y + b2*z) + c;
+    return e > 0 ? e : 0;
+  }
+};
+
+//Per vertex state shared by all regions of one simplification
+struct SimplifyState{
+  std::vector< vec3 > positions;          //scaled to unit size
+  const std::vector< vec3 > *normals;
+  const std::vector< vec2 > *uvs;         //NULL when the mesh has none
+  std::vector< unsigned char > kind;
+  std::vector< Quadric > quadrics;        //written only for vertices a region owns
+};
+
+static inline uint64_t edgeKey(unsigned int a, unsigned int b){
+  return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+static inline vec3 triangleNormal(const vec3 &a, const vec3 &b, const vec3 &c){
+  return cross(b - a, c - a);
+}
+
+/*
+ * Vertex kinds from the position topology: vertices sharing a position
+ * with another vertex (uv/normal seams) and vertices on edges with more
+ * than two faces are locked, vertices on edges with one face are border.
+ * Border edges also add their perpendicular planes to the quadrics.
+ */
+static void classifyVertices(const std::vector< unsigned int > &indices, SimplifyState &state){
+  size_t num_vertices = state.positions.size();
+  state.kind.assign(num_vertices, KIND_MANIFOLD);
+
+  //Weld by exact position
+  std::vector< unsigned int > order(num_vertices);
+  for(size_t v=0; v < num_vertices; v++){ order[v] = (unsigned int) v; }
+  const std::vector< vec3 > &p = state.positions;
+  std::sort(order.begin(), order.end(), [&p](unsigned int a, unsigned int b){
+    if( p[a].x != p[b].x ){ return p[a].x < p[b].x; }
+    if( p[a].y != p[b].y ){ return p[a].y < p[b].y; }
+    return p[a].z < p[b].z;
+  });
+  std::vector< unsigned int > rep(num_vertices);
+  for(size_t i=0; i < num_vertices; ){
+    size_t j = i+1;
+    while( j < num_vertices && p[order[j]].x == p[order[i]].x &&
+           p[order[j]].y == p[order[i]].y && p[order[j]].z == p[order[i]].z ){ j++; }
+    for(size_t k=i; k < j; k++){
+      rep[order[k]] = order[i];
+      if( j - i > 1 ){ state.kind[order[k]] = KIND_LOCKED; }
+    }
+    i = j;
+  }
+
+  //Count faces per welded edge
+  std::vector< std::pair< uint64_t, unsigned int > > edges(indices.size());
+  for(size_t i=0; i < indices.size(); i++){
+    size_t t = i/3;
+    unsigned int a = rep[indices[i]];
+    unsigned int b = rep[indices[3*t + (i+1)%3]];
+    edges[i] = std::make_pair(edgeKey(a, b), (unsigned int) i);
+  }
+  std::sort(edges.begin(), edges.end());
+
+  for(size_t i=0; i < edges.size(); ){
+    size_t j = i+1;
+    while( j < edges.size() && edges[j].first == edges[i].first ){ j++; }
+    size_t count = j - i;
+    for(size_t k=i; k < j && count != 2; k++){
+      unsigned int corner = edges[k].second;
+      size_t t = corner/3;
+      unsigned int a = indices[corner];
+      unsigned int b = indices[3*t + (corner%3+1)%3];
+      unsigned int c = indices[3*t + (corner%3+2)%3];
+      if( count > 2 ){
+        state.kind[a] = state.kind[b] = KIND_LOCKED;
+        continue;
+      }
+      if( state.kind[a] == KIND_MANIFOLD ){ state.kind[a] = KIND_BORDER; }
+      if( state.kind[b] == KIND_MANIFOLD ){ state.kind[b] = KIND_BORDER; }
+
+      //Plane through the border edge, perpendicular to its face
+      vec3 e = p[b] - p[a];
+      vec3 n = cross(e, triangleNormal(p[a], p[b], p[c]));
+      float len = length(n);
+      if( len > 0 ){
+        n /= len;
+        double weight = BORDER_WEIGHT*dot(e, e);
+        state.quadrics[a].addPlane(n.x, n.y, n.z, -dot(n, p[a]), weight);
+        state.quadrics[b].addPlane(n.x, n.y, n.z, -dot(n, p[a]), weight);
+      }
+    }
+    i = j;
+  }
+}
+
+//Area weighted face planes
+static void faceQuadrics(const std::vector< unsigned int > &indices, SimplifyState &state){
+  const std::vector< vec3 > &p = state.positions;
+  for(size_t t=0; t+2 < indices.size(); t+=3){
+    vec3 n = triangleNormal(p[indices[t]], p[indices[t+1]], p[indices[t+2]]);
+    float len = length(n);
+    if( len == 0 ){ continue; }
+    n /= len;
+    double d = -dot(n, p[indices[t]]);
+    for(int k=0; k < 3; k++){ state.quadrics[indices[t+k]].addPlane(n.x, n.y, n.z, d, 0.5*len); }
+  }
+}
+
+struct Collapse{
+  double cost;
+  unsigned int from, to;
+  bool operator<(const Collapse &o) const { return cost < o.cost; }
+};
+
+/*
+ * Collapse edges of one region until target triangles remain or nothing
+ * can be collapsed.  indices holds global vertex ids on entry and exit;
+ * vertices flagged in frozen (may be NULL) neither move nor receive
+ * collapses, so regions sharing them can run concurrently.
+ * @return largest distance error of the collapses, in normalized units
+ */
+static float simplifyRegion(std::vector< unsigned int > &indices, size_t target,
+                            SimplifyState &state, const std::vector< unsigned char > *frozen){
+  //Compact to local vertex ids
+  std::vector< unsigned int > global(indices);
+  std::sort(global.begin(), global.end());
+  global.erase(std::unique(global.begin(), global.end()), global.end());
+  size_t num_vertices = global.size();
+  std::vector< unsigned int > local(indices.size());
+  for(size_t i=0; i < indices.size(); i++){
+    local[i] = (unsigned int)(std::lower_bound(global.begin(), global.end(), indices[i]) - global.begin());
+  }
+
+  std::vector< vec3 > position(num_vertices);
+  std::vector< unsigned char > kind(num_vertices);
+  std::vector< Quadric > quadric(num_vertices);
+  for(size_t v=0; v < num_vertices; v++){
+    unsigned int g = global[v];
+    position[v] = state.positions[g];
+    kind[v] = state.kind[g];
+    quadric[v] = state.quadrics[g];
+    if( frozen && (*frozen)[g] ){ kind[v] = KIND_LOCKED + 1; }
+  }
+  const unsigned char FROZEN = KIND_LOCKED + 1;
+
+  std::vector< unsigned int > remap(num_vertices);
+  std::vector< unsigned char > touched(num_vertices);
+  std::vector< uint64_t > edges;
+  std::vector< Collapse > collapses;
+  float max_error = 0;
+  size_t triangles = local.size()/3;
+
+  while( triangles > target ){
+    VertexAdjacency adjacency(local, num_vertices);
+
+    edges.resize(local.size());
+    for(size_t i=0; i < local.size(); i++){
+      edges[i] = edgeKey(local[i], local[i - i%3 + (i+1)%3]);
+    }
+    std::sort(edges.begin(), edges.end());
+
+    //Cheapest valid direction of every edge
+    collapses.clear();
+    for(size_t i=0; i < edges.size(); ){
+      size_t j = i+1;
+      while( j < edges.size() && edges[j] == edges[i] ){ j++; }
+      bool border_edge = (j - i == 1);
+      unsigned int ends[2] = { (unsigned int)(edges[i] >> 32), (unsigned int)(edges[i] & 0xFFFFFFFF) };
+      i = j;
+
+      if( kind[ends[0]] == FROZEN || kind[ends[1]] == FROZEN ){ continue; }
+      Collapse best;
+      best.cost = -1;
+      for(int d=0; d < 2; d++){
+        unsigned int u = ends[d], v = ends[1-d];
+        if( kind[u] == KIND_LOCKED || (kind[u] == KIND_BORDER && !border_edge) ){ continue; }
+        Quadric q = quadric[u];
+        q.add(quadric[v]);
+        double cost = q.eval(position[v]);
+        unsigned int gu = global[u], gv = global[v];
+        vec3 dn = (*state.normals)[gu] - (*state.normals)[gv];
+        double attribute = dot(dn, dn);
+        if( state.uvs ){
+          vec2 dt = (*state.uvs)[gu] - (*state.uvs)[gv];
+          attribute += dot(dt, dt);
+        }
+        cost += ATTRIBUTE_WEIGHT*attribute*quadric[u].w;
+        if( best.cost < 0 || cost < best.cost ){
+          best.cost = cost;
+          best.from = u;
+          best.to = v;
+        }
+      }
+      if( best.cost >= 0 ){ collapses.push_back(best); }
+    }
+    if( collapses.empty() ){ break; }
+    std::sort(collapses.begin(), collapses.end());
+
+    //Independent set: a collapsing vertex's ring stays put for this pass,
+    //which keeps the flip test exact
+    for(size_t v=0; v < num_vertices; v++){ remap[v] = (unsigned int) v; }
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t collapsed = 0;
+    size_t remaining = triangles;
+    for(size_t c=0; c < collapses.size() && remaining > target; c++){
+      unsigned int u = collapses[c].from, v = collapses[c].to;
+      if( touched[u] || touched[v] == 2 ){ continue; }
+
+      bool flips = false;
+      size_t removed = 0;
+      for(unsigned int a=adjacency.offsets[u]; a < adjacency.offsets[u+1] && !flips; a++){
+        const unsigned int *t = &local[3*adjacency.triangles[a]];
+        if( t[0] == v || t[1] == v || t[2] == v ){ removed++; continue; }
+        vec3 before = triangleNormal(position[t[0]], position[t[1]], position[t[2]]);
+        vec3 after = triangleNormal(t[0] == u ? position[v] : position[t[0]],
+                                    t[1] == u ? position[v] : position[t[1]],
+                                    t[2] == u ? position[v] : position[t[2]]);
+        double lb = length(before), la = length(after);
+        if( lb > 0 && dot(before, after) < MAX_FLIP_COS*lb*la ){ flips = true; }
+      }
+      if( flips || removed == 0 ){ continue; }
+
+      remap[u] = v;
+      touched[u] = 2;
+      for(unsigned int a=adjacency.offsets[u]; a < adjacency.offsets[u+1]; a++){
+        const unsigned int *t = &local[3*adjacency.triangles[a]];
+        for(int k=0; k < 3; k++){ if( touched[t[k]] == 0 ){ touched[t[k]] = 1; } }
+      }
+
+      Quadric q = quadric[u];
+      q.add(quadric[v]);
+      double error = q.eval(position[v]);
+      if( q.w > 0 ){ max_error = (std::max)(max_error, (float) sqrt(error/q.w)); }
+      quadric[v] = q;
+
+      remaining -= removed;
+      collapsed++;
+    }
+    if( collapsed == 0 ){ break; }
+
+    size_t out = 0;
+    for(size_t t=0; t+2 < local.size(); t+=3){
+      unsigned int a = remap[local[t]], b = remap[local[t+1]], c = remap[local[t+2]];
+      if( a == b || b == c || a == c ){ continue; }
+      local[out++] = a;
+      local[out++] = b;
+      local[out++] = c;
+    }
+    local.resize(out);
+    triangles = out/3;
+  }
+
+  for(size_t v=0; v < num_vertices; v++){
+    if( kind[v] != FROZEN ){ state.quadrics[global[v]] = quadric[v]; }
+  }
+  indices.resize(local.size());
+  for(size_t i=0; i < local.size(); i++){ indices[i] = global[local[i]]; }
+  return max_error;
+}
+
+//Recursive median split of the triangles by centroid along the longest axis
+static void partitionTriangles(const std::vector< unsigned int > &indices, const std::vector< vec3 > &p,
+                               std::vector< unsigned int >::iterator begin, std::vector< unsigned int >::iterator end,
+                               unsigned int parts, std::vector< std::vector< unsigned int > > &cells){
+  if( parts <= 1 || end - begin < 2 ){
+    cells.push_back(std::vector< unsigned int >());
+    std::vector< unsigned int > &cell = cells.back();
+    cell.reserve((end - begin)*3);
+    for(std::vector< unsigned int >::iterator t=begin; t != end; ++t){
+      cell.insert(cell.end(), indices.begin() + 3*(*t), indices.begin() + 3*(*t) + 3);
+    }
+    return;
+  }
+
+  vec3 lo( (std::numeric_limits< float >::max)());
+  vec3 hi(-(std::numeric_limits< float >::max)());
+  for(std::vector< unsigned int >::iterator t=begin; t != end; ++t){
+    vec3 c = p[indices[3*(*t)]] + p[indices[3*(*t)+1]] + p[indices[3*(*t)+2]];
+    for(int k=0; k < 3; k++){
+      lo[k] = (std::min)(lo[k], c[k]);
+      hi[k] = (std::max)(hi[k], c[k]);
+    }
+  }
+  int axis = 0;
+  for(int k=1; k < 3; k++){ if( hi[k] - lo[k] > hi[axis] - lo[axis] ){ axis = k; } }
+
+  unsigned int left = parts/2;
+  std::vector< unsigned int >::iterator mid = begin + (end - begin)*left/parts;
+  std::nth_element(begin, mid, end, [&](unsigned int a, unsigned int b){
+    return p[indices[3*a]][axis] + p[indices[3*a+1]][axis] + p[indices[3*a+2]][axis] <
+           p[indices[3*b]][axis] + p[indices[3*b+1]][axis] + p[indices[3*b+2]][axis];
+  });
+  partitionTriangles(indices, p, begin, mid, left, cells);
+  partitionTriangles(indices, p, mid, end, parts - left, cells);
+}
+
+//Simplify indices to target triangles, in parallel cells first when large
+static float simplifyLevel(std::vector< unsigned int > &indices, size_t target,
+                           SimplifyState &state, unsigned int workers){
+  size_t triangles = indices.size()/3;
+  float error = 0;
+
+  unsigned int parts = workers;
+  while( parts > 1 && triangles/parts < MIN_CELL_TRIANGLES ){ parts--; }
+  if( parts > 1 ){
+    std::vector< unsigned int > order(triangles);
+    for(size_t t=0; t < triangles; t++){ order[t] = (unsigned int) t; }
+    std::vector< std::vector< unsigned int > > cells;
+    partitionTriangles(indices, state.positions, order.begin(), order.end(), parts, cells);
+
+    //Vertices used by more than one cell stay fixed until the final pass
+    std::vector< unsigned int > owner(state.positions.size(), ~0u);
+    std::vector< unsigned char > frozen(state.positions.size(), 0);
+    for(size_t c=0; c < cells.size(); c++){
+      for(size_t i=0; i < cells[c].size(); i++){
+        unsigned int v = cells[c][i];
+        if( owner[v] == ~0u ){ owner[v] = (unsigned int) c; }
+        else if( owner[v] != c ){ frozen[v] = 1; }
+      }
+    }
+
+    std::vector< float > cell_error(cells.size(), 0);
+    Parallel::forRange(cells.size(), [&](size_t b, size_t e, unsigned int){
+      for(size_t c=b; c < e; c++){
+        size_t cell_target = (size_t)((double) target * (cells[c].size()/3) / triangles);
+        cell_error[c] = simplifyRegion(cells[c], cell_target, state, &frozen);
+      }
+    }, 1, parts);
+
+    indices.clear();
+    for(size_t c=0; c < cells.size(); c++){
+      indices.insert(indices.end(), cells[c].begin(), cells[c].end());
+      error = (std::max)(error, cell_error[c]);
+    }
+  }
+
+  return (std::max)(error, simplifyRegion(indices, target, state, NULL));
+}
+
+std::vector< float > Mesh::defaultLODRatios(){
+  std::vector< float > ratios;
+  for(float r=0.5f; r > 0.02f; r *= 0.5f){ ratios.push_back(r); }
+  return ratios;
+}
+
+void Mesh::buildLODs(const std::vector< float > &ratios, unsigned int threads){
+  lod_indices.clear();
+  lods.clear();
+  meshlets.clear();
+  MeshLOD full = { 0, (unsigned int) indices.size(), 0.0f, 0, 0 };
+  lods.push_back(full);
+  if( indices.empty() || normals.size() < vertices.size() ){ return; }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned int workers = threads ? threads : Parallel::workerCount();
+
+  SimplifyState state;
+  float unit = scale > 0 ? 1.0f/scale : 1.0f;
+  state.positions.resize(vertices.size());
+  for(size_t v=0; v < vertices.size(); v++){
+    state.positions[v] = vec3(vertices[v].x, vertices[v].y, vertices[v].z)*unit;
+  }
+  state.normals = &normals;
+  state.uvs = (hasUV && uvs.size() >= vertices.size()) ? &uvs : NULL;
+  state.quadrics.resize(vertices.size());
+  classifyVertices(indices, state);
+  faceQuadrics(indices, state);
+
+  std::vector< unsigned int > current(indices);
+  size_t full_triangles = indices.size()/3;
+  float error = 0;
+  for(size_t r=0; r < ratios.size(); r++){
+    size_t target = (size_t)(ratios[r]*full_triangles);
+    size_t previous = current.size()/3;
+    if( target < MIN_LOD_TRIANGLES || target >= previous ){ continue; }
+
+    error = (std::max)(error, simplifyLevel(current, target, state, workers));
+
+    //Stop once the collapses run out
+    if( current.size()/3 > previous - previous/10 ){ break; }
+
+    optimizeVertexCache(current, vertices.size());
+    MeshLOD lod = { (unsigned int)(indices.size() + lod_indices.size()), (unsigned int) current.size(), error*scale, 0, 0 };
+    lod_indices.insert(lod_indices.end(), current.begin(), current.end());
+    lods.push_back(lod);
+  }
+
+  printf("Mesh LODs:");
+  for(size_t l=0; l < lods.size(); l++){ printf(" %u", lods[l].index_count/3); }
+  printf(" triangles in %.0f ms\n",
+         std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count());
+}
@@ -0,0 +1,597 @@
+#include "common.h"
+
+#include <chrono>
+#include <unordered_map>
+
+/*
+ * Subdivision surfaces.  The triangle list is welded on position into a
+ * polygon mesh with half-edge connectivity (every corner is the half-edge
+ * to the next corner of its face), so uv seams do not tear the surface;
+ * uvs ride along per corner and are interpolated linearly.  Each level
+ * computes the new points in parallel, in separate passes over faces,
+ * edges and vertices, then writes the refined faces in the order of the
+ * faces they come from.  Nothing depends on the number of threads.
+ *
+ *   Loop          triangles only: every edge gets a point, every
+ *                 triangle becomes four
+ *   Catmull-Clark any polygons: every face and edge gets a point, every
+ *                 n-gon becomes n quads
+ *
+ * The adaptive mode splits only the edges whose projection is longer than
+ * a pixel threshold.  Triangles with one or two split edges are cut into
+ * two or three (red-green refinement), so no T-junctions appear, and only
+ * vertices touching a split edge move.  Boundary edges and vertices use
+ * the curve rules; non-manifold vertices stay put.  Normals are rebuilt
+ * from the subdivided surface at the end.
+ */
+
+static const unsigned int NONE = ~0u;
+
+//Polygons over position-welded points; uvs are per corner so seams stay open
+struct PolyMesh{
+  std::vector< vec3 > points;
+  std::vector< unsigned int > face_first;     //faces+1 offsets into the corners
+  std::vector< unsigned int > corner_point;
+  std::vector< vec2 > corner_uv;              //empty without uvs
+
+  size_t faces() const { return face_first.size()-1; }
+};
+
+//Connectivity of a PolyMesh; corner c is the half-edge from its point to
+//the point of the next corner of its face
+struct HalfEdges{
+  std::vector< unsigned int > face;           //corner -> face
+  std::vector< unsigned int > twin;           //opposite half-edge, NONE on boundaries
+  std::vector< unsigned int > edge;           //corner -> undirected edge
+  std::vector< unsigned int > edge_corner;    //edge -> the half-edge that owns it
+  std::vector< unsigned int > around_first;   //point -> corners at it, compressed rows
+  std::vector< unsigned int > around;
+};
+
+//Bytes of a level with its connectivity, for the growth report and the bound
+static size_t levelBytes(size_t points, size_t faces, size_t corners, size_t edges, bool with_uvs){
+  return points*(sizeof(vec3) + sizeof(unsigned int)) + (faces+1)*sizeof(unsigned int) +
+         corners*(5*sizeof(unsigned int) + (with_uvs ? sizeof(vec2) : 0)) + edges*sizeof(unsigned int);
+}
+
+static inline unsigned int nextCorner(const PolyMesh &m, const HalfEdges &h, unsigned int c){
+  unsigned int f = h.face[c];
+  return (c+1 < m.face_first[f+1]) ? c+1 : m.face_first[f];
+}
+
+static inline unsigned int prevCorner(const PolyMesh &m, const HalfEdges &h, unsigned int c){
+  unsigned int f = h.face[c];
+  return (c > m.face_first[f]) ? c-1 : m.face_first[f+1]-1;
+}
+
+//Corners at every point in ascending order
+static void cornersAround(const PolyMesh &m, unsigned int threads, HalfEdges &h){
+  const std::vector< unsigned int > &cp = m.corner_point;
+  Parallel::groupBy(cp.size(), m.points.size(),
+                    [&](size_t c){ return cp[c]; }, [](size_t c){ return (unsigned int) c; },
+                    h.around_first, h.around, threads);
+}
+
+static void buildHalfEdges(const PolyMesh &m, unsigned int threads, HalfEdges &h){
+  size_t num_corners = m.corner_point.size();
+  const std::vector< unsigned int > &cp = m.corner_point;
+  h.face.resize(num_corners);
+  Parallel::forRange(m.faces(), [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){
+      for(unsigned int c=m.face_first[f]; c < m.face_first[f+1]; c++){ h.face[c] = (unsigned int) f; }
+    }
+  }, 1 << 14, threads);
+  cornersAround(m, threads, h);
+
+  //Opposite half-edge: the first one at the end point leading back.  Only
+  //mutual pairs count, edges shared by more than two faces become boundaries
+  std::vector< unsigned int > found(num_corners);
+  Parallel::forRange(num_corners, [&](size_t b, size_t e, unsigned int){
+    for(size_t c=b; c < e; c++){
+      unsigned int from = cp[c], to = cp[nextCorner(m, h, (unsigned int) c)];
+      found[c] = NONE;
+      for(unsigned int i=h.around_first[to]; i < h.around_first[to+1]; i++){
+        unsigned int d = h.around[i];
+        if( cp[nextCorner(m, h, d)] == from ){ found[c] = d; break; }
+      }
+    }
+  }, 1 << 14, threads);
+  h.twin.resize(num_corners);
+  Parallel::forRange(num_corners, [&](size_t b, size_t e, unsigned int){
+    for(size_t c=b; c < e; c++){
+      h.twin[c] = (found[c] != NONE && found[found[c]] == c) ? found[c] : NONE;
+    }
+  }, 1 << 16, threads);
+
+  //Edges are numbered in the order of their owners, the lower half-edge
+  h.edge.resize(num_corners);
+  unsigned int edges = 0;
+  for(size_t c=0; c < num_corners; c++){
+    h.edge[c] = edges;
+    if( h.twin[c] == NONE || c < h.twin[c] ){ edges++; }
+  }
+  h.edge_corner.resize(edges);
+  Parallel::forRange(num_corners, [&](size_t b, size_t e, unsigned int){
+    for(size_t c=b; c < e; c++){
+      if( h.twin[c] == NONE || c < h.twin[c] ){ h.edge_corner[h.edge[c]] = (unsigned int) c; }
+      else{ h.edge[c] = h.edge[h.twin[c]]; }
+    }
+  }, 1 << 16, threads);
+}
+
+/**
+  Neighbours of point p across its outgoing half-edges, and the two
+    neighbours along the boundary when p is on one.
+  @return the number of outgoing half-edges, boundary neighbours in boundary
+**/
+static unsigned int pointRing(const PolyMesh &m, const HalfEdges &h, unsigned int p,
+                              vec3 &ring_sum, vec3 &boundary_sum, unsigned int &boundary){
+  ring_sum = boundary_sum = vec3(0,0,0);
+  boundary = 0;
+  unsigned int count = 0;
+  for(unsigned int i=h.around_first[p]; i < h.around_first[p+1]; i++){
+    unsigned int c = h.around[i];
+    unsigned int next = m.corner_point[nextCorner(m, h, c)];
+    unsigned int prev_corner = prevCorner(m, h, c);
+    ring_sum += m.points[next];
+    count++;
+    if( h.twin[c] == NONE ){ boundary_sum += m.points[next]; boundary++; }
+    if( h.twin[prev_corner] == NONE ){ boundary_sum += m.points[m.corner_point[prev_corner]]; boundary++; }
+  }
+  return count;
+}
+
+/**
+  One Loop level.
+  @param split new point index for every edge, NONE for edges kept whole;
+    split edges are numbered after the old points
+**/
+static void loopLevel(const PolyMesh &m, const HalfEdges &h, const std::vector< unsigned int > &split,
+                      size_t new_points, bool adaptive, unsigned int threads, PolyMesh &out){
+  const std::vector< unsigned int > &cp = m.corner_point;
+  bool with_uvs = !m.corner_uv.empty();
+  size_t num_points = m.points.size();
+  out.points.resize(new_points);
+
+  //Old points: the vertex mask, or the boundary curve rule
+  Parallel::forRange(num_points, [&](size_t b, size_t e, unsigned int){
+    for(size_t p=b; p < e; p++){
+      out.points[p] = m.points[p];
+      bool touched = !adaptive;
+      for(unsigned int i=h.around_first[p]; i < h.around_first[p+1] && !touched; i++){
+        unsigned int c = h.around[i];
+        touched = split[h.edge[c]] != NONE || split[h.edge[prevCorner(m, h, c)]] != NONE;
+      }
+      if( !touched ){ continue; }
+      vec3 ring, boundary_ring;
+      unsigned int boundary;
+      unsigned int n = pointRing(m, h, (unsigned int) p, ring, boundary_ring, boundary);
+      if( boundary == 2 ){
+        out.points[p] = m.points[p]*0.75f + boundary_ring*0.125f;
+      }else if( boundary == 0 && n >= 3 ){
+        float beta = (n == 3) ? 3.0f/16.0f : 3.0f/(8.0f*n);
+        out.points[p] = m.points[p]*(1.0f - n*beta) + ring*beta;
+      }
+    }
+  }, 1 << 12, threads);
+
+  //Edge points: 3/8 of the ends and 1/8 of the opposite corners
+  Parallel::forRange(h.edge_corner.size(), [&](size_t b, size_t e, unsigned int){
+    for(size_t edge=b; edge < e; edge++){
+      if( split[edge] == NONE ){ continue; }
+      unsigned int c = h.edge_corner[edge];
+      const vec3 &p0 = m.points[cp[c]];
+      const vec3 &p1 = m.points[cp[nextCorner(m, h, c)]];
+      if( h.twin[c] == NONE ){
+        out.points[split[edge]] = (p0 + p1)*0.5f;
+      }else{
+        const vec3 &o0 = m.points[cp[prevCorner(m, h, c)]];
+        const vec3 &o1 = m.points[cp[prevCorner(m, h, h.twin[c])]];
+        out.points[split[edge]] = (p0 + p1)*0.375f + (o0 + o1)*0.125f;
+      }
+    }
+  }, 1 << 12, threads);
+
+  //Triangles out of every triangle: 1, 2, 3 or 4 by its split edges
+  size_t num_faces = m.faces();
+  std::vector< unsigned int > first_out(num_faces+1, 0);
+  Parallel::forRange(num_faces, [&](size_t b, size_t e, unsigned int){
+    static const unsigned int pieces[4] = { 1, 2, 3, 4 };
+    for(size_t f=b; f < e; f++){
+      unsigned int c = m.face_first[f];
+      unsigned int s = (split[h.edge[c]] != NONE) + (split[h.edge[c+1]] != NONE) + (split[h.edge[c+2]] != NONE);
+      first_out[f+1] = pieces[s];
+    }
+  }, 1 << 14, threads);
+  for(size_t f=0; f < num_faces; f++){ first_out[f+1] += first_out[f]; }
+
+  size_t out_faces = first_out[num_faces];
+  out.face_first.resize(out_faces+1);
+  out.corner_point.resize(3*out_faces);
+  out.corner_uv.resize(with_uvs ? 3*out_faces : 0);
+  Parallel::forRange(out_faces+1, [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){ out.face_first[f] = (unsigned int)(3*f); }
+  }, 1 << 16, threads);
+
+  Parallel::forRange(num_faces, [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){
+      unsigned int c = m.face_first[f];
+      unsigned int P[3], M[3];
+      vec2 U[3], MU[3];
+      bool S[3];
+      for(int k=0; k < 3; k++){
+        P[k] = cp[c+k];
+        M[k] = split[h.edge[c+k]];
+        S[k] = M[k] != NONE;
+        if( with_uvs ){
+          U[k] = m.corner_uv[c+k];
+          MU[k] = (m.corner_uv[c+k] + m.corner_uv[c + (k+1)%3])*0.5f;
+        }
+      }
+      unsigned int o = 3*first_out[f];
+      auto emit = [&](unsigned int a, const vec2 &ua, unsigned int b, const vec2 &ub, unsigned int d, const vec2 &ud){
+        out.corner_point[o] = a; out.corner_point[o+1] = b; out.corner_point[o+2] = d;
+        if( with_uvs ){ out.corner_uv[o] = ua; out.corner_uv[o+1] = ub; out.corner_uv[o+2] = ud; }
+        o += 3;
+      };
+      int s = S[0] + S[1] + S[2];
+      if( s == 0 ){
+        emit(P[0], U[0], P[1], U[1], P[2], U[2]);
+      }else if( s == 3 ){
+        emit(P[0], U[0], M[0], MU[0], M[2], MU[2]);
+        emit(M[0], MU[0], P[1], U[1], M[1], MU[1]);
+        emit(M[2], MU[2], M[1], MU[1], P[2], U[2]);
+        emit(M[0], MU[0], M[1], MU[1], M[2], MU[2]);
+      }else if( s == 1 ){
+        int k = S[0] ? 0 : S[1] ? 1 : 2;
+        int k1 = (k+1)%3, k2 = (k+2)%3;
+        emit(P[k], U[k], M[k], MU[k], P[k2], U[k2]);
+        emit(M[k], MU[k], P[k1], U[k1], P[k2], U[k2]);
+      }else{
+        int j = !S[0] ? 0 : !S[1] ? 1 : 2;
+        int j1 = (j+1)%3, j2 = (j+2)%3;
+        emit(M[j1], MU[j1], P[j2], U[j2], M[j2], MU[j2]);
+        emit(P[j], U[j], P[j1], U[j1], M[j1], MU[j1]);
+        emit(P[j], U[j], M[j1], MU[j1], M[j2], MU[j2]);
+      }
+    }
+  }, 1 << 12, threads);
+}
+
+//One Catmull-Clark level; points are the old ones, then edges, then faces
+static void catmullClarkLevel(const PolyMesh &m, const HalfEdges &h, unsigned int threads, PolyMesh &out){
+  const std::vector< unsigned int > &cp = m.corner_point;
+  bool with_uvs = !m.corner_uv.empty();
+  size_t num_points = m.points.size(), num_edges = h.edge_corner.size(), num_faces = m.faces();
+  size_t edge_base = num_points, face_base = num_points + num_edges;
+  out.points.resize(num_points + num_edges + num_faces);
+
+  //Face points: centroids
+  Parallel::forRange(num_faces, [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){
+      vec3 sum(0,0,0);
+      for(unsigned int c=m.face_first[f]; c < m.face_first[f+1]; c++){ sum += m.points[cp[c]]; }
+      out.points[face_base + f] = sum/float(m.face_first[f+1] - m.face_first[f]);
+    }
+  }, 1 << 14, threads);
+
+  //Edge points: ends and the two face points, midpoints on boundaries
+  Parallel::forRange(num_edges, [&](size_t b, size_t e, unsigned int){
+    for(size_t edge=b; edge < e; edge++){
+      unsigned int c = h.edge_corner[edge];
+      vec3 ends = m.points[cp[c]] + m.points[cp[nextCorner(m, h, c)]];
+      if( h.twin[c] == NONE ){
+        out.points[edge_base + edge] = ends*0.5f;
+      }else{
+        out.points[edge_base + edge] = (ends + out.points[face_base + h.face[c]] +
+                                        out.points[face_base + h.face[h.twin[c]]])*0.25f;
+      }
+    }
+  }, 1 << 14, threads);
+
+  //Vertex points: (Q + 2R + (n-3)P)/n, or the boundary curve rule
+  Parallel::forRange(num_points, [&](size_t b, size_t e, unsigned int){
+    for(size_t p=b; p < e; p++){
+      out.points[p] = m.points[p];
+      vec3 ring, boundary_ring;
+      unsigned int boundary;
+      unsigned int n = pointRing(m, h, (unsigned int) p, ring, boundary_ring, boundary);
+      if( boundary == 2 ){
+        out.points[p] = m.points[p]*0.75f + boundary_ring*0.125f;
+      }else if( boundary == 0 && n >= 3 ){
+        vec3 q(0,0,0);
+        for(unsigned int i=h.around_first[p]; i < h.around_first[p+1]; i++){
+          q += out.points[face_base + h.face[h.around[i]]];
+        }
+        //Edge midpoints average to (P + ring/n)/2
+        vec3 r = (m.points[p] + ring/float(n))*0.5f;
+        out.points[p] = (q/float(n) + r*2.0f + m.points[p]*float(n - 3))/float(n);
+      }
+    }
+  }, 1 << 12, threads);
+
+  //A quad for every corner: the corner, its edge, the face, the edge before
+  size_t num_corners = cp.size();
+  out.face_first.resize(num_corners+1);
+  out.corner_point.resize(4*num_corners);
+  out.corner_uv.resize(with_uvs ? 4*num_corners : 0);
+  Parallel::forRange(num_faces, [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){
+      unsigned int first = m.face_first[f], last = m.face_first[f+1];
+      vec2 face_uv(0,0);
+      if( with_uvs ){
+        for(unsigned int c=first; c < last; c++){ face_uv += m.corner_uv[c]; }
+        face_uv /= float(last - first);
+      }
+      for(unsigned int c=first; c < last; c++){
+        unsigned int prev = (c > first) ? c-1 : last-1;
+        unsigned int next = (c+1 < last) ? c+1 : first;
+        unsigned int o = 4*c;
+        out.face_first[c] = o;
+        out.corner_point[o]   = cp[c];
+        out.corner_point[o+1] = (unsigned int)(edge_base + h.edge[c]);
+        out.corner_point[o+2] = (unsigned int)(face_base + f);
+        out.corner_point[o+3] = (unsigned int)(edge_base + h.edge[prev]);
+        if( with_uvs ){
+          out.corner_uv[o]   = m.corner_uv[c];
+          out.corner_uv[o+1] = (m.corner_uv[c] + m.corner_uv[next])*0.5f;
+          out.corner_uv[o+2] = face_uv;
+          out.corner_uv[o+3] = (m.corner_uv[c] + m.corner_uv[prev])*0.5f;
+        }
+      }
+    }
+  }, 1 << 12, threads);
+  out.face_first[num_corners] = (unsigned int)(4*num_corners);
+}
+
+//Weld the mesh's vertices on exact position
+static void toPolyMesh(const Mesh &mesh, PolyMesh &m){
+  struct PositionHash{
+    size_t operator()(const vec3 &p) const {
+      uint32_t b[3];
+      memcpy(b, &p, sizeof(b));
+      return (size_t)(b[0]*73856093u ^ b[1]*19349663u ^ b[2]*83492791u);
+    }
+  };
+  struct PositionEqual{
+    bool operator()(const vec3 &a, const vec3 &b) const { return memcmp(&a, &b, sizeof(vec3)) == 0; }
+  };
+  std::unordered_map< vec3, unsigned int, PositionHash, PositionEqual > welded;
+  welded.reserve(mesh.vertices.size());
+  std::vector< unsigned int > point_of(mesh.vertices.size());
+  m.points.clear();
+  for(size_t v=0; v < mesh.vertices.size(); v++){
+    vec3 p(mesh.vertices[v].x, mesh.vertices[v].y, mesh.vertices[v].z);
+    std::pair< std::unordered_map< vec3, unsigned int, PositionHash, PositionEqual >::iterator, bool > at =
+      welded.insert(std::make_pair(p, (unsigned int) m.points.size()));
+    if( at.second ){ m.points.push_back(p); }
+    point_of[v] = at.first->second;
+  }
+
+  bool with_uvs = mesh.hasUV && mesh.uvs.size() >= mesh.vertices.size();
+  size_t num_faces = mesh.indices.size()/3;
+  m.face_first.resize(num_faces+1);
+  m.corner_point.resize(3*num_faces);
+  m.corner_uv.resize(with_uvs ? 3*num_faces : 0);
+  for(size_t i=0; i < 3*num_faces; i++){
+    m.corner_point[i] = point_of[mesh.indices[i]];
+    if( with_uvs ){ m.corner_uv[i] = mesh.uvs[mesh.indices[i]]; }
+  }
+  for(size_t f=0; f <= num_faces; f++){ m.face_first[f] = (unsigned int)(3*f); }
+}
+
+//Triangulate m back into mesh: one vertex per distinct (point, uv), area
+//and angle weighted normals per point
+static void toMesh(const PolyMesh &m, unsigned int threads, Mesh &mesh){
+  HalfEdges h;
+  h.face.resize(m.corner_point.size());
+  for(size_t f=0; f < m.faces(); f++){
+    for(unsigned int c=m.face_first[f]; c < m.face_first[f+1]; c++){ h.face[c] = (unsigned int) f; }
+  }
+  cornersAround(m, threads, h);
+  bool with_uvs = !m.corner_uv.empty();
+  size_t num_points = m.points.size();
+
+  //Newell normals of the faces, scaled to twice their area
+  std::vector< vec3 > face_normals(m.faces());
+  Parallel::forRange(m.faces(), [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){
+      vec3 n(0,0,0);
+      for(unsigned int c=m.face_first[f]; c < m.face_first[f+1]; c++){
+        const vec3 &a = m.points[m.corner_point[c]];
+        const vec3 &d = m.points[m.corner_point[nextCorner(m, h, c)]];
+        n += vec3((a.y - d.y)*(a.z + d.z), (a.z - d.z)*(a.x + d.x), (a.x - d.x)*(a.y + d.y));
+      }
+      face_normals[f] = n;
+    }
+  }, 1 << 14, threads);
+
+  //Per point: the normal, and the distinct uvs of its corners
+  std::vector< vec3 > point_normals(num_points);
+  std::vector< unsigned int > vertex_of(m.corner_point.size());
+  std::vector< unsigned int > first_vertex(num_points+1, 0);
+  Parallel::forRange(num_points, [&](size_t b, size_t e, unsigned int){
+    for(size_t p=b; p < e; p++){
+      vec3 sum(0,0,0);
+      unsigned int distinct = 0;
+      unsigned int begin = h.around_first[p], end = h.around_first[p+1];
+      for(unsigned int i=begin; i < end; i++){
+        unsigned int c = h.around[i];
+        vec3 e1 = m.points[m.corner_point[nextCorner(m, h, c)]] - m.points[p];
+        vec3 e2 = m.points[m.corner_point[prevCorner(m, h, c)]] - m.points[p];
+        float l = length(e1)*length(e2);
+        float angle = (l > 0) ? acosf((std::max)(-1.0f, (std::min)(1.0f, dot(e1, e2)/l))) : 0.0f;
+        float area = length(face_normals[h.face[c]]);
+        if( area > 0 ){ sum += face_normals[h.face[c]]*(angle/area); }
+
+        //Local slot of the first corner with the same uv
+        vertex_of[c] = distinct;
+        for(unsigned int j=begin; j < i && with_uvs; j++){
+          if( memcmp(&m.corner_uv[h.around[j]], &m.corner_uv[c], sizeof(vec2)) == 0 ){
+            vertex_of[c] = vertex_of[h.around[j]];
+            break;
+          }
+        }
+        if( vertex_of[c] == distinct ){ distinct++; }
+      }
+      float l = length(sum);
+      point_normals[p] = (l > 0) ? sum/l : vec3(0,0,1);
+      first_vertex[p+1] = distinct;
+    }
+  }, 1 << 12, threads);
+  for(size_t p=0; p < num_points; p++){ first_vertex[p+1] += first_vertex[p]; }
+
+  size_t num_vertices = first_vertex[num_points];
+  mesh.vertices.resize(num_vertices);
+  mesh.normals.resize(num_vertices);
+  mesh.uvs.resize(with_uvs ? num_vertices : 0);
+  Parallel::forRange(num_points, [&](size_t b, size_t e, unsigned int){
+    for(size_t p=b; p < e; p++){
+      for(unsigned int i=h.around_first[p]; i < h.around_first[p+1]; i++){
+        unsigned int c = h.around[i];
+        unsigned int v = first_vertex[p] + vertex_of[c];
+        vertex_of[c] = v;
+        mesh.vertices[v] = vec4(m.points[p], 1.0);
+        mesh.normals[v] = point_normals[p];
+        if( with_uvs ){ mesh.uvs[v] = m.corner_uv[c]; }
+      }
+    }
+  }, 1 << 12, threads);
+
+  //Fans, quads across their shorter diagonal
+  std::vector< unsigned int > first_index(m.faces()+1, 0);
+  for(size_t f=0; f < m.faces(); f++){
+    first_index[f+1] = first_index[f] + 3*(m.face_first[f+1] - m.face_first[f] - 2);
+  }
+  mesh.indices.resize(first_index[m.faces()]);
+  Parallel::forRange(m.faces(), [&](size_t b, size_t e, unsigned int){
+    for(size_t f=b; f < e; f++){
+      unsigned int c = m.face_first[f], n = m.face_first[f+1] - c;
+      unsigned int *out = &mesh.indices[first_index[f]];
+      if( n == 4 && length(m.points[m.corner_point[c+1]] - m.points[m.corner_point[c+3]]) <
+                    length(m.points[m.corner_point[c]] - m.points[m.corner_point[c+2]]) ){
+        unsigned int quad[6] = { c, c+1, c+3, c+1, c+2, c+3 };
+        for(int k=0; k < 6; k++){ out[k] = vertex_of[quad[k]]; }
+        continue;
+      }
+      for(unsigned int k=1; k+1 < n; k++){
+        *out++ = vertex_of[c];
+        *out++ = vertex_of[c+k];
+        *out++ = vertex_of[c+k+1];
+      }
+    }
+  }, 1 << 12, threads);
+}
+
+static const char *schemeName(SubdivisionScheme scheme){
+  return (scheme == SUBDIVIDE_LOOP) ? "Loop" : "Catmull-Clark";
+}
+
+/**
+  Shared driver of subdivide() and subdivideAdaptive().
+  @param object_to_clip NULL for uniform refinement
+**/
+static unsigned int subdivideMesh(Mesh &mesh, SubdivisionScheme scheme, unsigned int levels, size_t max_bytes,
+                                  const mat4 *object_to_clip, float width, float height, float max_pixels,
+                                  unsigned int threads){
+  if( mesh.indices.empty() || levels == 0 ){ return 0; }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  PolyMesh m;
+  toPolyMesh(mesh, m);
+  bool with_uvs = !m.corner_uv.empty();
+  size_t bytes = levelBytes(m.points.size(), m.faces(), m.corner_point.size(), m.corner_point.size(), with_uvs);
+  printf("Subdivision (%s%s): %zu faces, %zu points, %.1f MB\n", schemeName(scheme),
+         object_to_clip ? ", adaptive" : "", m.faces(), m.points.size(), bytes/1048576.0);
+
+  unsigned int done = 0;
+  for(; done < levels; done++){
+    HalfEdges h;
+    buildHalfEdges(m, threads, h);
+    size_t num_edges = h.edge_corner.size();
+
+    //Size of the next level, known before building it
+    size_t points, faces, corners;
+    std::vector< unsigned int > split;
+    if( scheme == SUBDIVIDE_CATMULL_CLARK ){
+      points = m.points.size() + num_edges + m.faces();
+      faces = m.corner_point.size();
+      corners = 4*faces;
+    }else{
+      split.assign(num_edges, NONE);
+      Parallel::forRange(num_edges, [&](size_t b, size_t e, unsigned int){
+        for(size_t edge=b; edge < e; edge++){
+          if( object_to_clip == NULL ){ split[edge] = 0; continue; }
+          unsigned int c = h.edge_corner[edge];
+          vec4 p0 = *object_to_clip*vec4(m.points[m.corner_point[c]], 1.0);
+          vec4 p1 = *object_to_clip*vec4(m.points[m.corner_point[nextCorner(m, h, c)]], 1.0);
+          if( p0.w <= 0 || p1.w <= 0 ){ continue; }
+          float dx = (p0.x/p0.w - p1.x/p1.w)*0.5f*width;
+          float dy = (p0.y/p0.w - p1.y/p1.w)*0.5f*height;
+          if( dx*dx + dy*dy > max_pixels*max_pixels ){ split[edge] = 0; }
+        }
+      }, 1 << 14, threads);
+      points = m.points.size();
+      faces = 0;
+      for(size_t edge=0; edge < num_edges; edge++){
+        if( split[edge] != NONE ){ split[edge] = (unsigned int) points++; }
+      }
+      if( points == m.points.size() ){
+        printf("Subdivision level %u: no edge longer than %g pixels\n", done+1, max_pixels);
+        break;
+      }
+      for(size_t f=0; f < m.faces(); f++){
+        unsigned int c = m.face_first[f];
+        faces += 1 + (split[h.edge[c]] != NONE) + (split[h.edge[c+1]] != NONE) + (split[h.edge[c+2]] != NONE);
+      }
+      corners = 3*faces;
+    }
+    size_t next_bytes = levelBytes(points, faces, corners, corners, with_uvs);
+    if( next_bytes > max_bytes || points > 0xFFFFFFFFu || corners > 0xFFFFFFFFu ){
+      printf("Subdivision level %u would take %.1f MB, over the %.1f MB bound; stopping\n",
+             done+1, next_bytes/1048576.0, max_bytes/1048576.0);
+      break;
+    }
+
+    PolyMesh out;
+    if( scheme == SUBDIVIDE_CATMULL_CLARK ){
+      catmullClarkLevel(m, h, threads, out);
+    }else{
+      loopLevel(m, h, split, points, object_to_clip != NULL, threads, out);
+    }
+    std::swap(m, out);
+    printf("Subdivision level %u: %zu faces, %zu points, %.1f MB (x%.2f)\n", done+1, m.faces(),
+           m.points.size(), next_bytes/1048576.0, (double) next_bytes/bytes);
+    bytes = next_bytes;
+  }
+  if( done == 0 ){ return 0; }
+
+  toMesh(m, threads, mesh);
+  mesh.lod_indices.clear();
+  mesh.lods.clear();
+  mesh.meshlets.clear();
+  mesh.tangents.clear();
+  mesh.optimized = false;
+  mesh.box_min = vec3((std::numeric_limits< float >::max)());
+  mesh.box_max = vec3(-(std::numeric_limits< float >::max)());
+  for(size_t v=0; v < mesh.vertices.size(); v++){
+    for(int a=0; a < 3; a++){
+      mesh.box_min[a] = (std::min)(mesh.box_min[a], mesh.vertices[v][a]);
+      mesh.box_max[a] = (std::max)(mesh.box_max[a], mesh.vertices[v][a]);
+    }
+  }
+
+  double ms = std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count();
+  printf("Subdivided %u levels: %u triangles, %zu vertices in %.0f ms\n", done, mesh.getNumTri(),
+         mesh.vertices.size(), ms);
+  return done;
+}
+
+unsigned int Mesh::subdivide(SubdivisionScheme scheme, unsigned int levels, size_t max_bytes, unsigned int threads){
+  return subdivideMesh(*this, scheme, levels, max_bytes, NULL, 0, 0, 0, threads);
+}
+
+unsigned int Mesh::subdivideAdaptive(const mat4 &object_to_clip, float width, float height, float max_pixels,
+                                     unsigned int levels, size_t max_bytes, unsigned int threads){
+  return subdivideMesh(*this, SUBDIVIDE_LOOP, levels, max_bytes, &object_to_clip, width, height, max_pixels, threads);
+}
@@ -0,0 +1,96 @@
+#include "common.h"
+#include "MeshOptimize.h"
+
+#include <chrono>
+
+/*
+ * Tangent frames as MikkTSpace computes them, minus its vertex splitting:
+ * the vertices here are already welded on (position, uv, normal), so every
+ * vertex keeps exactly one frame.
+ *
+ * Per face the tangent is the direction of increasing u, taken from the
+ * positions and uvs and flipped for faces whose uvs are mirrored, which
+ * also gives the face's orientation sign.  Per vertex the tangents of the
+ * faces around it are projected into the plane of the vertex normal,
+ * normalized, and summed weighted by the corner angle measured in that
+ * same plane.
+ */
+
+//x with the n component removed, unit length or zero
+static inline vec3 projectUnit(const vec3 &x, const vec3 &n){
+  vec3 p = x - n*dot(n, x);
+  float l = length(p);
+  return (l > 0) ? p/l : vec3(0,0,0);
+}
+
+void Mesh::buildTangents(unsigned int threads){
+  tangents.clear();
+  size_t n = vertices.size();
+  if( indices.empty() || !hasUV || uvs.size() < n || normals.size() < n ){ return; }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  //Unit face tangent in xyz and the uv orientation in w (zero xyz and w
+  //for faces without a usable uv gradient)
+  size_t num_triangles = indices.size()/3;
+  std::vector< vec4 > face_tangents(num_triangles);
+  Parallel::forRange(num_triangles, [&](size_t b, size_t e, unsigned int){
+    for(size_t t=b; t < e; t++){
+      const unsigned int *f = &indices[3*t];
+      vec3 p0(vertices[f[0]].x, vertices[f[0]].y, vertices[f[0]].z);
+      vec3 d1 = vec3(vertices[f[1]].x, vertices[f[1]].y, vertices[f[1]].z) - p0;
+      vec3 d2 = vec3(vertices[f[2]].x, vertices[f[2]].y, vertices[f[2]].z) - p0;
+      vec2 st1 = uvs[f[1]] - uvs[f[0]];
+      vec2 st2 = uvs[f[2]] - uvs[f[0]];
+      float area = st1.x*st2.y - st1.y*st2.x;
+      vec3 os = d1*st2.y - d2*st1.y;
+      float l = length(os);
+      if( area == 0 || l == 0 ){
+        face_tangents[t] = vec4(0,0,0,0);
+        continue;
+      }
+      float sign = (area > 0) ? 1.0f : -1.0f;
+      face_tangents[t] = vec4(os*(sign/l), sign);
+    }
+  }, 1 << 16, threads);
+
+  VertexAdjacency adjacency(indices, n, threads);
+
+  tangents.resize(n);
+  Parallel::forRange(n, [&](size_t b, size_t e, unsigned int){
+    for(size_t v=b; v < e; v++){
+      float nl = length(normals[v]);
+      vec3 normal = (nl > 0) ? normals[v]/nl : vec3(0,0,1);
+      vec3 sum(0,0,0);
+      float orientation = 0;
+      unsigned int previous = ~0u;
+      for(unsigned int a=adjacency.offsets[v]; a < adjacency.offsets[v+1]; a++){
+        unsigned int t = adjacency.triangles[a];
+        const vec4 &ft = face_tangents[t];
+        if( t == previous || ft.w == 0 ){ continue; }
+        previous = t;
+
+        //Corner of v, with its edges in the tangent plane
+        const unsigned int *f = &indices[3*t];
+        int k = (f[0] == v) ? 0 : (f[1] == v) ? 1 : 2;
+        const vec4 &p = vertices[v];
+        const vec4 &p1 = vertices[f[(k+1)%3]];
+        const vec4 &p2 = vertices[f[(k+2)%3]];
+        vec3 e1 = projectUnit(vec3(p1.x - p.x, p1.y - p.y, p1.z - p.z), normal);
+        vec3 e2 = projectUnit(vec3(p2.x - p.x, p2.y - p.y, p2.z - p.z), normal);
+        float angle = acosf((std::max)(-1.0f, (std::min)(1.0f, dot(e1, e2))));
+
+        sum += projectUnit(vec3(ft.x, ft.y, ft.z), normal)*angle;
+        orientation += ft.w*angle;
+      }
+
+      //No uv gradient around v: any direction in the tangent plane
+      float l = length(sum);
+      vec3 tangent = (l > 0) ? sum/l
+                             : projectUnit((fabs(normal.x) < 0.9f) ? vec3(1,0,0) : vec3(0,1,0), normal);
+      tangents[v] = vec4(tangent, (orientation < 0) ? -1.0f : 1.0f);
+    }
+  }, 1 << 14, threads);
+
+  double ms = std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count();
+  printf("Mesh tangents: %zu vertices in %.0f ms\n", n, ms);
+}
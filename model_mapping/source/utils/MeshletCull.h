@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshletCull.h ---
+//
+//  CPU culling of the meshlets of one level (see Mesh::buildMeshlets)
+//  against the view frustum and by their normal cones, producing the
+//  count/offset arrays of a single glMultiDrawElements call.
+//
+//  The cone test drops clusters whose faces all point away from the eye,
+//  so like GL_CULL_FACE it assumes counter-clockwise front faces and
+//  models whose back faces are never seen.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESHLET_CULL_H__
+#define __MESHLET_CULL_H__
+
+#include "common.h"
+
+struct MeshletCullStats{
+  unsigned int meshlets;        //considered
+  unsigned int frustum_culled;
+  unsigned int backface_culled;
+  unsigned int draws;           //ranges left after merging neighbours
+
+  MeshletCullStats() : meshlets(0), frustum_culled(0), backface_culled(0), draws(0) {}
+};
+
+//The six clip planes of projection*model_view in object space, xyz normalized
+inline void frustumPlanes(const mat4 &model_view_projection, vec4 planes[6]){
+  const mat4 &m = model_view_projection;
+  for(int axis=0; axis < 3; axis++){
+    planes[2*axis]   = m[3] + m[axis];
+    planes[2*axis+1] = m[3] - m[axis];
+  }
+  for(int p=0; p < 6; p++){
+    float l = length(vec3(planes[p].x, planes[p].y, planes[p].z));
+    if( l > 0 ){ planes[p] /= l; }
+  }
+}
+
+/**
+  Is any part of the meshlet possibly visible?
+  @param eye camera position in object space
+**/
+inline bool meshletVisible(const Meshlet &m, const vec4 planes[6], const vec3 &eye, MeshletCullStats &stats){
+  for(int p=0; p < 6; p++){
+    if( dot(vec3(planes[p].x, planes[p].y, planes[p].z), m.center) + planes[p].w < -m.radius ){
+      stats.frustum_culled++;
+      return false;
+    }
+  }
+  //Back facing when every direction from the eye into the sphere lies
+  //within 90 degrees of every normal in the cone
+  vec3 view = m.center - eye;
+  float distance = length(view);
+  if( dot(view, m.cone_axis) > m.cone_cutoff*distance + m.radius*(1.0f + m.cone_cutoff) ){
+    stats.backface_culled++;
+    return false;
+  }
+  return true;
+}
+
+/**
+  Replace counts/offsets with the index ranges of the visible meshlets of
+    lod, merging ranges that touch in the index buffer.
+  @param index_size bytes per index of the bound element buffer
+**/
+inline void cullMeshlets(const std::vector< Meshlet > &meshlets, const MeshLOD &lod,
+                         const mat4 &model_view, const mat4 &projection, size_t index_size,
+                         std::vector< GLsizei > &counts, std::vector< const GLvoid * > &offsets,
+                         MeshletCullStats &stats){
+  counts.clear();
+  offsets.clear();
+
+  vec4 planes[6];
+  frustumPlanes(projection*model_view, planes);
+  vec4 eye = invert(model_view)*vec4(0.0, 0.0, 0.0, 1.0);
+  vec3 eye_object(eye.x/eye.w, eye.y/eye.w, eye.z/eye.w);
+
+  size_t end = 0;
+  for(unsigned int i=lod.first_meshlet; i < lod.first_meshlet + lod.meshlet_count; i++){
+    const Meshlet &m = meshlets[i];
+    stats.meshlets++;
+    if( !meshletVisible(m, planes, eye_object, stats) ){ continue; }
+    if( !counts.empty() && end == m.first_index ){
+      counts.back() += m.index_count;
+    }else{
+      counts.push_back(m.index_count);
+      offsets.push_back(BUFFER_OFFSET(m.first_index*index_size));
+    }
+    end = m.first_index + m.index_count;
+  }
+  stats.draws += (unsigned int) counts.size();
+}
+
+#endif //__MESHLET_CULL_H__
@@ -1,148 +1,544 @@
 #include "common.h"
+#include "MeshCache.h"
+#include "MeshChunks.h"
+#include "AssetBundle.h"
 
+#include <chrono>
 
-bool Mesh::loadOBJ(const char * path){
-  std::vector< unsigned int > vertexIndices, uvIndices, normalIndices;
-  std::vector< vec3 > temp_vertices;
-  std::vector< vec2 > temp_uvs;
-  std::vector< vec3 > temp_normals;
-  
-  hasUV = true;
-  
-#ifdef _WIN32
-  std::wstring wcfn;
-  if ( u8names_towc(path, wcfn) != 0 ){
-    printf("Impossible to process the file name !\n");
-    return false;
-  }
-  FILE * file = _wfopen(wcfn.c_str(), L"r");
-#else
-  FILE * file = fopen(path, "r");
-#endif //_WIN32
-  if( file == NULL ){
-    printf("Impossible to open the file !\n");
-    return false;
-  }
+
+//Files smaller than this per worker are not worth splitting
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+//Everything parsed from one newline-aligned slice of the file.  Face
+//indices are zero-based; relative (negative) ones are resolved against the
+//chunk's own counts and listed in the *Fixups arrays so the chunk's global
+//offset can be added once all chunks are done.
+struct ObjChunk{
+  std::vector< vec3 > vertices;
+  std::vector< vec2 > uvs;
+  std::vector< vec3 > normals;
+  std::vector< int > vertexIndices, uvIndices, normalIndices;
+  std::vector< size_t > vertexFixups, uvFixups, normalFixups;
+  vec3 box_min, box_max;
+  bool hasUV;
+  bool hasNormals;
+  bool ok;
   
-  char *line = new char[128];
-  char *lineHeader = new char[128];
+  ObjChunk()
+    : box_min( (std::numeric_limits< float >::max)()),
+      box_max(-(std::numeric_limits< float >::max)()),
+      hasUV(true),
+      hasNormals(true),
+      ok(true) {}
+};
+
+/* turn a one-based (or negative, relative) OBJ index into a zero-based one */
+/* (adjust for size during processing of each face, as per the old
+ *  OBJ specification, instead of after the end of the file) */
+static inline int resolveIndex(int index, size_t count){
+  if( index < 0 ){ return index + (int)count; }
+  return index - 1;
+}
+
+static void parseChunk(const char *p, const char *end, ObjChunk &chunk){
+  //Face corners of the current line, reused to avoid per-line allocation
+  std::vector< int > corners;
+  //Per corner: bit 0/1/2 set when the v/vt/vn index was relative
+  std::vector< unsigned char > relative;
   
-  while(true){
-    memset(line, 0 , 128);
-    memset(lineHeader, 0 , 128);
+  while( p < end ){
+    p = ObjScan::skipSpace(p, end);
+    if( p >= end ){ break; }
     
-    if(fgets(line, 128, file) == NULL){ break; }
-    sscanf(line, "%s ", lineHeader);
+    char c0 = p[0];
+    char c1 = (p+1 < end) ? p[1] : '\n';
     
-    if ( strcmp( lineHeader, "v" ) == 0 ){
+    if ( c0 == 'v' && ObjScan::isSpace(c1) ){
       vec3 vertex;
-      sscanf(&line[2], "%f %f %f", &vertex.x, &vertex.y, &vertex.z );
-      temp_vertices.push_back(vertex);
-      if(vertex.x < box_min.x){box_min.x = vertex.x; }
-      if(vertex.y < box_min.y){box_min.y = vertex.y; }
-      if(vertex.z < box_min.z){box_min.z = vertex.z; }
-      if(vertex.x > box_max.x){box_max.x = vertex.x; }
-      if(vertex.y > box_max.y){box_max.y = vertex.y; }
-      if(vertex.z > box_max.z){box_max.z = vertex.z; }
-    }else if ( strcmp( lineHeader, "vt" ) == 0 ){
+      ObjScan::parseFloats(p+2, end, &vertex.x, 3);
+      chunk.vertices.push_back(vertex);
+      if(vertex.x < chunk.box_min.x){chunk.box_min.x = vertex.x; }
+      if(vertex.y < chunk.box_min.y){chunk.box_min.y = vertex.y; }
+      if(vertex.z < chunk.box_min.z){chunk.box_min.z = vertex.z; }
+      if(vertex.x > chunk.box_max.x){chunk.box_max.x = vertex.x; }
+      if(vertex.y > chunk.box_max.y){chunk.box_max.y = vertex.y; }
+      if(vertex.z > chunk.box_max.z){chunk.box_max.z = vertex.z; }
+    }else if ( c0 == 'v' && c1 == 't' ){
       vec2 uv;
-      sscanf(&line[3], "%f %f", &uv.x, &uv.y );
-      temp_uvs.push_back(uv);
-    }else if ( strcmp( lineHeader, "vn" ) == 0 ){
+      ObjScan::parseFloats(p+2, end, &uv.x, 2);
+      chunk.uvs.push_back(uv);
+    }else if ( c0 == 'v' && c1 == 'n' ){
       vec3 normal;
-      sscanf(&line[3], "%f %f %f", &normal.x, &normal.y, &normal.z );
-      temp_normals.push_back(normal);
-    }else if ( strcmp( lineHeader, "f" ) == 0 ){
-      std::string vertex1, vertex2, vertex3;
-      int vertexIndex[3], uvIndex[3], normalIndex[3];
-      int matches = sscanf(&line[2], "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                           &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                           &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-      if (matches != 9){
-        int matches = sscanf(&line[2], "%d//%d %d//%d %d//%d\n", &vertexIndex[0], &normalIndex[0],
-                             &vertexIndex[1], &normalIndex[1],
-                             &vertexIndex[2], &normalIndex[2]);
-        if (matches == 6){
-          hasUV = false;
-        } else {
-          printf("File can't be read by our simple parser : ( Try exporting with other options\n");
-          return false;
+      ObjScan::parseFloats(p+2, end, &normal.x, 3);
+      chunk.normals.push_back(normal);
+    }else if ( c0 == 'f' && ObjScan::isSpace(c1) ){
+      corners.clear();
+      relative.clear();
+      const char *q = p+2;
+      while( true ){
+        q = ObjScan::skipSpace(q, end);
+        if( ObjScan::atLineEnd(q, end) ){ break; }
+        int idx[3];
+        q = ObjScan::parseFaceCorner(q, end, idx);
+        if( q == NULL || idx[0] == 0 ){
+          chunk.ok = false;
+          return;
         }
+        if( idx[1] == 0 ){ chunk.hasUV = false; }
+        if( idx[2] == 0 ){ chunk.hasNormals = false; }
+        corners.push_back(resolveIndex(idx[0], chunk.vertices.size()));
+        corners.push_back(resolveIndex(idx[1], chunk.uvs.size()));
+        corners.push_back(resolveIndex(idx[2], chunk.normals.size()));
+        relative.push_back((idx[0] < 0 ? 1 : 0) | (idx[1] < 0 ? 2 : 0) | (idx[2] < 0 ? 4 : 0));
+      }
+      if( corners.size() < 9 ){
+        chunk.ok = false;
+        return;
       }
       
-      /* handle negative indices */
-      /* (adjust for size during processing of each face, as per the old
-       *  OBJ specification, instead of after the end of the file) */
-      for (int negati = 0; negati < 3; negati++){
-        if (vertexIndex[negati] < 0){
-          vertexIndex[negati]+=temp_vertices.size();
-          vertexIndex[negati]++; /* <- OBJ indices are one-based */
-        }
-        if (uvIndex[negati] < 0){
-          uvIndex[negati]+=temp_uvs.size();
-          uvIndex[negati]++;
-        }
-        if (normalIndex[negati] < 0){
-          normalIndex[negati]+=temp_normals.size();
-          normalIndex[negati]++;
+      //Polygons are split into a triangle fan around the first corner,
+      //relative corners get a fixup for every triangle they end up in
+      for(size_t k=2; k < relative.size(); k++){
+        size_t tri[3] = { 0, k-1, k };
+        for(int t=0; t < 3; t++){
+          const int *corner = &corners[3*tri[t]];
+          size_t slot = chunk.vertexIndices.size();
+          if( relative[tri[t]] & 1 ){ chunk.vertexFixups.push_back(slot); }
+          if( relative[tri[t]] & 2 ){ chunk.uvFixups.push_back(slot); }
+          if( relative[tri[t]] & 4 ){ chunk.normalFixups.push_back(slot); }
+          chunk.vertexIndices.push_back(corner[0]);
+          chunk.uvIndices    .push_back(corner[1]);
+          chunk.normalIndices.push_back(corner[2]);
         }
       }
-      
-      vertexIndices.push_back(vertexIndex[0]);
-      vertexIndices.push_back(vertexIndex[1]);
-      vertexIndices.push_back(vertexIndex[2]);
-      if(hasUV){
-        uvIndices    .push_back(uvIndex[0]);
-        uvIndices    .push_back(uvIndex[1]);
-        uvIndices    .push_back(uvIndex[2]);
+    }
+    
+    p = ObjScan::skipLine(p, end);
+  }
+}
+
+//Copy a chunk's attribute array into the merged array at its offset
+template< class T >
+static void appendAt(std::vector< T > &dst, size_t offset, std::vector< T > &src){
+  std::copy(src.begin(), src.end(), dst.begin() + offset);
+  std::vector< T >().swap(src);
+}
+
+//Index tuple of one face corner
+struct CornerKey{
+  unsigned int v, t, n;
+};
+
+//Open addressing hash set mapping CornerKeys to welded vertex ids
+class CornerTable{
+public:
+  CornerTable(size_t expected) : count(0) { rehash(nextPow2(2*expected + 16)); }
+  
+  //Id of key, inserting it with next_id if it is new
+  unsigned int insert(const CornerKey &key, unsigned int next_id){
+    if( 2*(count+1) > slots.size() ){ rehash(2*slots.size()); }
+    size_t mask = slots.size()-1;
+    size_t h = hash(key) & mask;
+    while( slots[h] ){
+      const CornerKey &other = keys[slots[h]-1];
+      if( other.v == key.v && other.t == key.t && other.n == key.n ){ return slots[h]-1; }
+      h = (h+1) & mask;
+    }
+    slots[h] = next_id+1;
+    keys.push_back(key);
+    count++;
+    return next_id;
+  }
+  
+private:
+  std::vector< unsigned int > slots;  //vertex id + 1, 0 when empty
+  std::vector< CornerKey > keys;      //key of every vertex id
+  size_t count;
+  
+  static size_t nextPow2(size_t n){ size_t p = 1; while( p < n ){ p <<= 1; } return p; }
+  
+  static size_t hash(const CornerKey &k){
+    uint64_t h = (uint64_t)k.v * 0x9E3779B97F4A7C15ull;
+    h ^= ((uint64_t)k.t + (h >> 32)) * 0xC2B2AE3D27D4EB4Full;
+    h ^= ((uint64_t)k.n + (h >> 29)) * 0x165667B19E3779F9ull;
+    return (size_t)(h ^ (h >> 32));
+  }
+  
+  void rehash(size_t capacity){
+    slots.assign(capacity, 0);
+    size_t mask = capacity-1;
+    for(size_t id=0; id < keys.size(); id++){
+      size_t h = hash(keys[id]) & mask;
+      while( slots[h] ){ h = (h+1) & mask; }
+      slots[h] = (unsigned int)(id+1);
+    }
+  }
+};
+
+/**
+  Angle weighted vertex normals for faces without vn indices.  corners
+    holds the position index of every triangle corner; every corner gets
+    the normalized sum of the unit face normals around its position,
+    weighted by the corner angles, over the faces within crease_degrees of
+    its own face.  Corners of a position that end up with the same normal
+    share one entry of normals, whose index goes to normal_ids.
+  @param crease_degrees 180 or more for fully smooth normals
+**/
+static void generateNormals(const std::vector< vec3 > &positions, const std::vector< unsigned int > &corners,
+                            float crease_degrees, unsigned int threads,
+                            std::vector< vec3 > &normals, std::vector< unsigned int > &normal_ids){
+  size_t num_triangles = corners.size()/3;
+  bool smooth = crease_degrees >= 180.0f;
+  float crease_cos = cosf(crease_degrees*DegreesToRadians);
+  
+  //Unit face normals, zero for degenerate faces
+  std::vector< vec3 > face_normals(num_triangles);
+  Parallel::forRange(num_triangles, [&](size_t b, size_t e, unsigned int){
+    for(size_t t=b; t < e; t++){
+      const vec3 &p0 = positions[corners[3*t]];
+      vec3 n = cross(positions[corners[3*t+1]] - p0, positions[corners[3*t+2]] - p0);
+      float l = length(n);
+      face_normals[t] = (l > 0) ? n/l : vec3(0,0,0);
+    }
+  }, 1 << 16, threads);
+  
+  //Corners around every position, in compressed row form
+  std::vector< unsigned int > offsets, around;
+  Parallel::groupBy(corners.size(), positions.size(),
+                    [&](size_t c){ return corners[c]; }, [](size_t c){ return (unsigned int) c; },
+                    offsets, around, threads);
+  
+  //Normals of the corners around position p into out; returns the number
+  //of distinct ones, each corner's group in group (first corner of the group)
+  auto cornerNormals = [&](size_t p, std::vector< vec3 > &out, std::vector< unsigned int > &group,
+                           std::vector< vec3 > &weighted) -> unsigned int {
+    unsigned int first = offsets[p];
+    unsigned int count = offsets[p+1] - first;
+    out.assign(count, vec3(0,0,0));
+    group.resize(count);
+    weighted.resize(count);
+    if( count == 0 ){ return 0; }
+    
+    //Face normals scaled by the angle between the corner's two edges
+    vec3 all(0,0,0), axis(0,0,0);
+    for(unsigned int i=0; i < count; i++){
+      unsigned int c = around[first+i];
+      unsigned int t = c - c%3;
+      const vec3 &a = positions[corners[c]];
+      vec3 e1 = positions[corners[t + (c%3+1)%3]] - a;
+      vec3 e2 = positions[corners[t + (c%3+2)%3]] - a;
+      float l = length(e1)*length(e2);
+      float angle = (l > 0) ? acosf((std::max)(-1.0f, (std::min)(1.0f, dot(e1, e2)/l))) : 0.0f;
+      weighted[i] = face_normals[c/3]*angle;
+      all += weighted[i];
+      axis += face_normals[c/3];
+    }
+    
+    //When every face normal is within half the crease angle of their mean,
+    //no pair is split and every corner gets the full sum without the
+    //pairwise test
+    bool within = smooth;
+    if( !within && crease_cos > 0.0f && dot(axis, axis) > 0 ){
+      axis = normalize(axis);
+      float spread_cos = 1.0f;
+      for(unsigned int i=0; i < count; i++){
+        const vec3 &n = face_normals[around[first+i]/3];
+        if( dot(n, n) > 0 ){ spread_cos = (std::min)(spread_cos, dot(axis, n)); }
+      }
+      within = spread_cos > 0.0f && 2.0f*spread_cos*spread_cos - 1.0f >= crease_cos + 1e-4f;   //cos of twice the spread
+    }
+    
+    for(unsigned int i=0; i < count; i++){
+      if( within ){
+        out[i] = all;
+        continue;
+      }
+      const vec3 &n = face_normals[around[first+i]/3];
+      bool degenerate = dot(n, n) == 0;
+      vec3 sum(0,0,0);
+      for(unsigned int j=0; j < count; j++){
+        if( !degenerate && dot(n, face_normals[around[first+j]/3]) < crease_cos ){ continue; }
+        sum += weighted[j];
+      }
+      out[i] = sum;
+    }
+    
+    unsigned int distinct = 0;
+    for(unsigned int i=0; i < count; i++){
+      group[i] = i;
+      for(unsigned int j=0; j < i; j++){
+        if( group[j] == j && memcmp(&out[i], &out[j], sizeof(vec3)) == 0 ){ group[i] = j; break; }
       }
-      normalIndices.push_back(normalIndex[0]);
-      normalIndices.push_back(normalIndex[1]);
-      normalIndices.push_back(normalIndex[2]);
+      if( group[i] == i ){ distinct++; }
     }
+    return distinct;
+  };
+  
+  //Distinct normals of every position into its corner rows of unique, and
+  //their index within the position into normal_ids; then the positions'
+  //counts give them global ids
+  std::vector< vec3 > unique(corners.size());
+  std::vector< unsigned int > normal_first(positions.size()+1, 0);
+  normal_ids.resize(corners.size());
+  Parallel::forRange(positions.size(), [&](size_t b, size_t e, unsigned int){
+    std::vector< vec3 > out, weighted;
+    std::vector< unsigned int > group, local;
+    for(size_t p=b; p < e; p++){
+      unsigned int count = cornerNormals(p, out, group, weighted);
+      unsigned int next = 0;
+      local.resize(out.size());
+      for(unsigned int i=0; i < out.size(); i++){
+        if( group[i] == i ){
+          float l = length(out[i]);
+          unique[offsets[p] + next] = (l > 0) ? out[i]/l : vec3(0,0,1);
+          local[i] = next++;
+        }else{
+          local[i] = local[group[i]];
+        }
+        normal_ids[around[offsets[p]+i]] = local[i];
+      }
+      normal_first[p+1] = count;
+    }
+  }, 1 << 14, threads);
+  for(size_t p=0; p < positions.size(); p++){ normal_first[p+1] += normal_first[p]; }
+  
+  normals.resize(normal_first[positions.size()]);
+  Parallel::forRange(positions.size(), [&](size_t b, size_t e, unsigned int){
+    for(size_t p=b; p < e; p++){
+      unsigned int count = normal_first[p+1] - normal_first[p];
+      for(unsigned int i=0; i < count; i++){ normals[normal_first[p] + i] = unique[offsets[p] + i]; }
+      for(unsigned int i=offsets[p]; i < offsets[p+1]; i++){ normal_ids[around[i]] += normal_first[p]; }
+    }
+  }, 1 << 14, threads);
+}
+
+//Seconds since start, restarting the clock
+static double lap(std::chrono::steady_clock::time_point &start){
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration< double >(now - start).count();
+  start = now;
+  return seconds;
+}
+
+bool Mesh::loadOBJ(const char * path, unsigned int threads, float crease_degrees, ObjLoadTimings *timings){
+  std::chrono::steady_clock::time_point stage = std::chrono::steady_clock::now();
+  ObjLoadTimings times;
+  hasUV = true;
+  bool hasNormals = true;
+  optimized = false;
+  vertices.clear();
+  normals.clear();
+  uvs.clear();
+  tangents.clear();
+  indices.clear();
+  lod_indices.clear();
+  lods.clear();
+  meshlets.clear();
+  
+  MappedFile file;
+  if( !file.open(path) ){
+    printf("Impossible to open the file !\n");
+    return false;
+  }
+  
+  const char *begin = file.data;
+  const char *end   = file.data + file.size;
+  
+  //Split the file into newline-aligned chunks, one per worker
+  if( threads == 0 ){ threads = Parallel::workerCount(); }
+  size_t nchunks = (std::min)((size_t)threads, file.size/MIN_CHUNK_BYTES);
+  if( nchunks < 1 ){ nchunks = 1; }
+  
+  std::vector< const char * > cuts(nchunks+1);
+  cuts[0] = begin;
+  cuts[nchunks] = end;
+  for(size_t k=1; k < nchunks; k++){
+    cuts[k] = ObjScan::skipLine(begin + file.size*k/nchunks, end);
+    if( cuts[k] < cuts[k-1] ){ cuts[k] = cuts[k-1]; }
+  }
+  
+  std::vector< ObjChunk > chunks(nchunks);
+  Parallel::forRange(nchunks, [&](size_t b, size_t e, unsigned int){
+    for(size_t k=b; k < e; k++){ parseChunk(cuts[k], cuts[k+1], chunks[k]); }
+  }, 1, threads);
+  
+  //Prefix sums give every chunk its offset into the merged arrays
+  std::vector< size_t > vertexOffset(nchunks+1, 0), uvOffset(nchunks+1, 0),
+                        normalOffset(nchunks+1, 0), cornerOffset(nchunks+1, 0);
+  for(size_t k=0; k < nchunks; k++){
+    if( !chunks[k].ok ){
+      printf("File can't be read by our simple parser : ( Try exporting with other options\n");
+      return false;
+    }
+    vertexOffset[k+1] = vertexOffset[k] + chunks[k].vertices.size();
+    uvOffset[k+1]     = uvOffset[k]     + chunks[k].uvs.size();
+    normalOffset[k+1] = normalOffset[k] + chunks[k].normals.size();
+    cornerOffset[k+1] = cornerOffset[k] + chunks[k].vertexIndices.size();
+    
+    if( !chunks[k].vertexIndices.empty() ){
+      hasUV = hasUV && chunks[k].hasUV;
+      hasNormals = hasNormals && chunks[k].hasNormals;
+    }
+    if(chunks[k].box_min.x < box_min.x){box_min.x = chunks[k].box_min.x; }
+    if(chunks[k].box_min.y < box_min.y){box_min.y = chunks[k].box_min.y; }
+    if(chunks[k].box_min.z < box_min.z){box_min.z = chunks[k].box_min.z; }
+    if(chunks[k].box_max.x > box_max.x){box_max.x = chunks[k].box_max.x; }
+    if(chunks[k].box_max.y > box_max.y){box_max.y = chunks[k].box_max.y; }
+    if(chunks[k].box_max.z > box_max.z){box_max.z = chunks[k].box_max.z; }
   }
   
-  delete[] line;
-  delete[] lineHeader;
+  std::vector< vec3 > temp_vertices(vertexOffset[nchunks]);
+  std::vector< vec2 > temp_uvs(uvOffset[nchunks]);
+  std::vector< vec3 > temp_normals(normalOffset[nchunks]);
+  
+  Parallel::forRange(nchunks, [&](size_t b, size_t e, unsigned int){
+    for(size_t k=b; k < e; k++){
+      ObjChunk &chunk = chunks[k];
+      for(size_t i=0; i < chunk.vertexFixups.size(); i++){ chunk.vertexIndices[chunk.vertexFixups[i]] += (int)vertexOffset[k]; }
+      for(size_t i=0; i < chunk.uvFixups.size(); i++){     chunk.uvIndices[chunk.uvFixups[i]]         += (int)uvOffset[k]; }
+      for(size_t i=0; i < chunk.normalFixups.size(); i++){ chunk.normalIndices[chunk.normalFixups[i]] += (int)normalOffset[k]; }
+      appendAt(temp_vertices, vertexOffset[k], chunk.vertices);
+      appendAt(temp_uvs,      uvOffset[k],     chunk.uvs);
+      appendAt(temp_normals,  normalOffset[k], chunk.normals);
+    }
+  }, 1, threads);
+  
+  file.close();
   
   //    std::cout << "Read " << temp_vertices.size() << " vertices\n";
   //    std::cout << "Read " << temp_normals.size() << " normals\n";
-  //    std::cout << "Read " << vertexIndices.size()/3 << " faces\n";
+  //    std::cout << "Read " << cornerOffset[nchunks]/3 << " faces\n";
   //
   
-  // For each vertex of each triangle
-  for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-    unsigned int vertexIndex = vertexIndices[i];
-    vec4 vertex = vec4(temp_vertices[ vertexIndex-1 ], 1.0);
-    vertices.push_back(vertex);
-  }
+  //Validate every corner before welding
+  Parallel::forRange(nchunks, [&](size_t b, size_t e, unsigned int){
+    for(size_t k=b; k < e; k++){
+      ObjChunk &chunk = chunks[k];
+      for( size_t i=0; i < chunk.vertexIndices.size(); i++ ){
+        if( (unsigned int) chunk.vertexIndices[i] >= temp_vertices.size() ||
+            (hasNormals && (unsigned int) chunk.normalIndices[i] >= temp_normals.size()) ||
+            (hasUV && (unsigned int) chunk.uvIndices[i] >= temp_uvs.size()) ){
+          chunk.ok = false;
+          break;
+        }
+      }
+    }
+  }, 1, threads);
   
-  if(hasUV){
-    for( unsigned int i=0; i<uvIndices.size(); i++ ){
-      unsigned int uvIndex = uvIndices[i];
-      vec2 uv = temp_uvs[ uvIndex-1 ];
-      uvs.push_back(uv);
+  for(size_t k=0; k < nchunks; k++){
+    if( !chunks[k].ok ){
+      printf("Face index out of range in %s\n", path);
+      return false;
     }
   }
   
-  for( unsigned int i=0; i<normalIndices.size(); i++ ){
-    unsigned int normalIndex = normalIndices[i];
-    vec3 normal = temp_normals[ normalIndex-1 ];
-    normals.push_back(normal);
+  times.parse = lap(stage);
+  
+  //Faces without vn (in any part of the file) get generated normals for all
+  if( !hasNormals ){
+    std::vector< unsigned int > corners(cornerOffset[nchunks]), normal_ids;
+    Parallel::forRange(nchunks, [&](size_t b, size_t e, unsigned int){
+      for(size_t k=b; k < e; k++){
+        const std::vector< int > &v = chunks[k].vertexIndices;
+        if( !v.empty() ){ memcpy(&corners[cornerOffset[k]], &v[0], v.size()*sizeof(int)); }
+      }
+    }, 1, threads);
+    generateNormals(temp_vertices, corners, crease_degrees, threads, temp_normals, normal_ids);
+    std::vector< unsigned int >().swap(corners);
+    Parallel::forRange(nchunks, [&](size_t b, size_t e, unsigned int){
+      for(size_t k=b; k < e; k++){
+        std::vector< int > &n = chunks[k].normalIndices;
+        if( !n.empty() ){ memcpy(&n[0], &normal_ids[cornerOffset[k]], n.size()*sizeof(int)); }
+      }
+    }, 1, threads);
+    times.normals = lap(stage);
+    printf("Generated %u normals (crease %g degrees) in %.0f ms\n", (unsigned int) temp_normals.size(), crease_degrees,
+           times.normals*1000.0);
+  }
+  
+  // Weld: every distinct (v, vt, vn) tuple becomes one vertex
+  size_t expected = (std::max)(temp_vertices.size(), (std::max)(temp_uvs.size(), temp_normals.size()));
+  CornerTable table(expected);
+  indices.resize(cornerOffset[nchunks]);
+  vertices.reserve(expected);
+  normals.reserve(expected);
+  if(hasUV){ uvs.reserve(expected); }
+  
+  for(size_t k=0; k < nchunks; k++){
+    ObjChunk &chunk = chunks[k];
+    unsigned int *out = indices.empty() ? NULL : &indices[cornerOffset[k]];
+    for( size_t i=0; i < chunk.vertexIndices.size(); i++ ){
+      CornerKey key = { (unsigned int) chunk.vertexIndices[i],
+                        hasUV ? (unsigned int) chunk.uvIndices[i] : 0u,
+                        (unsigned int) chunk.normalIndices[i] };
+      unsigned int id = table.insert(key, (unsigned int) vertices.size());
+      if( id == vertices.size() ){
+        vertices.push_back(vec4(temp_vertices[ key.v ], 1.0));
+        normals.push_back(temp_normals[ key.n ]);
+        if(hasUV){ uvs.push_back(temp_uvs[ key.t ]); }
+      }
+      out[i] = id;
+    }
+    std::vector< int >().swap(chunk.vertexIndices);
+    std::vector< int >().swap(chunk.uvIndices);
+    std::vector< int >().swap(chunk.normalIndices);
   }
   
   //    std::cout << "Total " << vertices.size() << " vertices\n";
   //    std::cout << "Total " << normals.size() << " normals\n";
   
   
+  times.deindex = lap(stage);
+  if( timings ){ *timings = times; }
+  
   center = box_min+(box_max-box_min)/2.0;
   scale = (std::max)(box_max.x - box_min.x, box_max.y-box_min.y);
+  updateModelView();
   
+  return true;
+}
+
+void Mesh::updateModelView(){
   model_view = Scale(1.0/scale,           //Make the extents 0-1
                      1.0/scale,
                      1.0/scale)*
   Translate(-center);  //Orient Model About Center
+}
+
+bool Mesh::load(const char * path, bool optimize_mesh, bool build_lods, bool build_meshlets){
+  std::string bundle_path, name;
+  if( splitAssetPath(path, bundle_path, name) ){
+    if( !loadAsset(bundle_path.c_str(), name.c_str()) ){ return false; }
+    if( optimize_mesh && !optimized ){ optimize(); }
+    if( build_lods && lods.empty() ){ buildLODs(defaultLODRatios()); }
+    if( build_meshlets && meshlets.empty() ){ buildMeshlets(); }
+    if( hasUV && tangents.empty() ){ buildTangents(); }
+    return true;
+  }
   
+  std::string chunks_path;
+  unsigned int chunk;
+  if( splitChunkPath(path, chunks_path, chunk) ){
+    if( !loadChunk(chunks_path.c_str(), chunk) ){ return false; }
+    if( optimize_mesh ){ optimize(); }
+    if( build_lods ){ buildLODs(defaultLODRatios()); }
+    if( build_meshlets ){ buildMeshlets(); }
+    if( hasUV ){ buildTangents(); }
+    return true;
+  }
+  
+  bool cached = loadCache(path);
+  if( cached && (optimized || !optimize_mesh) && (!lods.empty() || !build_lods) &&
+      (!meshlets.empty() || !build_meshlets) && (!tangents.empty() || !hasUV) ){ return true; }
   
+  //A current cache missing a pass only needs that pass
+  if( !cached && !loadOBJ(path) ){ return false; }
+  if( optimize_mesh && !optimized ){ optimize(); }
+  if( build_lods && lods.empty() ){ buildLODs(defaultLODRatios()); }
+  if( build_meshlets && meshlets.empty() ){ buildMeshlets(); }
+  if( hasUV && tangents.empty() ){ buildTangents(); }
+  if( !saveCache(path) ){
+    printf("Could not write mesh cache %s\n", meshCachePath(path).c_str());
+  }
   return true;
 }
@@ -8,6 +8,40 @@
 
 using namespace Angel;
 
+//One level of detail: a range of the mesh's indices followed by its lod_indices
+struct MeshLOD{
+  unsigned int first_index;
+  unsigned int index_count;
+  float error;                //object space distance the level may deviate by
+  unsigned int first_meshlet; //the level's clusters, see buildMeshlets()
+  unsigned int meshlet_count;
+};
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+//A spatially compact cluster of triangles: one contiguous index range of a level
+struct Meshlet{
+  unsigned int first_index;   //indexes indices followed by lod_indices, like MeshLOD
+  unsigned int index_count;
+  vec3 center;                //bounding sphere of the vertices, object space
+  float radius;
+  vec3 cone_axis;             //every face normal lies within the cone around cone_axis
+  float cone_cutoff;          //sine of the cone half angle, 1 when too wide to ever cull
+};
+
+//Refinement rules of Mesh::subdivide()
+enum SubdivisionScheme{ SUBDIVIDE_LOOP, SUBDIVIDE_CATMULL_CLARK };
+
+//Wall time of the stages of one loadOBJ() call, in seconds
+struct ObjLoadTimings{
+  double parse;     //map, tokenize and merge the per-thread slices, validate indices
+  double normals;   //generate missing normals, 0 when the file has them
+  double deindex;   //weld (v, vt, vn) tuples into indexed vertices
+  
+  ObjLoadTimings() : parse(0), normals(0), deindex(0) {}
+};
+
 class Mesh{
 public:
   bool hasUV;
@@ -15,6 +49,24 @@ public:
   std::vector < vec2 > uvs;
   std::vector < vec3 > normals;
   
+  //Unit tangent in xyz, bitangent = w*cross(normal, tangent), see
+  //buildTangents(); empty unless built
+  std::vector < vec4 > tangents;
+  
+  //Triangle list into the (welded, unique) vertex arrays above
+  std::vector < unsigned int > indices;
+  
+  //Coarser levels of detail over the same vertices, see buildLODs().
+  //lods[0] is the full mesh, empty until LODs are built
+  std::vector < unsigned int > lod_indices;
+  std::vector < MeshLOD > lods;
+  
+  //Clusters of every level, empty until meshlets are built
+  std::vector < Meshlet > meshlets;
+  
+  //Triangle and vertex order were rebuilt by optimize()
+  bool optimized;
+  
   vec3 box_min;
   vec3 box_max;
   vec3 center;
@@ -22,18 +74,129 @@ public:
   
   mat4 model_view;
   
-  Mesh(const char * path)
-    : box_min((std::numeric_limits< float >::max)(),
+  Mesh(const char * path) : Mesh() { load(path); }
+  
+  //Empty mesh to fill with loadOBJ(), loadCache(), loadChunk() or loadAsset()
+  Mesh()
+    : hasUV(false),
+    optimized(false),
+    box_min((std::numeric_limits< float >::max)(),
               (std::numeric_limits< float >::max)(),
               (std::numeric_limits< float >::max)() ),
     box_max(0,0,0),
     center(0,0,0),
     scale(1.0),
-    model_view(){ loadOBJ(path); }
+    model_view(){}
   
-  unsigned int getNumTri(){ return vertices.size()/3; }
+  unsigned int getNumTri(){ return indices.size()/3; }
 
-  bool loadOBJ(const char * path);
+  /**
+    Load an OBJ file, polygons are split into triangle fans.  Large files
+      are split at line boundaries and parsed on several threads.  Files
+      with "v" or "v/vt" faces get angle weighted normals.
+    @param threads worker threads to use, 0 for one per hardware thread
+    @param crease_degrees generated normals do not smooth across faces
+      meeting at a sharper angle than this; 180 smooths everything
+    @param timings if not NULL, receives the time spent in each stage
+  **/
+  bool loadOBJ(const char * path, unsigned int threads=0, float crease_degrees=180.0f,
+               ObjLoadTimings *timings=NULL);
+  
+  /**
+    Load from the binary cache next to the OBJ when it is up to date,
+      otherwise parse the OBJ and (re)write the cache.  Paths of the form
+      "model.meshchunks#<chunk>" load one chunk (see MeshChunks.h) and run
+      the passes on it without caching; "assets.bundle#<name>" load a mesh
+      baked by assetc.
+    @param optimize_mesh run optimize() before the cache is baked
+    @param build_lods run buildLODs(defaultLODRatios()) before the cache is baked
+    @param build_meshlets run buildMeshlets() before the cache is baked
+    Meshes with uvs also get buildTangents().
+  **/
+  bool load(const char * path, bool optimize_mesh=true, bool build_lods=true, bool build_meshlets=true);
+  
+  //Binary .meshbin cache, see MeshCache.h
+  bool loadCache(const char * obj_path);
+  bool saveCache(const char * obj_path) const;
+  
+  //.meshbin contents already in memory; the source fingerprint is not checked
+  bool readCache(const char * data, size_t size);
+  
+  //Write the .meshbin contents at the current position of file
+  bool writeCache(FILE * file, uint64_t source_size=0, int64_t source_mtime=0, uint64_t source_hash=0) const;
+  
+  //A mesh baked into an asset bundle by assetc, see AssetBundle.h
+  bool loadAsset(const char * bundle_path, const char * name);
+  
+  //One chunk of a .meshchunks file, framed by the whole model's center and scale
+  bool loadChunk(const char * chunks_path, unsigned int chunk);
+  
+  /**
+    Reorder triangles for the post-transform vertex cache (Tipsify), then
+      triangle clusters for overdraw, then vertices for fetch locality.
+      Prints ACMR/ATVR before and after.
+  **/
+  void optimize();
+  
+  /**
+    Build the LOD chain by quadric edge collapse (see MeshSimplify.cpp).
+      Each level keeps a subset of the vertices, so all levels share the
+      vertex arrays and differ only in their index range.
+    @param ratios triangle counts relative to the full mesh, descending
+    @param threads workers for the partitioned passes, 0 for all cores
+  **/
+  void buildLODs(const std::vector< float > &ratios, unsigned int threads=0);
+  
+  //Halving down to 1/32 of the triangles
+  static std::vector< float > defaultLODRatios();
+  
+  /**
+    Split every level into meshlets of at most MESHLET_MAX_VERTICES vertices
+      and MESHLET_MAX_TRIANGLES triangles (see MeshCluster.cpp).  Triangles
+      are regrouped inside each level's index range so every meshlet is
+      contiguous.  Adds lods[0] for the full mesh when there are no LODs.
+  **/
+  void buildMeshlets();
+  
+  /**
+    Per-vertex tangent frames for normal mapping, following MikkTSpace on
+      the welded vertices: every face's tangent from its uv gradient is
+      projected into the plane of the vertex normal and averaged weighted
+      by the corner angle; the bitangent sign is the weighted majority of
+      the faces' uv orientations.  Faces are processed in parallel, each
+      vertex then sums its faces in triangle order, so results do not
+      depend on the number of threads.  Needs uvs and normals.
+    @param threads workers, 0 for all cores
+  **/
+  void buildTangents(unsigned int threads=0);
+  
+  /**
+    Replace the mesh by its subdivision surface (see MeshSubdivide.cpp),
+      with normals recomputed and LODs, meshlets and tangents dropped.
+      Every level prints its size and growth; levels that would take more
+      than max_bytes are not built.
+    @param scheme Loop splits every triangle in four, Catmull-Clark turns
+      the welded polygons into quads
+    @param threads workers, 0 for all cores
+    @return levels built
+  **/
+  unsigned int subdivide(SubdivisionScheme scheme, unsigned int levels, size_t max_bytes, unsigned int threads=0);
+  
+  /**
+    Loop subdivision of only the edges longer than max_pixels on screen.
+      Edges behind the eye stay whole; a level without long edges ends the
+      refinement early.
+    @param object_to_clip projection*view*model_view of the mesh
+    @param width, height viewport size in pixels
+  **/
+  unsigned int subdivideAdaptive(const mat4 &object_to_clip, float width, float height, float max_pixels,
+                                 unsigned int levels, size_t max_bytes, unsigned int threads=0);
+  
+  //Average cache miss ratio per triangle and per unique vertex
+  void vertexCacheStats(float &acmr, float &atvr) const;
+  
+  //Rebuild model_view from center and scale
+  void updateModelView();
   
   friend std::ostream& operator << ( std::ostream& os, const Mesh& v ) {
     os << "Vertices:\n";
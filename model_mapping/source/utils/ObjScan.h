@@ -0,0 +1,149 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- ObjScan.h ---
+//
+//  In-place tokenizer helpers for OBJ text.  Every function takes the
+//  current position and the end of the buffer and never reads past it, so
+//  they work directly on a MappedFile (which is not null terminated).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OBJ_SCAN_H__
+#define __OBJ_SCAN_H__
+
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+
+namespace ObjScan {
+
+  inline bool isSpace(char c){ return c == ' ' || c == '\t' || c == '\r'; }
+  inline bool isDigit(char c){ return (unsigned char)(c - '0') < 10; }
+
+  //Skip blanks, stopping at end of line
+  inline const char * skipSpace(const char *p, const char *end){
+    while( p < end && isSpace(*p) ){ p++; }
+    return p;
+  }
+
+  //Advance past the next '\n' (or to end)
+  inline const char * skipLine(const char *p, const char *end){
+    while( p < end && *p != '\n' ){ p++; }
+    return (p < end) ? p+1 : end;
+  }
+
+  inline bool atLineEnd(const char *p, const char *end){
+    return p >= end || *p == '\n' || *p == '#';
+  }
+
+  //Parse a signed decimal integer, returns NULL if no digits were found
+  inline const char * parseInt(const char *p, const char *end, int &out){
+    bool neg = false;
+    if( p < end && (*p == '-' || *p == '+') ){ neg = (*p == '-'); p++; }
+    if( p >= end || !isDigit(*p) ){ return NULL; }
+    int v = 0;
+    while( p < end && isDigit(*p) ){ v = v*10 + (*p - '0'); p++; }
+    out = neg ? -v : v;
+    return p;
+  }
+
+  //Uncommon spellings (nan, inf, hex floats, absurd digit counts) are
+  //copied out and handed to strtod so results always match the C library
+  inline const char * parseFloatSlow(const char *p, const char *end, float &out){
+    char buf[64];
+    int n = 0;
+    while( p+n < end && n < 63 && !isSpace(p[n]) && p[n] != '\n' && p[n] != '/' ){
+      buf[n] = p[n]; n++;
+    }
+    buf[n] = '\0';
+    char *stop;
+    double d = strtod(buf, &stop);
+    if( stop == buf ){ return NULL; }
+    out = (float) d;
+    return p + (stop - buf);
+  }
+
+  //Parse a decimal float ("-1.25e-3").  Returns NULL if nothing was parsed
+  inline const char * parseFloat(const char *p, const char *end, float &out){
+    static const double pow10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char *start = p;
+    bool neg = false;
+    if( p < end && (*p == '-' || *p == '+') ){ neg = (*p == '-'); p++; }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while( p < end && isDigit(*p) ){
+      if( digits < 19 ){ mantissa = mantissa*10 + (*p - '0'); digits++; }
+      else { exponent++; }
+      p++;
+    }
+    bool any = (p != start && isDigit(p[-1]));
+    if( p < end && *p == '.' ){
+      p++;
+      while( p < end && isDigit(*p) ){
+        if( digits < 19 ){ mantissa = mantissa*10 + (*p - '0'); digits++; exponent--; }
+        p++;
+        any = true;
+      }
+    }
+    if( !any ){ return parseFloatSlow(start, end, out); }
+
+    if( p < end && (*p == 'e' || *p == 'E') ){
+      int e = 0;
+      const char *q = parseInt(p+1, end, e);
+      if( q == NULL ){ return parseFloatSlow(start, end, out); }
+      exponent += e;
+      p = q;
+    }
+
+    double v = (double) mantissa;
+    if( exponent < 0 ){
+      if( exponent < -22 ){ return parseFloatSlow(start, end, out); }
+      v /= pow10[-exponent];
+    }else if( exponent > 0 ){
+      if( exponent > 22 ){ return parseFloatSlow(start, end, out); }
+      v *= pow10[exponent];
+    }
+    out = (float)(neg ? -v : v);
+    return p;
+  }
+
+  //Parse one "v/vt/vn", "v//vn", "v/vt" or "v" face corner in place.
+  //idx receives the raw (one-based, possibly negative) indices, 0 if absent.
+  inline const char * parseFaceCorner(const char *p, const char *end, int idx[3]){
+    idx[0] = idx[1] = idx[2] = 0;
+    p = parseInt(p, end, idx[0]);
+    if( p == NULL ){ return NULL; }
+    if( p < end && *p == '/' ){
+      p++;
+      if( p < end && *p != '/' ){
+        p = parseInt(p, end, idx[1]);
+        if( p == NULL ){ return NULL; }
+      }
+      if( p < end && *p == '/' ){
+        p = parseInt(p+1, end, idx[2]);
+        if( p == NULL ){ return NULL; }
+      }
+    }
+    return p;
+  }
+
+  //Read up to n whitespace separated floats, missing trailing values stay 0
+  inline const char * parseFloats(const char *p, const char *end, float *out, int n){
+    for(int i=0; i < n; i++){
+      p = skipSpace(p, end);
+      if( atLineEnd(p, end) ){ break; }
+      const char *q = parseFloat(p, end, out[i]);
+      if( q == NULL ){ break; }
+      p = q;
+    }
+    return p;
+  }
+
+}  // namespace ObjScan
+
+#endif //__OBJ_SCAN_H__
@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Parallel.h ---
+//
+//  Minimal fork/join helpers over std::thread.  Work is split into
+//  contiguous ranges so every worker streams through its own part of the
+//  arrays; the calling thread runs the first range itself.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace Parallel {
+
+  //Number of hardware threads, never less than 1
+  inline unsigned int workerCount(){
+    unsigned int n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+  }
+
+  //Number of ranges forRange() splits count into
+  inline size_t rangeCount(size_t count, size_t min_per_worker=1, unsigned int workers=0){
+    if( workers == 0 ){ workers = workerCount(); }
+    if( min_per_worker == 0 ){ min_per_worker = 1; }
+    size_t n = (count + min_per_worker - 1) / min_per_worker;
+    return (n > workers) ? workers : n;
+  }
+
+  /**
+    Call fn(begin, end, worker) on disjoint ranges covering [0, count).
+    @param min_per_worker ranges smaller than this are not split further
+    @param workers number of workers to use, 0 for workerCount()
+  **/
+  template< class F >
+  void forRange(size_t count, F fn, size_t min_per_worker=1, unsigned int workers=0){
+    if( count == 0 ){ return; }
+    size_t n = rangeCount(count, min_per_worker, workers);
+    if( n <= 1 ){
+      fn((size_t)0, count, 0u);
+      return;
+    }
+
+    std::vector< std::thread > pool;
+    pool.reserve(n-1);
+    for(size_t w=1; w < n; w++){
+      size_t b = count*w/n;
+      size_t e = count*(w+1)/n;
+      pool.push_back(std::thread(fn, b, e, (unsigned int)w));
+    }
+    fn((size_t)0, count/n, 0u);
+    for(size_t w=0; w < pool.size(); w++){ pool[w].join(); }
+  }
+
+  /**
+    Counting sort of the items [0, count) into lists by key(i) < num_keys:
+      list k is items[first[k]] .. items[first[k+1]-1] and holds value(i)
+      of its items in ascending i.  Every worker counts its own slice of
+      the items into its own histogram, and later scatters the same slice
+      into the slots the histograms reserve for it, so each item is read
+      twice whatever the number of workers.
+    @param workers 0 for workerCount(); fewer are used when the histograms,
+      one per worker, would take more than four times the items
+  **/
+  template< class Key, class Value >
+  void groupBy(size_t count, size_t num_keys, Key key, Value value,
+               std::vector< unsigned int > &first, std::vector< unsigned int > &items, unsigned int workers=0){
+    const size_t min_items = 1 << 16, min_keys = 1 << 14;
+    if( workers == 0 ){ workers = workerCount(); }
+    size_t fit = num_keys ? 4*count/num_keys : workers;
+    if( fit < workers ){ workers = (unsigned int)(fit ? fit : 1); }
+    first.assign(num_keys+1, 0);
+    items.resize(count);
+    if( count == 0 ){ return; }
+
+    //slot[w*num_keys + k]: items of key k in slice w, then the offset of
+    //slice w's first one within list k
+    unsigned int slices = (unsigned int) rangeCount(count, min_items, workers);
+    std::vector< unsigned int > slot(slices*num_keys, 0);
+    forRange(count, [&](size_t b, size_t e, unsigned int w){
+      unsigned int *counts = &slot[w*num_keys];
+      for(size_t i=b; i < e; i++){ counts[key(i)]++; }
+    }, min_items, slices);
+
+    //List starts within blocks of keys, then the blocks' own offsets
+    unsigned int blocks = (unsigned int) rangeCount(num_keys, min_keys, workers);
+    std::vector< unsigned int > block_first(blocks+1, 0);
+    forRange(num_keys, [&](size_t b, size_t e, unsigned int block){
+      unsigned int running = 0;
+      for(size_t k=b; k < e; k++){
+        first[k] = running;
+        for(size_t w=0; w < slices; w++){
+          unsigned int n = slot[w*num_keys + k];
+          slot[w*num_keys + k] = running - first[k];
+          running += n;
+        }
+      }
+      block_first[block+1] = running;
+    }, min_keys, blocks);
+    for(unsigned int block=0; block < blocks; block++){ block_first[block+1] += block_first[block]; }
+    forRange(num_keys, [&](size_t b, size_t e, unsigned int block){
+      for(size_t k=b; k < e; k++){ first[k] += block_first[block]; }
+    }, min_keys, blocks);
+    first[num_keys] = (unsigned int) count;
+
+    forRange(count, [&](size_t b, size_t e, unsigned int w){
+      unsigned int *next = &slot[w*num_keys];
+      for(size_t i=b; i < e; i++){
+        size_t k = key(i);
+        items[first[k] + next[k]++] = value(i);
+      }
+    }, min_items, slices);
+  }
+
+}  // namespace Parallel
+
+#endif //__PARALLEL_H__
@@ -0,0 +1,235 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- VertexPack.h ---
+//
+//  Builds the vertex buffer contents for a mesh in one of two formats:
+//
+//    VERTEX_FLOAT    vec4 position, vec3 normal, vec2 uv         (36 bytes)
+//    VERTEX_COMPACT  unorm16x3 position against the bounding box,
+//                    octahedral snorm16x2 normal, half2 uv       (16 bytes)
+//
+//  laid out either planar (VERTEX_PLANAR, one block per attribute) or
+//  interleaved (VERTEX_INTERLEAVED, one record per vertex).
+//
+//  Compact positions are decoded in the vertex shader with
+//  PositionScale/PositionBias, normals with OctNormals (see vshader.glsl).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __VERTEX_PACK_H__
+#define __VERTEX_PACK_H__
+
+#include "common.h"
+
+#include <stdint.h>
+
+enum VertexFormat{ VERTEX_FLOAT, VERTEX_COMPACT };
+enum VertexLayout{ VERTEX_PLANAR, VERTEX_INTERLEAVED };
+
+//One glVertexAttribPointer call
+struct VertexAttrib{
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  GLsizei stride;
+  size_t offset;
+
+  VertexAttrib() : size(0), type(GL_FLOAT), normalized(GL_FALSE), stride(0), offset(0) {}
+  VertexAttrib(GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset)
+    : size(size), type(type), normalized(normalized), stride(stride), offset(offset) {}
+};
+
+struct PackedVertices{
+  std::vector< unsigned char > data;
+  VertexAttrib position, normal, uv;   //uv.size is 0 when there are no uvs
+  VertexLayout layout;
+  size_t vertex_bytes;
+
+  //Shader decode: object position = attribute.xyz*position_scale + position_bias
+  vec3 position_scale;
+  vec3 position_bias;
+  bool oct_normals;
+};
+
+//IEEE half from float, round to nearest even, flushes denormals to zero
+inline uint16_t floatToHalf(float f){
+  uint32_t x;
+  memcpy(&x, &f, 4);
+  uint32_t sign = (x >> 16) & 0x8000;
+  int32_t exponent = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+  uint32_t mantissa = x & 0x7FFFFF;
+
+  if( ((x >> 23) & 0xFF) == 0xFF ){ return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0)); }
+  if( exponent <= 0 ){ return (uint16_t) sign; }
+  if( exponent >= 31 ){ return (uint16_t)(sign | 0x7C00); }
+
+  uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1FFF;
+  if( rest > 0x1000 || (rest == 0x1000 && (half & 1)) ){ half++; }
+  return (uint16_t) half;
+}
+
+inline GLshort toSnorm16(float v){
+  v = (std::max)(-1.0f, (std::min)(1.0f, v));
+  return (GLshort) floor(v*32767.0f + 0.5f);
+}
+
+//Octahedral normal encoding (Meyer et al. 2010) into two snorm16 values
+inline void octEncode(const vec3 &n, GLshort out[2]){
+  float l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+  if( l1 == 0 ){ out[0] = out[1] = 0; return; }
+  float x = n.x/l1;
+  float y = n.y/l1;
+  if( n.z < 0 ){
+    float ox = (1.0f - fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+    float oy = (1.0f - fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+    x = ox;
+    y = oy;
+  }
+  out[0] = toSnorm16(x);
+  out[1] = toSnorm16(y);
+}
+
+//Byte address of vertex i of an attribute
+inline unsigned char *attribAt(unsigned char *base, const VertexAttrib &a, size_t element_bytes, size_t i){
+  return base + a.offset + i*(a.stride ? (size_t) a.stride : element_bytes);
+}
+
+//Bytes of one position, normal and uv (0 without uvs) in format
+inline void attribBytes(VertexFormat format, bool with_uvs, size_t &position_bytes, size_t &normal_bytes, size_t &uv_bytes){
+  if( format == VERTEX_COMPACT ){
+    position_bytes = 4*sizeof(GLushort);  //xyz plus padding to 8 bytes
+    normal_bytes = 2*sizeof(GLshort);
+    uv_bytes = with_uvs ? 2*sizeof(uint16_t) : 0;
+  }else{
+    position_bytes = sizeof(vec4);
+    normal_bytes = sizeof(vec3);
+    uv_bytes = with_uvs ? sizeof(vec2) : 0;
+  }
+}
+
+/**
+  Set up the attributes and vertex_bytes of n vertices in format and
+    layout, leaving data alone.  For filling buffers other than
+    packed.data, such as a mapped GL buffer (see MeshCodec.h).
+**/
+inline void layoutVertices(size_t n, bool with_uvs, VertexFormat format, VertexLayout layout, PackedVertices &packed){
+  bool compact = (format == VERTEX_COMPACT);
+
+  packed.layout = layout;
+  packed.position_scale = vec3(1,1,1);
+  packed.position_bias = vec3(0,0,0);
+  packed.oct_normals = compact;
+
+  size_t position_bytes, normal_bytes, uv_bytes;
+  attribBytes(format, with_uvs, position_bytes, normal_bytes, uv_bytes);
+  if( compact ){
+    packed.position = VertexAttrib(3, GL_UNSIGNED_SHORT, GL_TRUE, 0, 0);
+    packed.normal   = VertexAttrib(2, GL_SHORT, GL_TRUE, 0, 0);
+    packed.uv       = VertexAttrib(2, GL_HALF_FLOAT, GL_FALSE, 0, 0);
+  }else{
+    packed.position = VertexAttrib(4, GL_FLOAT, GL_FALSE, 0, 0);
+    packed.normal   = VertexAttrib(3, GL_FLOAT, GL_FALSE, 0, 0);
+    packed.uv       = VertexAttrib(2, GL_FLOAT, GL_FALSE, 0, 0);
+  }
+  if( !with_uvs ){ packed.uv = VertexAttrib(); }
+  packed.vertex_bytes = position_bytes + normal_bytes + uv_bytes;
+
+  if( layout == VERTEX_INTERLEAVED ){
+    GLsizei stride = (GLsizei) packed.vertex_bytes;
+    packed.position.stride = packed.normal.stride = stride;
+    packed.normal.offset = position_bytes;
+    if( with_uvs ){
+      packed.uv.stride = stride;
+      packed.uv.offset = position_bytes + normal_bytes;
+    }
+  }else{
+    //Compact positions keep their padding, so they need an explicit stride
+    if( compact ){ packed.position.stride = (GLsizei) position_bytes; }
+    packed.normal.offset = n*position_bytes;
+    if( with_uvs ){ packed.uv.offset = n*(position_bytes + normal_bytes); }
+  }
+}
+
+/**
+  Fill packed with the vertex buffer contents for the given streams in a
+    single pass over the arrays.
+  @param uvs may be empty (or shorter than positions) to leave uvs out
+  @param layout VERTEX_PLANAR stores all positions, then all normals, then
+    all uvs; VERTEX_INTERLEAVED stores each vertex contiguously
+**/
+inline void packVertices(const std::vector< vec4 > &positions,
+                         const std::vector< vec3 > &normals,
+                         const std::vector< vec2 > &uvs,
+                         VertexFormat format, VertexLayout layout, PackedVertices &packed){
+  size_t n = positions.size();
+  bool with_uvs = !uvs.empty() && uvs.size() >= n;
+  bool compact = (format == VERTEX_COMPACT);
+
+  layoutVertices(n, with_uvs, format, layout, packed);
+  size_t position_bytes, normal_bytes, uv_bytes;
+  attribBytes(format, with_uvs, position_bytes, normal_bytes, uv_bytes);
+  packed.data.resize(n*packed.vertex_bytes);
+  if( n == 0 ){ return; }
+  unsigned char *base = &packed.data[0];
+
+  if( !compact ){
+    for(size_t i=0; i < n; i++){
+      memcpy(attribAt(base, packed.position, position_bytes, i), &positions[i], position_bytes);
+      memcpy(attribAt(base, packed.normal, normal_bytes, i), &normals[i], normal_bytes);
+      if( with_uvs ){ memcpy(attribAt(base, packed.uv, uv_bytes, i), &uvs[i], uv_bytes); }
+    }
+    return;
+  }
+
+  //Quantize positions against their own bounding box
+  vec3 lo( (std::numeric_limits< float >::max)());
+  vec3 hi(-(std::numeric_limits< float >::max)());
+  for(size_t i=0; i < n; i++){
+    for(int k=0; k < 3; k++){
+      lo[k] = (std::min)(lo[k], positions[i][k]);
+      hi[k] = (std::max)(hi[k], positions[i][k]);
+    }
+  }
+  vec3 extent(0,0,0);
+  for(int k=0; k < 3; k++){ extent[k] = (hi[k] > lo[k]) ? hi[k] - lo[k] : 1.0f; }
+  packed.position_scale = extent;
+  packed.position_bias = lo;
+
+  for(size_t i=0; i < n; i++){
+    GLushort p[4];
+    for(int k=0; k < 3; k++){
+      float q = (positions[i][k] - packed.position_bias[k]) / extent[k];
+      p[k] = (GLushort) floor((std::max)(0.0f, (std::min)(1.0f, q))*65535.0f + 0.5f);
+    }
+    p[3] = 0;
+    memcpy(attribAt(base, packed.position, position_bytes, i), p, sizeof(p));
+
+    GLshort nn[2];
+    octEncode(normals[i], nn);
+    memcpy(attribAt(base, packed.normal, normal_bytes, i), nn, sizeof(nn));
+
+    if( with_uvs ){
+      uint16_t t[2] = { floatToHalf(uvs[i].x), floatToHalf(uvs[i].y) };
+      memcpy(attribAt(base, packed.uv, uv_bytes, i), t, sizeof(t));
+    }
+  }
+}
+
+//Point the currently bound VAO at the packed buffer (bound to GL_ARRAY_BUFFER)
+inline void setVertexAttribs(const PackedVertices &packed, GLint vPosition, GLint vNormal, GLint vTexCoord=-1){
+  const VertexAttrib *attribs[3] = { &packed.position, &packed.normal, &packed.uv };
+  GLint locations[3] = { vPosition, vNormal, vTexCoord };
+  for(int a=0; a < 3; a++){
+    if( locations[a] < 0 ){ continue; }
+    if( attribs[a]->size == 0 ){
+      glDisableVertexAttribArray( locations[a] );
+      continue;
+    }
+    glEnableVertexAttribArray( locations[a] );
+    glVertexAttribPointer( locations[a], attribs[a]->size, attribs[a]->type, attribs[a]->normalized,
+                           attribs[a]->stride, BUFFER_OFFSET(attribs[a]->offset) );
+  }
+}
+
+#endif //__VERTEX_PACK_H__
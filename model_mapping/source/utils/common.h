@@ -126,7 +126,16 @@ static void check_program_link(GLuint program){
 
 #include "lodepng.h"
 #include "Trackball.h"
+#include "MappedFile.h"
+#include "ObjScan.h"
+#include "Parallel.h"
 #include "ObjMesh.h"
+#include "VertexPack.h"
+#include "MeshLoader.h"
+#include "MeshResidency.h"
+#include "LodSelect.h"
+#include "MeshletCull.h"
+#include "MeshBVH.h"
 #include "CubeMap.h"
 
 